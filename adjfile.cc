@@ -0,0 +1,469 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+#include "misc.h"
+#include "adjfile.h"
+
+using std::pair;
+using std::string;
+using std::vector;
+
+namespace {
+
+const char ADJ_MAGIC[8] = { 'A', 'Z', 'R', 'V', 'A', 'D', 'J', '1' };
+
+const uint64_t NO_ROW = std::numeric_limits<uint64_t>::max();
+
+// bytes of slack after the rows, so that 16 byte SIMD loads never leave
+// the mapping
+const size_t ADJ_PADDING = 16;
+
+struct AdjHeader {
+    char magic[8];
+    uint64_t num_verts;
+    uint64_t num_rows;
+    uint64_t num_edges;
+    uint64_t rank_pos;
+    uint64_t offset_pos;
+};
+
+void put_varint( vector<uint8_t> &out, uint64_t x ) {
+    while ( x >= 0x80 ) {
+        out.push_back( static_cast<uint8_t>( x | 0x80 ) );
+        x >>= 7;
+    }
+    out.push_back( static_cast<uint8_t>( x ) );
+}
+
+const uint8_t* get_varint( const uint8_t *in, uint64_t &x ) {
+    x = 0;
+    for ( int shift = 0; ; shift += 7 ) {
+        uint8_t b = *in++;
+        x |= static_cast<uint64_t>( b & 0x7f ) << shift;
+        if ( b < 0x80 ) break;
+    }
+    return in;
+}
+
+/**
+ * Stream VByte: a block of 2 bit length codes, four per control byte,
+ * followed by the 1 to 4 significant bytes of every value.
+ */
+void put_stream_vbyte( vector<uint8_t> &out, const vector<uint32_t> &values ) {
+
+    size_t n = values.size();
+    size_t ctrl_pos = out.size();
+    out.resize( out.size() + ( n + 3 )/4, 0 );
+
+    for ( size_t i = 0; i < n; ++i ) {
+        uint32_t v = values[i];
+        int len = ( v < (1u << 8) ? 1 :
+                    v < (1u << 16) ? 2 :
+                    v < (1u << 24) ? 3 : 4 );
+        out[ctrl_pos + i/4] |= static_cast<uint8_t>( (len - 1) << (2*(i%4)) );
+        for ( int b = 0; b < len; ++b ) {
+            out.push_back( static_cast<uint8_t>( v >> (8*b) ) );
+        }
+    }
+}
+
+#if defined(__SSSE3__)
+
+struct VByteTables {
+    __m128i shuffle[256];
+    uint8_t length[256];
+
+    VByteTables() {
+        for ( int c = 0; c < 256; ++c ) {
+            uint8_t mask[16];
+            int pos = 0;
+            for ( int i = 0; i < 4; ++i ) {
+                int len = ( ( c >> (2*i) ) & 3 ) + 1;
+                for ( int b = 0; b < 4; ++b ) {
+                    mask[4*i + b] = ( b < len ? pos + b : 0x80 );
+                }
+                pos += len;
+            }
+            shuffle[c] = _mm_loadu_si128(
+                                reinterpret_cast<const __m128i*>( mask ) );
+            length[c] = pos;
+        }
+    }
+};
+
+const VByteTables& vbyte_tables() {
+    static const VByteTables tables;
+    return tables;
+}
+
+#endif
+
+const uint8_t* get_stream_vbyte( const uint8_t *in, const size_t n,
+                                 uint32_t *out ) {
+
+    const uint8_t *ctrl = in;
+    const uint8_t *data = in + ( n + 3 )/4;
+
+    size_t i = 0;
+
+#if defined(__SSSE3__)
+    const VByteTables &tables = vbyte_tables();
+    for ( ; i + 4 <= n; i += 4 ) {
+        uint8_t c = ctrl[i/4];
+        __m128i d = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( out + i ),
+                          _mm_shuffle_epi8( d, tables.shuffle[c] ) );
+        data += tables.length[c];
+    }
+#endif
+
+    for ( ; i < n; ++i ) {
+        int len = ( ( ctrl[i/4] >> (2*(i%4)) ) & 3 ) + 1;
+        uint32_t v = 0;
+        for ( int b = 0; b < len; ++b ) {
+            v |= static_cast<uint32_t>( data[b] ) << (8*b);
+        }
+        out[i] = v;
+        data += len;
+    }
+
+    return data;
+}
+
+/**
+ * The end of a stream of n values starting at 'in', from its length codes,
+ * or null if the stream does not fit before 'end'.
+ */
+const uint8_t* stream_vbyte_end( const uint8_t *in, const size_t n,
+                                 const uint8_t *end ) {
+
+    size_t ctrl_len = ( n + 3 )/4;
+    if ( in > end || ctrl_len > static_cast<size_t>( end - in ) ) {
+        return nullptr;
+    }
+
+    size_t data_len = 0;
+    for ( size_t i = 0; i < n; ++i ) {
+        data_len += ( ( in[i/4] >> (2*(i%4)) ) & 3 ) + 1;
+    }
+
+    const uint8_t *data = in + ctrl_len;
+    if ( data_len > static_cast<size_t>( end - data ) ) return nullptr;
+
+    return data + data_len;
+}
+
+}
+
+
+/**
+ * 'rank' holds the 1-based centrality rank of every vertex, the order in
+ * which the neighbors of each row must be given. With 'append' the rows
+ * of the file are kept and new ones follow them.
+ */
+AdjWriter::AdjWriter( const string &filename,
+                      const vector<uint32_t> &rank,
+                      const bool append ) {
+
+    _num_verts = rank.size();
+    _num_rows = 0;
+    _num_edges = 0;
+    _rank = rank;
+    _offsets.assign( _num_verts, NO_ROW );
+
+    if ( append ) {
+        _fp = fopen_csv( filename, "r+", false );
+        fseek( _fp, 0, SEEK_END );
+        _pos = ftell( _fp );
+        if ( _pos < sizeof(AdjHeader) ) {
+            fprintf( stderr, "Bad adjacency file: %s\n", filename.c_str() );
+            abort();
+        }
+        return;
+    }
+
+    _fp = fopen_csv( filename, "w", false );
+
+    AdjHeader header;
+    memset( &header, 0, sizeof(header) );
+    fwrite( &header, sizeof(header), 1, _fp );
+    _pos = sizeof(header);
+}
+
+/**
+ * The rows written before an append, as (vertex, position) pairs, and
+ * their number of edges.
+ */
+void AdjWriter::resume( const vector<pair<size_t,uint64_t>> &rows,
+                        const size_t num_edges ) {
+
+    for ( const pair<size_t,uint64_t> &row : rows ) {
+        if ( row.first >= _num_verts || row.second >= _pos ) {
+            fprintf( stderr, "Bad resumed row: %zd\n", row.first );
+            abort();
+        }
+        _offsets[row.first] = row.second;
+    }
+
+    _num_rows += rows.size();
+    _num_edges += num_edges;
+}
+
+/**
+ * Put the rows written so far on disk, up to position().
+ */
+void AdjWriter::sync() {
+
+    if ( fflush( _fp ) != 0 || fdatasync( fileno( _fp ) ) != 0 ) {
+        fprintf( stderr, "Error syncing adjacency file\n" );
+        abort();
+    }
+}
+
+AdjWriter::~AdjWriter() {
+    if ( _fp != NULL ) close();
+}
+
+template <typename V, typename W>
+void AdjWriter::write_row( const size_t vertex,
+                           const vector<pair<V,W>> &edges ) {
+
+    if ( vertex >= _num_verts ) {
+        fprintf( stderr, "Vertex out of range: %zd\n", vertex );
+        abort();
+    }
+
+    _buffer.clear();
+    put_varint( _buffer, edges.size() );
+
+    _values.clear();
+    uint32_t last = 0;
+    for ( const pair<V,W> &edge : edges ) {
+        uint32_t r = ( static_cast<size_t>( edge.first ) < _num_verts ?
+                                                    _rank[edge.first] : 0 );
+        if ( r == 0 || r > _num_verts ) {
+            fprintf( stderr, "Row %zd has an unranked neighbor: %zd\n",
+                             vertex, static_cast<size_t>( edge.first ) );
+            abort();
+        }
+        if ( r <= last ) {
+            fprintf( stderr, "Row %zd is not in rank order\n", vertex );
+            abort();
+        }
+        _values.push_back( r - last );
+        last = r;
+    }
+    put_stream_vbyte( _buffer, _values );
+
+    _values.clear();
+    for ( const pair<V,W> &edge : edges ) {
+        if ( edge.second > std::numeric_limits<uint32_t>::max() ) {
+            fprintf( stderr, "Weight too large: %zd\n",
+                             static_cast<size_t>( edge.second ) );
+            abort();
+        }
+        _values.push_back( edge.second );
+    }
+    put_stream_vbyte( _buffer, _values );
+
+    fwrite( _buffer.data(), 1, _buffer.size(), _fp );
+
+    _offsets[vertex] = _pos;
+    _pos += _buffer.size();
+
+    ++_num_rows;
+    _num_edges += edges.size();
+}
+
+template void AdjWriter::write_row( const size_t,
+                                    const vector<pair<uint32_t,uint32_t>>& );
+template void AdjWriter::write_row( const size_t,
+                                    const vector<pair<uint64_t,uint64_t>>& );
+
+void AdjWriter::close() {
+
+    uint8_t padding[ADJ_PADDING] = { 0 };
+    fwrite( padding, 1, ADJ_PADDING, _fp );
+    _pos += ADJ_PADDING;
+
+    AdjHeader header;
+    memcpy( header.magic, ADJ_MAGIC, sizeof(ADJ_MAGIC) );
+    header.num_verts = _num_verts;
+    header.num_rows = _num_rows;
+    header.num_edges = _num_edges;
+
+    // invert the ranks
+    vector<uint32_t> rank_vertex( _num_verts, 0 );
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        if ( _rank[v] > 0 && _rank[v] <= _num_verts ) {
+            rank_vertex[_rank[v] - 1] = v;
+        }
+    }
+
+    header.rank_pos = _pos;
+    fwrite( rank_vertex.data(), sizeof(uint32_t), _num_verts, _fp );
+    _pos += _num_verts*sizeof(uint32_t);
+
+    // keep the offset table 8 byte aligned
+    while ( _pos % sizeof(uint64_t) ) {
+        fputc( 0, _fp );
+        ++_pos;
+    }
+
+    header.offset_pos = _pos;
+    fwrite( _offsets.data(), sizeof(uint64_t), _num_verts, _fp );
+    _pos += _num_verts*sizeof(uint64_t);
+
+    rewind( _fp );
+    fwrite( &header, sizeof(header), 1, _fp );
+
+    fclose( _fp );
+    _fp = NULL;
+}
+
+
+AdjReader::AdjReader( const string &filename ) {
+
+    _fd = open( filename.c_str(), O_RDONLY );
+    if ( _fd < 0 ) {
+        fprintf( stderr, "Could not open file: %s\n", filename.c_str() );
+        abort();
+    }
+
+    struct stat st;
+    fstat( _fd, &st );
+    _size = st.st_size;
+
+    if ( _size < sizeof(AdjHeader) ) {
+        fprintf( stderr, "Bad adjacency file: %s\n", filename.c_str() );
+        abort();
+    }
+
+    void *map = mmap( NULL, _size, PROT_READ, MAP_SHARED, _fd, 0 );
+    if ( map == MAP_FAILED ) {
+        fprintf( stderr, "Could not map file: %s\n", filename.c_str() );
+        abort();
+    }
+    _base = static_cast<const uint8_t*>( map );
+
+    const AdjHeader *header = reinterpret_cast<const AdjHeader*>( _base );
+
+    // the rows, then the rank and offset tables, all within the file
+    if ( memcmp( header->magic, ADJ_MAGIC, sizeof(ADJ_MAGIC) ) != 0 ||
+         header->num_verts > _size/sizeof(uint64_t) ||
+         header->rank_pos < sizeof(AdjHeader) ||
+         header->rank_pos + header->num_verts*sizeof(uint32_t) >
+                                                    header->offset_pos ||
+         header->offset_pos + header->num_verts*sizeof(uint64_t) > _size ) {
+        fprintf( stderr, "Bad adjacency file: %s\n", filename.c_str() );
+        abort();
+    }
+
+    _num_verts = header->num_verts;
+    _num_rows = header->num_rows;
+    _num_edges = header->num_edges;
+    _rows_end = header->rank_pos;
+    _rank_vertex = reinterpret_cast<const uint32_t*>(
+                                            _base + header->rank_pos );
+    _offsets = reinterpret_cast<const uint64_t*>( _base + header->offset_pos );
+}
+
+AdjReader::~AdjReader() {
+    munmap( const_cast<uint8_t*>( _base ), _size );
+    close( _fd );
+}
+
+/**
+ * The position of the row of a vertex, which must lie among the rows, or
+ * NO_ROW.
+ */
+uint64_t AdjReader::offset( const size_t vertex ) const {
+
+    if ( vertex >= _num_verts || _offsets[vertex] == NO_ROW ) return NO_ROW;
+
+    if ( _offsets[vertex] < sizeof(AdjHeader) ||
+                                        _offsets[vertex] >= _rows_end ) {
+        fprintf( stderr, "Bad row in adjacency file: %zd\n", vertex );
+        abort();
+    }
+
+    return _offsets[vertex];
+}
+
+size_t AdjReader::degree( const size_t vertex ) const {
+
+    uint64_t pos = offset( vertex );
+    if ( pos == NO_ROW ) return 0;
+
+    uint64_t count;
+    get_varint( _base + pos, count );
+    return count;
+}
+
+/**
+ * Decode the row of a vertex: its neighbors, in rank order, and the
+ * weights of the edges. Returns the number of neighbors.
+ */
+size_t AdjReader::row( const size_t vertex,
+                       vector<uint32_t> &neighbors,
+                       vector<uint32_t> &weights ) const {
+
+    neighbors.clear();
+    weights.clear();
+
+    uint64_t pos = offset( vertex );
+    if ( pos == NO_ROW ) return 0;
+
+    uint64_t count;
+    const uint8_t *in = get_varint( _base + pos, count );
+
+    // every neighbor takes at least a byte of gap and one of weight
+    if ( count > ( _rows_end - pos )/2 ) {
+        fprintf( stderr, "Bad row in adjacency file: %zd\n", vertex );
+        abort();
+    }
+
+    // the length codes of both streams must stay within the rows
+    const uint8_t *rows_end = _base + _rows_end;
+    const uint8_t *weights_in = stream_vbyte_end( in, count, rows_end );
+    if ( weights_in == nullptr ||
+         stream_vbyte_end( weights_in, count, rows_end ) == nullptr ) {
+        fprintf( stderr, "Bad row in adjacency file: %zd\n", vertex );
+        abort();
+    }
+
+    neighbors.resize( count );
+    weights.resize( count );
+
+    get_stream_vbyte( in, count, neighbors.data() );
+    get_stream_vbyte( weights_in, count, weights.data() );
+
+    // the gaps are at least 1 and the ranks within the table, which maps
+    // them to vertices of the graph
+    uint64_t rank = 0;
+    for ( size_t i = 0; i < count; ++i ) {
+        rank += neighbors[i];
+        if ( neighbors[i] == 0 || rank > _num_verts ||
+                                    _rank_vertex[rank - 1] >= _num_verts ) {
+            fprintf( stderr, "Bad row in adjacency file: %zd\n", vertex );
+            abort();
+        }
+        neighbors[i] = _rank_vertex[rank - 1];
+    }
+
+    return count;
+}
@@ -0,0 +1,108 @@
+#ifndef ADJFILE_H
+#define ADJFILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * A compressed adjacency file with random access to every row.
+ *
+ * Layout, all integers in host byte order:
+ *
+ *    header    magic "AZRVADJ1", num_verts, num_rows, num_edges,
+ *              rank table position, offset table position (uint64 each)
+ *    rows      varint neighbor count, then the gaps between the ranks of
+ *              consecutive neighbors and the edge weights, each packed
+ *              with stream VByte
+ *    ranks     uint32 vertex of each rank, rank 1 first
+ *    offsets   uint64 file position of the row of each vertex, or
+ *              UINT64_MAX for vertices without a row
+ *
+ * Neighbors are stored in centrality rank order, so the gaps are small.
+ *
+ * A writer opened with 'append' carries on with a file which an earlier,
+ * interrupted writer had synced up to position(); resume() hands it the
+ * rows already there, which the header and tables are only written for
+ * on close().
+ */
+
+class AdjWriter {
+
+ private:
+    FILE *_fp;
+    size_t _num_verts;
+    size_t _num_rows;
+    size_t _num_edges;
+    uint64_t _pos;
+    std::vector<uint32_t> _rank;
+    std::vector<uint64_t> _offsets;
+    std::vector<uint32_t> _values;
+    std::vector<uint8_t> _buffer;
+
+ public:
+    AdjWriter( const std::string &filename,
+               const std::vector<uint32_t> &rank,
+               const bool append = false );
+
+    ~AdjWriter();
+
+    uint64_t position() const {
+        return _pos;
+    }
+
+    void resume( const std::vector<std::pair<size_t,uint64_t>> &rows,
+                 const size_t num_edges );
+
+    void sync();
+
+    template <typename V, typename W>
+    void write_row( const size_t vertex,
+                    const std::vector<std::pair<V,W>> &edges );
+
+    void close();
+
+};
+
+class AdjReader {
+
+ private:
+    int _fd;
+    const uint8_t *_base;
+    size_t _size;
+    size_t _num_verts;
+    size_t _num_rows;
+    size_t _num_edges;
+    uint64_t _rows_end;
+    const uint32_t *_rank_vertex;
+    const uint64_t *_offsets;
+
+ public:
+    AdjReader( const std::string &filename );
+
+    ~AdjReader();
+
+    size_t num_verts() const {
+        return _num_verts;
+    }
+    size_t num_rows() const {
+        return _num_rows;
+    }
+    size_t num_edges() const {
+        return _num_edges;
+    }
+
+    size_t degree( const size_t vertex ) const;
+
+    size_t row( const size_t vertex,
+                std::vector<uint32_t> &neighbors,
+                std::vector<uint32_t> &weights ) const;
+
+ private:
+    uint64_t offset( const size_t vertex ) const;
+
+};
+
+#endif // ADJFILE_H
@@ -0,0 +1,349 @@
+/**
+ * End to end benchmark on synthetic data. For each size, in reviews, the
+ * metadata is generated, every Reviews and Graph stage is run on it, and
+ * the outputs are checksummed. The throughput of each stage, and how its
+ * time scales from one size to the next, are printed when all sizes are
+ * done; each size also gets a JSON report with the per-stage details.
+ *
+ * Usage: bench [--dir <work dir>] [--ref <reference dir>] [--update]
+ *              [num_reviews ...]
+ *
+ * With --ref the checksums are compared with those of an earlier run, and
+ * --update stores them as the new reference. The generated data does not
+ * depend on the platform, but the edge order of reduce_edges depends on
+ * the standard library's hashing, so references are per toolchain and
+ * none are kept in the repository: the first run must be --update. A
+ * missing reference counts as a failure; without --ref nothing is checked.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "graph.h"
+#include "misc.h"
+#include "reviews.h"
+#include "stats.h"
+#include "synth.h"
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+const char *bench_prefix = "bench/";
+
+/**
+ * 64 bit FNV-1a of a file's contents
+ */
+uint64_t checksum( const string &filename ) {
+
+    FILE *fp = fopen_csv( filename, "r", false );
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    char buffer[1 << 16];
+    size_t len;
+    while ( ( len = fread( buffer, 1, sizeof( buffer ), fp ) ) > 0 ) {
+        for ( size_t i = 0; i < len; ++i ) {
+            hash ^= static_cast<unsigned char>( buffer[i] );
+            hash *= 0x100000001b3ull;
+        }
+    }
+
+    fclose( fp );
+
+    return hash;
+}
+
+size_t count_rows( const string &filename ) {
+
+    FILE *fp = fopen_csv( filename, "r" );
+
+    char *line = NULL;
+    size_t len = 0;
+    size_t num_rows = 0;
+
+    while ( getline( &line, &len, fp ) != -1 ) ++num_rows;
+
+    free( line );
+    fclose( fp );
+
+    return num_rows;
+}
+
+string read_file( const string &filename ) {
+    std::ifstream in( filename );
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+/**
+ * Run every stage on num_reviews generated reviews in 'dir'. Returns the
+ * checksums of the outputs, one "file\tchecksum" row each.
+ */
+string run_size( const size_t num_reviews, const string &dir ) {
+
+    string meta_file = dir + "meta.tsv";
+    string reviewer_index_filename = dir + "index_reviewers.csv";
+    string edges_dir = dir + "tmp3";
+    string edges_file = dir + "ar_edges.csv";
+    string degree_dist_file = dir + "ar_degree_dist.csv";
+    string evc_file = dir + "ar_evc.csv";
+    string tmp_buckets = dir + "tmp4";
+    string mat_file = dir + "ar_mat.bin";
+    string cluster_mem_file = dir + "ar_cluster_mem.csv";
+    string triangles_file = dir + "ar_triangles.csv";
+
+    mkdir( dir.c_str(), 0755 );
+    mkdir( edges_dir.c_str(), 0755 );
+    mkdir( tmp_buckets.c_str(), 0755 );
+
+    string prefix = bench_prefix;
+
+    size_t num_rows;
+    {
+        StageTimer timer( prefix + "generate" );
+        num_rows = generate_metadata( meta_file, SynthParams( num_reviews ) );
+        timer.add_rows( num_rows );
+        timer.add_file( meta_file );
+    }
+
+    StageTimer load_timer( prefix + "load_reviews" );
+    Reviews reviews( meta_file );
+    load_timer.add_rows( num_rows );
+    load_timer.add_file( meta_file );
+    load_timer.stop();
+
+    {
+        StageTimer timer( prefix + "condense_links" );
+        reviews.condense_links();
+        reviews.reviews_per_reviewer();
+        timer.add_rows( reviews.num_products() );
+    }
+    {
+        StageTimer timer( prefix + "output_reviewer_index" );
+        reviews.output_reviewer_index( reviewer_index_filename );
+        timer.add_rows( reviews.num_reviewers() );
+        timer.add_file( reviewer_index_filename );
+    }
+    {
+        StageTimer timer( prefix + "map_edges" );
+        reviews.map_edges( edges_dir );
+        timer.add_rows( num_rows );
+    }
+
+    // the projected pairs written by map_edges are the rows to reduce
+    size_t num_pairs = 0;
+    for ( const StageStats &stats : stage_stats() ) {
+        if ( stats.name == "map_edges" ) num_pairs = stats.rows;
+    }
+
+    {
+        StageTimer timer( prefix + "reduce_edges" );
+        Reviews::reduce_edges( edges_dir, edges_file );
+        timer.add_rows( num_pairs );
+        timer.add_file( edges_file );
+    }
+
+    size_t num_edges = count_rows( edges_file );
+
+    Graph graph( reviews.num_reviewers() );
+
+    {
+        StageTimer timer( prefix + "degree_dist" );
+        graph.degree_dist( edges_file, degree_dist_file );
+        timer.add_rows( num_edges );
+        timer.add_file( edges_file );
+    }
+    {
+        StageTimer timer( prefix + "eigen_vect_cent" );
+        graph.eigen_vect_cent( edges_file, evc_file, 20, 1.0e-10 );
+        timer.add_rows( num_edges );
+        timer.add_file( edges_file );
+    }
+    {
+        StageTimer timer( prefix + "cluster_stats" );
+        graph.cluster_stats( edges_file, cluster_mem_file );
+        timer.add_rows( num_edges );
+        timer.add_file( edges_file );
+    }
+
+    double Q;
+    {
+        StageTimer timer( prefix + "modularity" );
+        Q = graph.modularity( edges_file, degree_dist_file, cluster_mem_file );
+        timer.add_rows( num_edges );
+        timer.add_file( edges_file );
+    }
+    {
+        StageTimer timer( prefix + "convert_list_to_mat" );
+        graph.convert_list_to_mat( edges_file, degree_dist_file, evc_file,
+                                   tmp_buckets, mat_file );
+        timer.add_rows( num_edges );
+        timer.add_file( edges_file );
+    }
+    {
+        StageTimer timer( prefix + "triangle_stats" );
+        graph.triangle_stats( edges_file, triangles_file );
+        timer.add_rows( num_edges );
+        timer.add_file( edges_file );
+    }
+
+    std::ostringstream sums;
+
+    const string outputs[] = { reviewer_index_filename, edges_file,
+                               degree_dist_file, evc_file, cluster_mem_file,
+                               mat_file, triangles_file };
+
+    for ( const string &output : outputs ) {
+        char hex[17];
+        snprintf( hex, sizeof( hex ), "%016llx",
+                  static_cast<unsigned long long>( checksum( output ) ) );
+        sums << output.substr( dir.size() ) << "\t" << hex << "\n";
+    }
+
+    char modularity[32];
+    snprintf( modularity, sizeof( modularity ), "%14.7e", Q );
+    sums << "modularity\t" << modularity << "\n";
+
+    return sums.str();
+}
+
+}
+
+int main( int argc, char* argv[] ) {
+
+    string work_dir = "Bench/";
+    string ref_dir;
+    bool update = false;
+    vector<size_t> sizes;
+
+    for ( int a = 1; a < argc; ++a ) {
+        string arg = argv[a];
+        if ( arg == "--dir" && a + 1 < argc ) {
+            work_dir = string( argv[++a] ) + "/";
+        } else if ( arg == "--ref" && a + 1 < argc ) {
+            ref_dir = string( argv[++a] ) + "/";
+        } else if ( arg == "--update" ) {
+            update = true;
+        } else if ( arg[0] != '-' ) {
+            sizes.push_back( strtoul( arg.c_str(), NULL, 10 ) );
+        } else {
+            fprintf( stderr, "Usage: %s [--dir <work dir>] "
+                             "[--ref <reference dir>] [--update] "
+                             "[num_reviews ...]\n", argv[0] );
+            exit(1);
+        }
+    }
+
+    if ( sizes.empty() ) sizes = { 10000, 100000, 1000000 };
+
+    if ( ref_dir.empty() ) {
+        fprintf( stderr, "No --ref given: the outputs are not checked\n" );
+    }
+
+    mkdir( work_dir.c_str(), 0755 );
+    if ( !ref_dir.empty() ) mkdir( ref_dir.c_str(), 0755 );
+
+    // stage -> its measurement at each size
+    map<string,vector<StageStats>> results;
+    vector<string> stage_order;
+    int failures = 0;
+
+    for ( size_t n : sizes ) {
+
+        fprintf( stderr, "Benchmarking %zd reviews...\n", n );
+
+        string dir = work_dir + std::to_string( n ) + "/";
+
+        clear_stage_stats();
+
+        string sums = run_size( n, dir );
+
+        write_stats_report( dir + "stats.json" );
+
+        for ( const StageStats &stats : stage_stats() ) {
+            if ( stats.name.compare( 0, strlen( bench_prefix ),
+                                     bench_prefix ) != 0 ) continue;
+            string stage = stats.name.substr( strlen( bench_prefix ) );
+            if ( !results.count( stage ) ) stage_order.push_back( stage );
+            results[stage].push_back( stats );
+        }
+
+        if ( ref_dir.empty() ) continue;
+
+        string ref_file = ref_dir + std::to_string( n ) + ".tsv";
+
+        if ( update ) {
+            FILE *fp = fopen_csv( ref_file, "w", false );
+            fputs( sums.c_str(), fp );
+            fclose( fp );
+        } else if ( access( ref_file.c_str(), R_OK ) != 0 ) {
+            fprintf( stderr, "%zd reviews: no reference %s, create it with "
+                             "--update\n", n, ref_file.c_str() );
+            ++failures;
+        } else if ( read_file( ref_file ) != sums ) {
+            fprintf( stderr, "%zd reviews: outputs differ from %s\n",
+                             n, ref_file.c_str() );
+            ++failures;
+        } else {
+            fprintf( stderr, "%zd reviews: outputs match %s\n",
+                             n, ref_file.c_str() );
+        }
+    }
+
+    fprintf( stdout, "%-22s %10s %10s %12s %10s %10s\n",
+             "stage", "reviews", "seconds", "rows/s", "MB/s", "peak MB" );
+
+    for ( const string &stage : stage_order ) {
+        const vector<StageStats> &runs = results[stage];
+        for ( size_t s = 0; s < runs.size(); ++s ) {
+            double secs = runs[s].wall_seconds;
+            fprintf( stdout, "%-22s %10zd %10.3f %12.4e %10.1f %10.1f\n",
+                     stage.c_str(), sizes[s], secs,
+                     secs > 0.0 ? runs[s].rows/secs : 0.0,
+                     secs > 0.0 ? runs[s].bytes/secs/1048576.0 : 0.0,
+                     runs[s].process_peak_rss_kb/1024.0 );
+        }
+    }
+
+    // the exponent of time ~ reviews^k between consecutive sizes
+    if ( sizes.size() > 1 ) {
+
+        fprintf( stdout, "\n%-22s", "scaling exponent" );
+        for ( size_t s = 1; s < sizes.size(); ++s ) {
+            fprintf( stdout, " %9zd>%-9zd", sizes[s-1], sizes[s] );
+        }
+        fprintf( stdout, "\n" );
+
+        for ( const string &stage : stage_order ) {
+            const vector<StageStats> &runs = results[stage];
+            fprintf( stdout, "%-22s", stage.c_str() );
+            for ( size_t s = 1; s < runs.size(); ++s ) {
+                double t0 = runs[s-1].wall_seconds;
+                double t1 = runs[s].wall_seconds;
+                double k = ( t0 > 0.0 && t1 > 0.0 ) ?
+                            log( t1/t0 )/log( static_cast<double>( sizes[s] )/
+                                              static_cast<double>( sizes[s-1] ) )
+                            : 0.0;
+                fprintf( stdout, " %19.2f", k );
+            }
+            fprintf( stdout, "\n" );
+        }
+    }
+
+    return failures ? 1 : 0;
+}
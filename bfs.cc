@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "bfs.h"
+#include "thread_pool.h"
+
+using std::vector;
+
+namespace {
+
+// switch to bottom-up when the frontier has more than 1/ALPHA of the
+// unexplored edges, and back when it holds less than 1/BETA of the
+// vertices (the values of Beamer et al.)
+const size_t ALPHA = 15;
+const size_t BETA = 18;
+
+}
+
+
+const uint32_t BFS::UNREACHED;
+
+BFS::BFS( const CSR &graph ) : _graph( graph ) {
+
+    _num_verts = graph.num_verts();
+    _num_words = ( _num_verts + 63 )/64;
+
+    _dist.assign( _num_verts, UNREACHED );
+    _visited.reset( new std::atomic<uint64_t>[_num_words] );
+    _front_bits.assign( _num_words, 0 );
+    _next_bits.assign( _num_words, 0 );
+
+    size_t num_slots = ThreadPool::instance().max_slots();
+    _found.resize( num_slots );
+    _found_degrees.assign( num_slots, 0 );
+
+    _eccentricity = 0;
+    _farthest = 0;
+}
+
+/**
+ * The hop distance of every vertex from 'source', UNREACHED outside of its
+ * component. Returns the number of vertices reached, the source included;
+ * eccentricity() is then the last level and farthest() its smallest
+ * vertex, whatever the number of threads.
+ */
+size_t BFS::run( const size_t source ) {
+
+    if ( source >= _num_verts ) {
+        fprintf( stderr, "BFS source out of range: %zd\n", source );
+        abort();
+    }
+
+    std::fill( _dist.begin(), _dist.end(), UNREACHED );
+    for ( size_t w = 0; w < _num_words; ++w ) {
+        _visited[w].store( 0, std::memory_order_relaxed );
+    }
+
+    _dist[source] = 0;
+    _visited[source >> 6].store( 1ull << ( source & 63 ) );
+    _frontier.assign( 1, source );
+
+    size_t frontier_size = 1;
+    size_t frontier_edges = _graph.degree( source );
+    size_t unexplored = 2*_graph.num_edges() - frontier_edges;
+    size_t num_reached = 1;
+    bool bottom = false;
+    uint32_t level = 0;
+
+    _eccentricity = 0;
+    _farthest = source;
+
+    while ( frontier_size > 0 ) {
+
+        if ( !bottom && frontier_edges > unexplored/ALPHA ) {
+            list_to_bits();
+            bottom = true;
+        } else if ( bottom && frontier_size < _num_verts/BETA ) {
+            bits_to_list();
+            bottom = false;
+        }
+
+        if ( bottom ) {
+            frontier_size = bottom_up( level, frontier_edges );
+        } else {
+            frontier_edges = top_down( level );
+            frontier_size = _frontier.size();
+        }
+
+        unexplored -= std::min( unexplored, frontier_edges );
+
+        if ( frontier_size == 0 ) break;
+
+        ++level;
+        num_reached += frontier_size;
+
+        _eccentricity = level;
+        if ( bottom ) {
+            size_t w = 0;
+            while ( _front_bits[w] == 0 ) ++w;
+            _farthest = 64*w + __builtin_ctzll( _front_bits[w] );
+        } else {
+            _farthest = *std::min_element( _frontier.begin(),
+                                           _frontier.end() );
+        }
+    }
+
+    return num_reached;
+}
+
+/**
+ * Expand the frontier list along its edges, claiming each new vertex with
+ * an atomic or on the visited bitmap. Returns the degree sum of the next
+ * frontier, which replaces the current one.
+ */
+size_t BFS::top_down( const uint32_t level ) {
+
+    _frontier_degrees.assign( 1, 0 );
+    for ( uint32_t v : _frontier ) {
+        _frontier_degrees.push_back( _frontier_degrees.back() +
+                                     _graph.degree( v ) );
+    }
+
+    ThreadPool::instance().parallel_for_weighted(
+                                _frontier_degrees.data(), _frontier.size(),
+                                [&]( size_t begin, size_t end ) {
+
+        int slot = ThreadPool::slot();
+        vector<uint32_t> &found = _found[slot];
+        size_t edges = 0;
+
+        for ( size_t i = begin; i < end; ++i ) {
+            uint32_t v = _frontier[i];
+            const uint32_t *nbrs = _graph.neighbors( v );
+            for ( size_t e = 0; e < _graph.degree( v ); ++e ) {
+                uint32_t u = nbrs[e];
+                uint64_t bit = 1ull << ( u & 63 );
+                std::atomic<uint64_t> &word = _visited[u >> 6];
+                if ( word.load( std::memory_order_relaxed ) & bit ) continue;
+                if ( word.fetch_or( bit ) & bit ) continue;
+                _dist[u] = level + 1;
+                found.push_back( u );
+                edges += _graph.degree( u );
+            }
+        }
+
+        _found_degrees[slot] += edges;
+    });
+
+    _frontier.clear();
+    size_t edges = 0;
+    for ( size_t s = 0; s < _found.size(); ++s ) {
+        _frontier.insert( _frontier.end(), _found[s].begin(), _found[s].end() );
+        _found[s].clear();
+        edges += _found_degrees[s];
+        _found_degrees[s] = 0;
+    }
+
+    return edges;
+}
+
+/**
+ * Let every unvisited vertex search its neighbors for one in the frontier
+ * bitmap. Each task owns whole words of the bitmaps, so no atomics are
+ * needed. Returns the size of the next frontier, which replaces the
+ * current one, and its degree sum in next_edges.
+ */
+size_t BFS::bottom_up( const uint32_t level, size_t &next_edges ) {
+
+    ThreadPool &pool = ThreadPool::instance();
+
+    vector<size_t> counts( pool.max_slots(), 0 );
+
+    pool.parallel_for( 0, _num_words, [&]( size_t begin, size_t end ) {
+
+        int slot = ThreadPool::slot();
+        size_t count = 0;
+        size_t edges = 0;
+
+        for ( size_t w = begin; w < end; ++w ) {
+
+            uint64_t visited = _visited[w].load( std::memory_order_relaxed );
+            uint64_t unvisited = ~visited;
+            if ( w + 1 == _num_words && _num_verts % 64 ) {
+                unvisited &= ( 1ull << ( _num_verts % 64 ) ) - 1;
+            }
+
+            uint64_t next = 0;
+
+            while ( unvisited ) {
+                int i = __builtin_ctzll( unvisited );
+                unvisited &= unvisited - 1;
+
+                size_t v = 64*w + i;
+                const uint32_t *nbrs = _graph.neighbors( v );
+                for ( size_t e = 0; e < _graph.degree( v ); ++e ) {
+                    uint32_t u = nbrs[e];
+                    if ( ( _front_bits[u >> 6] >> ( u & 63 ) ) & 1 ) {
+                        next |= 1ull << i;
+                        _dist[v] = level + 1;
+                        ++count;
+                        edges += _graph.degree( v );
+                        break;
+                    }
+                }
+            }
+
+            _next_bits[w] = next;
+            if ( next ) {
+                _visited[w].store( visited | next, std::memory_order_relaxed );
+            }
+        }
+
+        counts[slot] += count;
+        _found_degrees[slot] += edges;
+    });
+
+    _front_bits.swap( _next_bits );
+
+    size_t count = 0;
+    next_edges = 0;
+    for ( size_t s = 0; s < counts.size(); ++s ) {
+        count += counts[s];
+        next_edges += _found_degrees[s];
+        _found_degrees[s] = 0;
+    }
+
+    return count;
+}
+
+void BFS::bits_to_list() {
+
+    _frontier.clear();
+    for ( size_t w = 0; w < _num_words; ++w ) {
+        uint64_t bits = _front_bits[w];
+        while ( bits ) {
+            _frontier.push_back( 64*w + __builtin_ctzll( bits ) );
+            bits &= bits - 1;
+        }
+    }
+}
+
+void BFS::list_to_bits() {
+
+    std::fill( _front_bits.begin(), _front_bits.end(), 0 );
+    for ( uint32_t v : _frontier ) {
+        _front_bits[v >> 6] |= 1ull << ( v & 63 );
+    }
+}
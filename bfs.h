@@ -0,0 +1,77 @@
+#ifndef BFS_H
+#define BFS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "csr.h"
+
+/**
+ * Parallel, direction-optimizing breadth first search on a CSR (Beamer,
+ * Asanovic and Patterson). Small frontiers are expanded top-down, from
+ * the frontier along its edges; once the frontier's edges outnumber a
+ * fraction of those left unexplored, every unvisited vertex instead
+ * looks bottom-up for a parent in a frontier bitmap and stops at the
+ * first one found, which skips most edges of the middle levels on a small
+ * world graph. Levels are split over the ThreadPool, top-down by frontier
+ * degree and bottom-up by 64-vertex words of the bitmaps.
+ *
+ * Usage:
+ *
+ *     BFS bfs( graph );
+ *     size_t num_reached = bfs.run( source );
+ *     const vector<uint32_t> &dist = bfs.distances();
+ */
+class BFS {
+
+ private:
+    const CSR &_graph;
+    size_t _num_verts;
+    size_t _num_words;
+
+    std::vector<uint32_t> _dist;
+    std::unique_ptr<std::atomic<uint64_t>[]> _visited;
+    std::vector<uint64_t> _front_bits;
+    std::vector<uint64_t> _next_bits;
+    std::vector<uint32_t> _frontier;
+    std::vector<size_t> _frontier_degrees;
+    std::vector<std::vector<uint32_t>> _found;
+    std::vector<size_t> _found_degrees;
+
+    uint32_t _eccentricity;
+    uint32_t _farthest;
+
+ public:
+    static const uint32_t UNREACHED = UINT32_MAX;
+
+    BFS( const CSR &graph );
+
+    size_t run( const size_t source );
+
+    const std::vector<uint32_t>& distances() const {
+        return _dist;
+    }
+
+    uint32_t eccentricity() const {
+        return _eccentricity;
+    }
+
+    uint32_t farthest() const {
+        return _farthest;
+    }
+
+ private:
+    size_t top_down( const uint32_t level );
+
+    size_t bottom_up( const uint32_t level, size_t &next_edges );
+
+    void bits_to_list();
+
+    void list_to_bits();
+
+};
+
+#endif // BFS_H
@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "bipartite.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "tsv_writer.h"
+
+using std::string;
+using std::unordered_map;
+using std::unordered_set;
+using std::vector;
+
+/**
+ * Copy the incidence out of Reviews::product_reviewers, as a product CSR
+ * with sorted reviewers and its transpose.
+ */
+template <typename V>
+BasicBipartite<V>::BasicBipartite(
+                        const unordered_map<V,unordered_set<V>> &prod_rev,
+                        const size_t num_reviewers ) {
+
+    _num_reviewers = num_reviewers;
+
+    _prod_offsets.push_back( 0 );
+    for ( const std::pair<const V,unordered_set<V>> &pr : prod_rev ) {
+        if ( pr.second.size() < 2 ) continue;
+        size_t first = _prod_reviewers.size();
+        for ( V reviewer : pr.second ) {
+            if ( reviewer >= _num_reviewers ) {
+                fprintf( stderr, "Reviewer out of range: %zd\n",
+                                        static_cast<size_t>( reviewer ) );
+                abort();
+            }
+            _prod_reviewers.push_back( reviewer );
+        }
+        std::sort( _prod_reviewers.begin() + first, _prod_reviewers.end() );
+        _prod_offsets.push_back( _prod_reviewers.size() );
+    }
+    _num_products = _prod_offsets.size() - 1;
+
+    _rev_offsets.assign( _num_reviewers + 1, 0 );
+    for ( V reviewer : _prod_reviewers ) ++_rev_offsets[reviewer + 1];
+    for ( size_t r = 0; r < _num_reviewers; ++r ) {
+        _rev_offsets[r + 1] += _rev_offsets[r];
+    }
+
+    vector<size_t> next( _rev_offsets.begin(), _rev_offsets.end() - 1 );
+    _rev_products.resize( _prod_reviewers.size() );
+    for ( size_t p = 0; p < _num_products; ++p ) {
+        for ( size_t i = _prod_offsets[p]; i < _prod_offsets[p + 1]; ++i ) {
+            _rev_products[next[_prod_reviewers[i]]++] = p;
+        }
+    }
+
+    _sums.resize( _num_products );
+}
+
+/**
+ * The number of reviewer pairs a projection would write, the rows of
+ * map_edges.
+ */
+template <typename V>
+size_t BasicBipartite<V>::num_pairs() const {
+
+    size_t pairs = 0;
+    for ( size_t p = 0; p < _num_products; ++p ) {
+        size_t k = _prod_offsets[p + 1] - _prod_offsets[p];
+        pairs += k*(k - 1)/2;
+    }
+    return pairs;
+}
+
+/**
+ * y = A x. The sum over the products of a reviewer leaves the reviewer's
+ * own term out of each product, which is the diagonal correction.
+ */
+template <typename V>
+void BasicBipartite<V>::multiply( const double *x, double *y ) {
+
+    ThreadPool &pool = ThreadPool::instance();
+
+    pool.parallel_for_weighted( _prod_offsets.data(), _num_products,
+                                [&]( size_t begin, size_t end ) {
+        for ( size_t p = begin; p < end; ++p ) {
+            double sum = 0.0;
+            for ( size_t i = _prod_offsets[p]; i < _prod_offsets[p + 1]; ++i ) {
+                sum += x[_prod_reviewers[i]];
+            }
+            _sums[p] = sum;
+        }
+    });
+
+    pool.parallel_for_weighted( _rev_offsets.data(), _num_reviewers,
+                                [&]( size_t begin, size_t end ) {
+        for ( size_t r = begin; r < end; ++r ) {
+            double sum = 0.0;
+            for ( size_t i = _rev_offsets[r]; i < _rev_offsets[r + 1]; ++i ) {
+                sum += _sums[_rev_products[i]] - x[r];
+            }
+            y[r] = sum;
+        }
+    });
+}
+
+/**
+ * The weighted degree of every reviewer, A 1: the reviewers met over all
+ * of its products, counting a reviewer once per shared product.
+ */
+template <typename V>
+void BasicBipartite<V>::strength( vector<uint64_t> &weighted_degree ) const {
+
+    weighted_degree.assign( _num_reviewers, 0 );
+
+    for ( size_t r = 0; r < _num_reviewers; ++r ) {
+        for ( size_t i = _rev_offsets[r]; i < _rev_offsets[r + 1]; ++i ) {
+            size_t p = _rev_products[i];
+            weighted_degree[r] += _prod_offsets[p + 1] - _prod_offsets[p] - 1;
+        }
+    }
+}
+
+/**
+ * Weighted degree, eigenvector centrality and PageRank of the reviewer
+ * graph, iterated like the lanes of Graph::centrality_sweep:
+ *
+ *     eigenvector    x <- A x/|A x|, until |A x| changes by less than eps
+ *     pagerank       x <- (1-damping)/N + damping A D^-1 x, with the
+ *                    rank of reviewers without pairs spread evenly, until
+ *                    the L1 change is below eps relative to the L1 norm
+ *
+ * The scores are written as "node\tdegree\teigenvector\tpagerank".
+ * Returns the largest eigenvalue of A, in units of shared products rather
+ * than normalized by the weights as in centrality_sweep.
+ */
+template <typename V>
+double BasicBipartite<V>::centrality( const string &output_filename,
+                                      const int num_it,
+                                      const double eps,
+                                      const double damping ) {
+
+    StageTimer timer( "bipartite_centrality" );
+
+    fprintf( stderr, "Bipartite: %zd reviews in place of %zd pairs\n",
+                     num_reviews(), num_pairs() );
+
+    vector<uint64_t> degree;
+    strength( degree );
+
+    double n = static_cast<double>( _num_reviewers );
+
+    vector<double> eig( _num_reviewers, sqrt( 1.0/n ) );
+    vector<double> rank( _num_reviewers, 1.0/n );
+    vector<double> in( _num_reviewers );
+    vector<double> out( _num_reviewers );
+
+    bool eig_done = false;
+    bool rank_done = false;
+    double norm_last = 1.0;
+    int it;
+
+    for ( it = 0; it < num_it; ++it ) {
+
+        StageTimer sweep_timer( "bipartite_centrality.iteration" );
+
+        if ( !eig_done ) {
+
+            sweep_timer.add_rows( 2*num_reviews() );
+
+            multiply( eig.data(), out.data() );
+
+            double norm_sq = 0.0;
+            for ( size_t r = 0; r < _num_reviewers; ++r ) {
+                norm_sq += out[r]*out[r];
+            }
+            double norm = sqrt( norm_sq );
+
+            if ( norm > 0.0 ) {
+                for ( size_t r = 0; r < _num_reviewers; ++r ) {
+                    eig[r] = out[r]/norm;
+                }
+            }
+
+            eig_done = ( fabs( norm - norm_last )/norm_last < eps );
+            norm_last = norm;
+        }
+
+        if ( !rank_done ) {
+
+            sweep_timer.add_rows( 2*num_reviews() );
+
+            double dangling = 0.0;
+            for ( size_t r = 0; r < _num_reviewers; ++r ) {
+                if ( degree[r] > 0 ) {
+                    in[r] = damping*rank[r]/static_cast<double>( degree[r] );
+                } else {
+                    in[r] = 0.0;
+                    dangling += rank[r];
+                }
+            }
+
+            multiply( in.data(), out.data() );
+
+            double teleport = ( 1.0 - damping )/n + damping*dangling/n;
+
+            double change = 0.0;
+            double total = 0.0;
+            for ( size_t r = 0; r < _num_reviewers; ++r ) {
+                double x = out[r] + teleport;
+                change += fabs( x - rank[r] );
+                total += x;
+                rank[r] = x;
+            }
+
+            rank_done = ( change < eps*total );
+        }
+
+        fprintf(stderr,"%3d %14.7e %d %d\n", it, norm_last,
+                        eig_done, rank_done );
+
+        if ( eig_done && rank_done ) {
+            ++it;
+            break;
+        }
+    }
+
+    fprintf(stderr,"num sweeps: %d\n", it );
+    fprintf(stderr,"eigenvalue: %14.7e\n", norm_last );
+
+    TsvWriter output( output_filename );
+
+    output.put( "node\tdegree\teigenvector\tpagerank\n" );
+    for ( size_t r = 0; r < _num_reviewers; ++r ) {
+        output.row( r, degree[r], Fixed( eig[r], 10 ), Fixed( rank[r], 10 ) );
+    }
+    output.close();
+
+    timer.add_file( output_filename );
+
+    return norm_last;
+}
+
+template class BasicBipartite<uint32_t>;
+template class BasicBipartite<uint64_t>;
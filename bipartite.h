@@ -0,0 +1,78 @@
+#ifndef BIPARTITE_H
+#define BIPARTITE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "types.h"
+
+/**
+ * The reviewer graph of Reviews::map_edges without the projection. With B
+ * the 0/1 incidence of products and reviewers, the reviewer graph is
+ * A = B^T B less its diagonal; the weight of a pair is the number of
+ * products both reviewed, as in ar_edges.csv. Only B is kept, in both
+ * orientations, and
+ *
+ *     A x = B^T ( B x ) - D x
+ *
+ * with D the number of products of each reviewer. A product of k
+ * reviewers costs O(k) per product instead of its k(k-1)/2 pairs, so
+ * memory and the work of an iteration follow the number of reviews.
+ * Products with a single reviewer add nothing to A and are left out.
+ *
+ * Both sums are gathers, B x over the reviewers of each product and then
+ * B^T over the products of each reviewer, split over the ThreadPool by
+ * reviews; the results do not depend on the number of threads.
+ *
+ * Usage:
+ *
+ *     Bipartite coreview( reviews.product_reviewers(),
+ *                         reviews.num_reviewers() );
+ *     coreview.centrality( output_filename, num_it, eps, damping );
+ */
+template <typename V>
+class BasicBipartite {
+
+ private:
+    size_t _num_reviewers;
+    size_t _num_products;
+
+    std::vector<size_t> _prod_offsets;
+    std::vector<V> _prod_reviewers;
+    std::vector<size_t> _rev_offsets;
+    std::vector<V> _rev_products;
+
+    std::vector<double> _sums;
+
+ public:
+    BasicBipartite(
+            const std::unordered_map<V,std::unordered_set<V>> &prod_rev,
+            const size_t num_reviewers );
+
+    size_t num_reviewers() const {
+        return _num_reviewers;
+    }
+
+    size_t num_reviews() const {
+        return _prod_reviewers.size();
+    }
+
+    size_t num_pairs() const;
+
+    void multiply( const double *x, double *y );
+
+    void strength( std::vector<uint64_t> &weighted_degree ) const;
+
+    double centrality( const std::string &output_filename,
+                       const int num_it,
+                       const double eps,
+                       const double damping = 0.85 );
+
+};
+
+typedef BasicBipartite<vertex_t> Bipartite;
+
+#endif // BIPARTITE_H
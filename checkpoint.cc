@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+
+using std::string;
+using std::vector;
+
+/**
+ * Open the log and, if it carries the same key, keep its complete records.
+ */
+Checkpoint::Checkpoint( const string &filename, const string &key ) {
+
+    _filename = filename;
+    _fp = NULL;
+
+    if ( _filename.empty() ) return;
+
+    string contents;
+    FILE *in = fopen( _filename.c_str(), "r" );
+    if ( in != NULL ) {
+        char block[1 << 16];
+        size_t n;
+        while ( ( n = fread( block, 1, sizeof(block), in ) ) > 0 ) {
+            contents.append( block, n );
+        }
+        fclose( in );
+    }
+
+    size_t end = contents.find( '\n' );
+    bool same_run = ( end != string::npos &&
+                      contents.compare( 0, end, key ) == 0 &&
+                      end == key.size() );
+
+    if ( same_run ) {
+
+        size_t begin = end + 1;
+        while ( ( end = contents.find( '\n', begin ) ) != string::npos ) {
+            _records.push_back( contents.substr( begin, end - begin ) );
+            begin = end + 1;
+        }
+
+        // drop a record cut short by a crash
+        if ( begin < contents.size() &&
+                        truncate( _filename.c_str(), begin ) != 0 ) {
+            fprintf( stderr, "Could not truncate checkpoint: %s\n",
+                                                        _filename.c_str() );
+            abort();
+        }
+
+        _fp = fopen( _filename.c_str(), "a" );
+
+    } else {
+
+        _fp = fopen( _filename.c_str(), "w" );
+        if ( _fp != NULL ) {
+            fprintf( _fp, "%s\n", key.c_str() );
+            fflush( _fp );
+            fsync( fileno( _fp ) );
+        }
+    }
+
+    if ( _fp == NULL ) {
+        fprintf( stderr, "Could not open checkpoint: %s\n", _filename.c_str() );
+        abort();
+    }
+
+    if ( !_records.empty() ) {
+        fprintf( stderr, "Resuming from checkpoint %s, %zd records\n",
+                         _filename.c_str(), _records.size() );
+    }
+}
+
+Checkpoint::~Checkpoint() {
+    if ( _fp != NULL ) fclose( _fp );
+}
+
+void Checkpoint::record( const string &line ) {
+
+    if ( _fp == NULL ) return;
+
+    if ( fprintf( _fp, "%s\n", line.c_str() ) < 0 || fflush( _fp ) != 0 ||
+         fsync( fileno( _fp ) ) != 0 ) {
+        fprintf( stderr, "Could not write checkpoint: %s\n",
+                                                        _filename.c_str() );
+        abort();
+    }
+
+    _records.push_back( line );
+}
+
+/**
+ * The stage is done: remove the log, so the next run starts afresh.
+ */
+void Checkpoint::finish() {
+
+    if ( _fp == NULL ) return;
+
+    fclose( _fp );
+    _fp = NULL;
+    _records.clear();
+
+    unlink( _filename.c_str() );
+}
+
+/**
+ * A key for a set of input files: their number, total size and latest
+ * modification time.
+ */
+string Checkpoint::fingerprint( const vector<string> &files ) {
+
+    long long bytes = 0;
+    long long mtime = 0;
+    size_t found = 0;
+
+    for ( const string &file : files ) {
+        struct stat st;
+        if ( stat( file.c_str(), &st ) != 0 ) continue;
+        ++found;
+        bytes += st.st_size;
+        mtime = std::max( mtime,
+                          static_cast<long long>( st.st_mtim.tv_sec )*
+                                    1000000000ll + st.st_mtim.tv_nsec );
+    }
+
+    return "files=" + std::to_string( found ) +
+           " bytes=" + std::to_string( bytes ) +
+           " mtime=" + std::to_string( mtime );
+}
+
+/**
+ * Cut a file back to the size a record gives for it, dropping what was
+ * written after the record. Returns false if the file is shorter, so not
+ * the one the record describes.
+ */
+bool Checkpoint::cut_back( const string &filename, const size_t size ) {
+
+    struct stat st;
+    if ( stat( filename.c_str(), &st ) != 0 ||
+                    static_cast<size_t>( st.st_size ) < size ) {
+        return false;
+    }
+
+    if ( truncate( filename.c_str(), size ) != 0 ) {
+        fprintf( stderr, "Could not truncate file: %s\n", filename.c_str() );
+        abort();
+    }
+
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * The progress log of a long running stage, so that a run which is killed
+ * part way, e.g. on a preemptible node, resumes from its last record
+ * instead of from the start.
+ *
+ * The first line of the log is a key describing the run, such as the
+ * sizes of its inputs and its parameters; a log with any other key is
+ * from another run and is started afresh. Every record is one line,
+ * synced to disk before record() returns, and a line cut short by a crash
+ * is dropped on reopening. The stage syncs its own output before writing
+ * the record which describes it. finish() removes the log.
+ *
+ * An empty filename gives a log which keeps nothing, for runs without
+ * checkpoints.
+ *
+ * Usage:
+ *
+ *     Checkpoint checkpoint( log_filename, key );
+ *     for ( const std::string &record : checkpoint.records() ) { ... }
+ *     ...
+ *     checkpoint.record( "bucket 17" );
+ *     ...
+ *     checkpoint.finish();
+ */
+class Checkpoint {
+
+ private:
+    std::string _filename;
+    FILE *_fp;
+    std::vector<std::string> _records;
+
+ public:
+    Checkpoint( const std::string &filename, const std::string &key );
+
+    ~Checkpoint();
+
+    bool enabled() const {
+        return _fp != NULL;
+    }
+
+    const std::vector<std::string>& records() const {
+        return _records;
+    }
+
+    void record( const std::string &line );
+
+    void finish();
+
+    static std::string fingerprint( const std::vector<std::string> &files );
+
+    static bool cut_back( const std::string &filename, const size_t size );
+
+};
+
+#endif // CHECKPOINT_H
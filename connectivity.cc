@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "connectivity.h"
+#include "edge_stream.h"
+#include "stats.h"
+#include "tsv_writer.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+
+const char UF_MAGIC[8] = { 'A', 'Z', 'R', 'V', 'U', 'F', '0', '1' };
+
+const char UF_BATCH_KEY[] = "AZRVUF01 batches";
+
+}
+
+
+/**
+ * Open the state file, or start an empty graph if it does not exist.
+ */
+template <typename V, typename W>
+BasicConnectivity<V,W>::BasicConnectivity( const string &filename ) {
+
+    _filename = filename;
+    _header = NULL;
+    _nodes = NULL;
+    _size = 0;
+
+    _fd = open( filename.c_str(), O_RDWR | O_CREAT, 0644 );
+    if ( _fd < 0 ) {
+        fprintf( stderr, "Could not open file: %s\n", filename.c_str() );
+        abort();
+    }
+
+    struct stat st;
+    fstat( _fd, &st );
+
+    if ( st.st_size == 0 ) {
+
+        // the batches of an earlier state are not in this one
+        unlink( batch_log().c_str() );
+
+        Header header;
+        memset( &header, 0, sizeof(header) );
+        memcpy( header.magic, UF_MAGIC, sizeof(UF_MAGIC) );
+        header.id_size = sizeof(V);
+
+        if ( write( _fd, &header, sizeof(header) ) !=
+                                    static_cast<ssize_t>( sizeof(header) ) ) {
+            fprintf( stderr, "Could not write file: %s\n", filename.c_str() );
+            abort();
+        }
+
+        map( sizeof(header) );
+        return;
+    }
+
+    if ( static_cast<size_t>( st.st_size ) < sizeof(Header) ) {
+        fprintf( stderr, "Bad connectivity file: %s\n", filename.c_str() );
+        abort();
+    }
+
+    map( st.st_size );
+
+    if ( memcmp( _header->magic, UF_MAGIC, sizeof(UF_MAGIC) ) != 0 ||
+         _header->id_size != sizeof(V) ||
+         _header->num_verts > _header->capacity ||
+         sizeof(Header) + _header->capacity*sizeof(Node) > _size ) {
+        fprintf( stderr, "Bad connectivity file: %s\n", filename.c_str() );
+        abort();
+    }
+}
+
+template <typename V, typename W>
+BasicConnectivity<V,W>::~BasicConnectivity() {
+    munmap( _header, _size );
+    close( _fd );
+}
+
+template <typename V, typename W>
+void BasicConnectivity<V,W>::map( const size_t size ) {
+
+    if ( _header != NULL ) munmap( _header, _size );
+
+    void *base = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       _fd, 0 );
+    if ( base == MAP_FAILED ) {
+        fprintf( stderr, "Could not map file: %s\n", _filename.c_str() );
+        abort();
+    }
+
+    _size = size;
+    _header = static_cast<Header*>( base );
+    _nodes = reinterpret_cast<Node*>( static_cast<char*>( base ) +
+                                      sizeof(Header) );
+}
+
+/**
+ * Add isolated vertices up to num_verts. The file grows by doubling, so
+ * a stream of new vertices is remapped only a logarithmic number of times.
+ */
+template <typename V, typename W>
+void BasicConnectivity<V,W>::grow( const size_t num_verts ) {
+
+    size_t old_verts = _header->num_verts;
+    if ( num_verts <= old_verts ) return;
+
+    if ( num_verts - 1 > std::numeric_limits<V>::max() ) {
+        fprintf( stderr, "Vertex id out of range: %zd\n", num_verts - 1 );
+        abort();
+    }
+
+    if ( num_verts > _header->capacity ) {
+
+        size_t capacity = std::max( num_verts,
+                          std::max( 2*_header->capacity, size_t( 1024 ) ) );
+        size_t size = sizeof(Header) + capacity*sizeof(Node);
+
+        if ( ftruncate( _fd, size ) != 0 ) {
+            fprintf( stderr, "Could not grow file: %s\n", _filename.c_str() );
+            abort();
+        }
+
+        map( size );
+        _header->capacity = capacity;
+    }
+
+    for ( size_t v = old_verts; v < num_verts; ++v ) {
+        _nodes[v].parent = v;
+        _nodes[v].size = 1;
+    }
+
+    _header->num_isolated += num_verts - old_verts;
+    _header->num_verts = num_verts;
+}
+
+template <typename V, typename W>
+V BasicConnectivity<V,W>::find( V v ) {
+    while ( _nodes[v].parent != v ) {
+        _nodes[v].parent = _nodes[_nodes[v].parent].parent;
+        v = _nodes[v].parent;
+    }
+    return v;
+}
+
+/**
+ * Union by size; the cluster count, isolated count, largest cluster and
+ * the pair sum behind the fragmentation are updated from the sizes of
+ * the two merged components alone.
+ */
+template <typename V, typename W>
+void BasicConnectivity<V,W>::add_edge( const V source, const V target ) {
+
+    grow( static_cast<size_t>( std::max( source, target ) ) + 1 );
+
+    ++_header->num_edges;
+
+    V rs = find( source );
+    V rt = find( target );
+
+    if ( rs == rt ) return;
+
+    if ( _nodes[rs].size < _nodes[rt].size ) std::swap( rs, rt );
+
+    uint64_t a = _nodes[rs].size;
+    uint64_t b = _nodes[rt].size;
+
+    if ( a == 1 && b == 1 ) {
+        ++_header->num_clusters;
+    } else if ( a > 1 && b > 1 ) {
+        --_header->num_clusters;
+    }
+    _header->num_isolated -= ( a == 1 ) + ( b == 1 );
+    _header->pair_sum += 2.0*static_cast<double>( a )*static_cast<double>( b );
+    _header->max_cluster = std::max( _header->max_cluster, a + b );
+
+    _nodes[rt].parent = rs;
+    _nodes[rs].size = a + b;
+}
+
+/**
+ * Absorb the edges of an edge file. Returns the number of edges, 0 if the
+ * batch was absorbed before.
+ *
+ * The batch log records the fingerprint of a batch and the edge count
+ * before it, then, once the state is synced, that the batch is done. A
+ * batch which is done is skipped. A batch cut short by a crash is redone
+ * from the edge count before it: the unions it did are found again as
+ * joined and count nothing twice. Any other batch is refused until then.
+ */
+template <typename V, typename W>
+size_t BasicConnectivity<V,W>::add_edges( const string &edge_filename ) {
+
+    StageTimer timer( "connectivity" );
+    timer.add_file( edge_filename );
+
+    Checkpoint log( batch_log(), UF_BATCH_KEY );
+    string fingerprint = Checkpoint::fingerprint( { edge_filename } );
+
+    string open_batch;
+    string open_filename;
+    uint64_t open_edges = 0;
+
+    for ( const string &record : log.records() ) {
+
+        size_t tab = record.find( '\t' );
+        size_t tab2 = record.find( '\t', tab + 1 );
+        string batch = record.substr( tab + 1, tab2 - tab - 1 );
+
+        if ( record.compare( 0, tab, "done" ) == 0 ) {
+            if ( batch == fingerprint ) {
+                fprintf( stderr, "Batch already absorbed: %s\n",
+                                                    edge_filename.c_str() );
+                return 0;
+            }
+            open_batch.clear();
+        } else {
+            size_t tab3 = record.find( '\t', tab2 + 1 );
+            open_batch = batch;
+            open_edges = strtoull( record.c_str() + tab2 + 1, NULL, 10 );
+            open_filename = record.substr( tab3 + 1 );
+        }
+    }
+
+    if ( !open_batch.empty() && open_batch != fingerprint ) {
+        fprintf( stderr, "Batch %s was cut short; absorb it again first\n",
+                                                    open_filename.c_str() );
+        abort();
+    }
+
+    if ( !open_batch.empty() ) {
+        fprintf( stderr, "Redoing batch cut short: %s\n",
+                                                    edge_filename.c_str() );
+        _header->num_edges = open_edges;
+    } else {
+        log.record( "begin\t" + fingerprint + "\t" +
+                    std::to_string( _header->num_edges ) + "\t" +
+                    edge_filename );
+    }
+
+    BasicEdgeStream<V,W> edges( edge_filename );
+    edges.rewind();
+
+    const BasicEdge<V,W> *batch;
+    size_t count;
+    size_t num_edges = 0;
+
+    while( ( batch = edges.next_batch( count ) ) != NULL ) {
+
+        size_t max_id = 0;
+        for ( size_t e = 0; e < count; ++e ) {
+            max_id = std::max( max_id, static_cast<size_t>(
+                               std::max( batch[e].source, batch[e].target ) ) );
+        }
+        if ( count > 0 ) grow( max_id + 1 );
+
+        for ( size_t e = 0; e < count; ++e ) {
+            add_edge( batch[e].source, batch[e].target );
+        }
+
+        num_edges += count;
+    }
+
+    if ( msync( _header, _size, MS_SYNC ) != 0 ) {
+        fprintf( stderr, "Could not sync file: %s\n", _filename.c_str() );
+        abort();
+    }
+
+    log.record( "done\t" + fingerprint );
+
+    timer.add_rows( num_edges );
+
+    return num_edges;
+}
+
+template <typename V, typename W>
+string BasicConnectivity<V,W>::batch_log() const {
+    return _filename + ".batches";
+}
+
+template <typename V, typename W>
+double BasicConnectivity<V,W>::fragmentation() const {
+
+    double nverts = static_cast<double>( _header->num_verts );
+    if ( nverts < 2.0 ) return 0.0;
+
+    return 1.0 - _header->pair_sum/( nverts*( nverts - 1.0 ) );
+}
+
+template <typename V, typename W>
+void BasicConnectivity<V,W>::write_stats( const string &filename ) const {
+
+    TsvWriter output( filename );
+
+    output.put( "statistic\tvalue\n" );
+    output.row( "vertices", num_verts() );
+    output.row( "edges", num_edges() );
+    output.row( "clusters", num_clusters() );
+    output.row( "isolated", num_isolated() );
+    output.row( "max_cluster", max_cluster() );
+    output.row( "fragmentation", Fixed( fragmentation(), 7 ) );
+    output.close();
+}
+
+/**
+ * The membership of every vertex in a cluster, numbered as by
+ * Graph::cluster_stats: 1 to the number of clusters, in the order of
+ * their smallest vertex. The whole file is rewritten, so that it reflects
+ * every batch absorbed so far: unlike add_edges, this is O(V) per call.
+ */
+template <typename V, typename W>
+void BasicConnectivity<V,W>::write_membership( const string &filename ) {
+
+    vector<V> cluster_id( _header->num_verts, 0 );
+    size_t num_clusters = 0;
+
+    TsvWriter output( filename );
+
+    output.put( "node\tmembership\n" );
+    for ( size_t v = 0; v < _header->num_verts; ++v ) {
+        V root = find( v );
+        if ( _nodes[root].size < 2 ) continue;
+        if ( cluster_id[root] == 0 ) cluster_id[root] = ++num_clusters;
+        output.row( v, cluster_id[root] );
+    }
+    output.close();
+}
+
+template class BasicConnectivity<uint32_t,uint32_t>;
+template class BasicConnectivity<uint64_t,uint64_t>;
@@ -0,0 +1,114 @@
+#ifndef CONNECTIVITY_H
+#define CONNECTIVITY_H
+
+#include <cstdint>
+#include <string>
+
+#include "types.h"
+
+/**
+ * The connected components of a growing graph, kept in a union-find
+ * forest that persists in a memory mapped state file. Absorbing a batch
+ * of edges touches only the forest entries on their paths, so the cost is
+ * proportional to the batch, not to the edges seen before; writing the
+ * membership, though, visits every vertex.
+ *
+ * The state is synced after each batch, and a log beside it, the state
+ * filename with ".batches", keeps the batches absorbed, so that a batch
+ * given twice is applied once and one cut short by a crash is redone.
+ *
+ * Layout, all integers in host byte order:
+ *
+ *    header    magic "AZRVUF01", sizeof(V), num_verts, capacity,
+ *              num_edges, num_clusters, num_isolated, max_cluster (uint64
+ *              each), pair_sum (double, the sum over components of
+ *              size*(size-1))
+ *    nodes     parent and component size of each vertex (V each); the
+ *              size is only meaningful at the roots
+ *
+ * Clusters are the components of two or more vertices, as in
+ * Graph::cluster_stats. Vertices are added, as isolated, when an edge
+ * first names them.
+ *
+ * Usage:
+ *
+ *     Connectivity components( state_filename );
+ *     components.add_edges( batch_filename );
+ *     components.write_membership( membership_filename );
+ */
+template <typename V, typename W>
+class BasicConnectivity {
+
+ private:
+    struct Header {
+        char magic[8];
+        uint64_t id_size;
+        uint64_t num_verts;
+        uint64_t capacity;
+        uint64_t num_edges;
+        uint64_t num_clusters;
+        uint64_t num_isolated;
+        uint64_t max_cluster;
+        double pair_sum;
+    };
+
+    struct Node {
+        V parent;
+        V size;
+    };
+
+    std::string _filename;
+    int _fd;
+    size_t _size;
+    Header *_header;
+    Node *_nodes;
+
+ public:
+    BasicConnectivity( const std::string &filename );
+
+    ~BasicConnectivity();
+
+    size_t add_edges( const std::string &edge_filename );
+
+    void add_edge( const V source, const V target );
+
+    V find( V v );
+
+    size_t num_verts() const {
+        return _header->num_verts;
+    }
+
+    size_t num_edges() const {
+        return _header->num_edges;
+    }
+
+    size_t num_clusters() const {
+        return _header->num_clusters;
+    }
+
+    size_t num_isolated() const {
+        return _header->num_isolated;
+    }
+
+    size_t max_cluster() const {
+        return _header->max_cluster;
+    }
+
+    double fragmentation() const;
+
+    void write_stats( const std::string &filename ) const;
+
+    void write_membership( const std::string &filename );
+
+ private:
+    std::string batch_log() const;
+
+    void grow( const size_t num_verts );
+
+    void map( const size_t size );
+
+};
+
+typedef BasicConnectivity<vertex_t,weight_t> Connectivity;
+
+#endif // CONNECTIVITY_H
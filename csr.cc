@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "csr.h"
+#include "edge_stream.h"
+
+using std::pair;
+using std::string;
+using std::vector;
+
+/**
+ * Build the adjacency lists with two passes over the edge file: the first
+ * checks the vertex ids and counts the degrees, the second scatters the
+ * edges into place.
+ */
+void CSR::load( const string &edge_filename ) {
+
+    if ( _num_verts >= std::numeric_limits<uint32_t>::max() ) {
+        fprintf( stderr, "Too many vertices for a CSR: %zd\n", _num_verts );
+        abort();
+    }
+
+    EdgeStream edges( edge_filename );
+
+    const Edge *batch;
+    size_t count;
+
+    _offsets.assign( _num_verts + 1, 0 );
+
+    edges.rewind();
+
+    while( ( batch = edges.next_batch( count ) ) != NULL ) {
+        for ( size_t e = 0; e < count; ++e ) {
+            if ( batch[e].source >= _num_verts ||
+                 batch[e].target >= _num_verts ) {
+                fprintf( stderr, "Vertex out of range in %s: %zd\n",
+                                 edge_filename.c_str(),
+                                 static_cast<size_t>( std::max(
+                                    batch[e].source, batch[e].target ) ) );
+                abort();
+            }
+            ++_offsets[batch[e].source+1];
+            ++_offsets[batch[e].target+1];
+        }
+    }
+
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        _offsets[v+1] += _offsets[v];
+    }
+
+    _targets.resize( _offsets[_num_verts] );
+    _weights.resize( _offsets[_num_verts] );
+    _strength.assign( _num_verts, 0 );
+
+    vector<size_t> fill( _offsets.begin(), _offsets.end() - 1 );
+
+    edges.rewind();
+
+    while( ( batch = edges.next_batch( count ) ) != NULL ) {
+
+        for ( size_t e = 0; e < count; ++e ) {
+
+            size_t source = batch[e].source;
+            size_t target = batch[e].target;
+            size_t weight = batch[e].weight;
+
+            _targets[fill[source]] = target;
+            _weights[fill[source]] = weight;
+            ++fill[source];
+
+            _targets[fill[target]] = source;
+            _weights[fill[target]] = weight;
+            ++fill[target];
+
+            _strength[source] += weight;
+            _strength[target] += weight;
+        }
+
+    }
+
+    // sort every adjacency list by neighbor
+    vector<pair<uint32_t,uint32_t>> row;
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        size_t begin = _offsets[v];
+        size_t end = _offsets[v+1];
+
+        row.clear();
+        for ( size_t e = begin; e < end; ++e ) {
+            row.push_back( pair<uint32_t,uint32_t>( _targets[e], _weights[e] ) );
+        }
+        std::sort( row.begin(), row.end() );
+        for ( size_t e = begin; e < end; ++e ) {
+            _targets[e] = row[e-begin].first;
+            _weights[e] = row[e-begin].second;
+        }
+    }
+
+}
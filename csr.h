@@ -0,0 +1,55 @@
+#ifndef CSR_H
+#define CSR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * An in-memory, compressed sparse row copy of an undirected, weighted
+ * edge file. Every edge appears in the adjacency list of both of its end
+ * points and each adjacency list is sorted by neighbor.
+ */
+class CSR {
+
+ private:
+    size_t _num_verts;
+    std::vector<size_t> _offsets;
+    std::vector<uint32_t> _targets;
+    std::vector<uint32_t> _weights;
+    std::vector<uint64_t> _strength;
+
+ public:
+    CSR( const size_t num_verts ) {
+       _num_verts = num_verts;
+    };
+
+    void load( const std::string &edge_filename );
+
+    size_t num_verts() const {
+        return _num_verts;
+    }
+
+    size_t num_edges() const {
+        return _targets.size()/2;
+    }
+
+    size_t degree( const size_t v ) const {
+        return _offsets[v+1] - _offsets[v];
+    }
+
+    uint64_t weighted_degree( const size_t v ) const {
+        return _strength[v];
+    }
+
+    const uint32_t* neighbors( const size_t v ) const {
+        return _targets.data() + _offsets[v];
+    }
+
+    const uint32_t* weights( const size_t v ) const {
+        return _weights.data() + _offsets[v];
+    }
+
+};
+
+#endif // CSR_H
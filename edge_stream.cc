@@ -0,0 +1,227 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "edge_stream.h"
+#include "tsv_reader.h"
+
+using std::string;
+using std::vector;
+
+template <typename V, typename W>
+BasicEdgeStream<V,W>::BasicEdgeStream( const string &filename,
+                                       const size_t num_buffers,
+                                       const size_t read_size ) {
+
+    _filename = filename;
+    _read_size = read_size;
+    _slots.resize( num_buffers < 2 ? 2 : num_buffers );
+
+    _head = 0;
+    _count = 0;
+    _holding = false;
+    _done = true;
+    _stop = false;
+}
+
+template <typename V, typename W>
+BasicEdgeStream<V,W>::~BasicEdgeStream() {
+    finish();
+}
+
+/**
+ * Start a new pass over the edges, abandoning any pass in progress.
+ */
+template <typename V, typename W>
+void BasicEdgeStream<V,W>::rewind() {
+
+    finish();
+
+    _head = 0;
+    _count = 0;
+    _holding = false;
+    _done = false;
+    _stop = false;
+
+    _reader = std::thread( &BasicEdgeStream::read_edges, this );
+}
+
+/**
+ * The next batch of edges, or NULL at the end of the pass. The batch
+ * remains valid until the following call.
+ */
+template <typename V, typename W>
+const BasicEdge<V,W>* BasicEdgeStream<V,W>::next_batch( size_t &count ) {
+
+    std::unique_lock<std::mutex> lock( _mutex );
+
+    if ( _holding ) {
+        _head = ( _head + 1 ) % _slots.size();
+        --_count;
+        _holding = false;
+        _emptied.notify_one();
+    }
+
+    _filled.wait( lock, [this] { return _count > 0 || _done; } );
+
+    if ( _count == 0 ) {
+        count = 0;
+        return NULL;
+    }
+
+    _holding = true;
+    count = _slots[_head].size();
+    return _slots[_head].data();
+}
+
+template <typename V, typename W>
+void BasicEdgeStream<V,W>::finish() {
+
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _stop = true;
+    }
+    _emptied.notify_all();
+
+    if ( _reader.joinable() ) _reader.join();
+}
+
+/**
+ * The body of the reader thread: read large blocks, decode the complete
+ * lines of each into a free slot and hand the slot to the consumer. A line
+ * split across two blocks is carried over to the next one.
+ */
+template <typename V, typename W>
+void BasicEdgeStream<V,W>::read_edges() {
+
+    size_t line = 1;
+
+    const uint64_t max_id = std::numeric_limits<V>::max();
+    const uint64_t max_weight = std::numeric_limits<W>::max();
+
+    auto parse = [&]( const char *begin, const char *end,
+                      vector<BasicEdge<V,W>> &batch ) {
+        auto emit = [&]( const uint64_t *row ) {
+            if ( row[0] > max_id || row[1] > max_id || row[2] > max_weight ) {
+                fprintf( stderr, "%s:%zd: edge does not fit in %zd bit ids "
+                                 "and weights\n", _filename.c_str(), line,
+                                 8*sizeof( V ) );
+                abort();
+            }
+            batch.push_back( BasicEdge<V,W>{ static_cast<V>( row[0] ),
+                                             static_cast<V>( row[1] ),
+                                             static_cast<W>( row[2] ) } );
+        };
+        if ( parse_uint_rows( begin, end, 3, line, emit ) == NULL ) {
+            fprintf( stderr, "%s:%zd: expected source, target and weight, "
+                             "unsigned 64 bit integers\n",
+                             _filename.c_str(), line );
+            abort();
+        }
+    };
+
+    int fd = open( _filename.c_str(), O_RDONLY );
+
+    if ( fd < 0 ) {
+        fprintf( stderr, "Could not open file: %s\n", _filename.c_str() );
+        abort();
+    }
+
+    posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+
+    void *aligned = NULL;
+    if ( posix_memalign( &aligned, 4096, _read_size ) != 0 ) {
+        fprintf( stderr, "Could not allocate the read buffer\n" );
+        abort();
+    }
+    char *buffer = static_cast<char*>( aligned );
+
+    bool header = true;
+    string partial;
+
+    while ( 1 ) {
+
+        ssize_t n = read( fd, buffer, _read_size );
+
+        if ( n < 0 ) {
+            if ( errno == EINTR ) continue;
+            fprintf( stderr, "Error reading file: %s\n", _filename.c_str() );
+            abort();
+        }
+
+        size_t slot;
+        {
+            std::unique_lock<std::mutex> lock( _mutex );
+            _emptied.wait( lock, [this] {
+                                return _count < _slots.size() || _stop; } );
+            if ( _stop ) break;
+            slot = ( _head + _count ) % _slots.size();
+        }
+
+        vector<BasicEdge<V,W>> &batch = _slots[slot];
+        batch.clear();
+
+        const char *p = buffer;
+        const char *end = buffer + n;
+
+        if ( n == 0 ) {
+            if ( !header ) {
+                parse( partial.data(), partial.data() + partial.size(),
+                       batch );
+            }
+        } else {
+
+            // finish the line carried over from the previous block
+            if ( header || !partial.empty() ) {
+                const char *nl = static_cast<const char*>(
+                                                memchr( p, '\n', end - p ) );
+                if ( nl == NULL ) {
+                    if ( !header ) partial.append( p, end - p );
+                    continue;
+                }
+                if ( !header ) {
+                    partial.append( p, nl - p );
+                    parse( partial.data(), partial.data() + partial.size(),
+                           batch );
+                }
+                header = false;
+                partial.clear();
+                p = nl + 1;
+            }
+
+            const char *last = static_cast<const char*>(
+                                            memrchr( p, '\n', end - p ) );
+            if ( last == NULL ) {
+                partial.assign( p, end - p );
+            } else {
+                parse( p, last + 1, batch );
+                partial.assign( last + 1, end - last - 1 );
+            }
+        }
+
+        if ( !batch.empty() ) {
+            std::lock_guard<std::mutex> lock( _mutex );
+            ++_count;
+            _filled.notify_one();
+        }
+
+        if ( n == 0 ) break;
+    }
+
+    free( buffer );
+    close( fd );
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    _done = true;
+    _filled.notify_all();
+}
+
+template class BasicEdgeStream<uint32_t,uint32_t>;
+template class BasicEdgeStream<uint64_t,uint64_t>;
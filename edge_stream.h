@@ -0,0 +1,74 @@
+#ifndef EDGE_STREAM_H
+#define EDGE_STREAM_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "types.h"
+
+template <typename V, typename W>
+struct BasicEdge {
+    V source;
+    V target;
+    W weight;
+};
+
+typedef BasicEdge<vertex_t,weight_t> Edge;
+
+/**
+ * Streams the edges of a weighted edge file from disk in batches. A
+ * background thread issues large reads into aligned buffers and decodes
+ * them into a ring of edge batches, so that reading and parsing overlap
+ * the computation on the previous batches.
+ *
+ * Ids and weights which do not fit in V and W are reported as errors.
+ *
+ * Usage, once per pass over the edges:
+ *
+ *     stream.rewind();
+ *     while ( ( batch = stream.next_batch( count ) ) != NULL ) { ... }
+ */
+template <typename V, typename W>
+class BasicEdgeStream {
+
+ private:
+    std::string _filename;
+    size_t _read_size;
+
+    std::vector<std::vector<BasicEdge<V,W>>> _slots;
+    size_t _head;
+    size_t _count;
+    bool _holding;
+    bool _done;
+    bool _stop;
+
+    std::mutex _mutex;
+    std::condition_variable _filled;
+    std::condition_variable _emptied;
+    std::thread _reader;
+
+ public:
+    BasicEdgeStream( const std::string &filename,
+                     const size_t num_buffers = 4,
+                     const size_t read_size = 4ul << 20 );
+
+    ~BasicEdgeStream();
+
+    void rewind();
+
+    const BasicEdge<V,W>* next_batch( size_t &count );
+
+ private:
+    void read_edges();
+
+    void finish();
+
+};
+
+typedef BasicEdgeStream<vertex_t,weight_t> EdgeStream;
+
+#endif // EDGE_STREAM_H
@@ -1,134 +1,501 @@
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cmath>
 #include <cstring>
 #include <functional>
-#include <map>
+#include <limits>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
 #include <stack>
 #include <utility>
 #include <vector>
 
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <unistd.h>
+
 #include "misc.h"
+#include "adjfile.h"
+#include "bfs.h"
+#include "checkpoint.h"
+#include "csr.h"
+#include "edge_stream.h"
 #include "graph.h"
+#include "intersect.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "tsv_reader.h"
+#include "tsv_writer.h"
 
-using std::map;
 using std::pair;
 using std::stack;
+using std::unique_ptr;
 using std::string;
 using std::unordered_map;
 using std::unordered_set;
 using std::vector;
 
+namespace {
+
+/**
+ * An edge of an EdgeSample, with its weight already scaled for product
+ * sampling and the inverse of its inclusion probability.
+ */
+template <typename V>
+struct SampledEdge {
+    V source;
+    V target;
+    double weight;
+    double scale;
+    uint8_t group;
+};
+
+template <typename V, typename W>
+void load_sample( const string &edge_filename,
+                  const EdgeSample &sample,
+                  vector<SampledEdge<V>> &kept ) {
+
+    BasicEdgeStream<V,W> edges( edge_filename );
+    edges.rewind();
+
+    const BasicEdge<V,W> *batch;
+    size_t count;
+    size_t num_edges = 0;
+
+    double weight_scale = 1.0/sample.product_rate();
+
+    kept.clear();
+
+    while( ( batch = edges.next_batch( count ) ) != NULL ) {
+
+        num_edges += count;
+
+        for ( size_t e = 0; e < count; ++e ) {
+            SampledEdge<V> edge;
+            if ( sample.keep( batch[e].source, batch[e].target,
+                              edge.scale, edge.group ) ) {
+                edge.source = batch[e].source;
+                edge.target = batch[e].target;
+                edge.weight = batch[e].weight*weight_scale;
+                kept.push_back( edge );
+            }
+        }
+    }
+
+    fprintf(stderr,"sampled %zd of %zd edges\n", kept.size(), num_edges );
+}
+
+/**
+ * The weight of a sampled edge in the full sample (exclude < 0) or in the
+ * jackknife replicate leaving out group 'exclude'.
+ */
+template <typename V>
+inline double replicate_scale( const SampledEdge<V> &edge,
+                               const int exclude,
+                               const double group_scale ) {
+    if ( exclude < 0 ) return edge.scale;
+    if ( edge.group == exclude ) return 0.0;
+    return edge.scale*group_scale;
+}
+
+template <typename V>
+V find_root( vector<V> &parent, V v ) {
+    while ( parent[v] != v ) {
+        parent[v] = parent[parent[v]];
+        v = parent[v];
+    }
+    return v;
+}
+
+// the lanes of the interleaved vectors of centrality_sweep
+const int EIG_LANE = 0;
+const int KATZ_LANE = 1;
+const int PR_LANE = 2;
+
+/**
+ * y[0..3] += w*x[0..3], one AVX or two SSE2 multiply-adds.
+ */
+inline void axpy4( double *y, const double w, const double *x ) {
+#if defined(__AVX__)
+    __m256d vy = _mm256_loadu_pd( y );
+    vy = _mm256_add_pd( vy, _mm256_mul_pd( _mm256_set1_pd( w ),
+                                           _mm256_loadu_pd( x ) ) );
+    _mm256_storeu_pd( y, vy );
+#elif defined(__SSE2__)
+    __m128d vw = _mm_set1_pd( w );
+    __m128d lo = _mm_mul_pd( vw, _mm_loadu_pd( x ) );
+    __m128d hi = _mm_mul_pd( vw, _mm_loadu_pd( x + 2 ) );
+    _mm_storeu_pd( y, _mm_add_pd( _mm_loadu_pd( y ), lo ) );
+    _mm_storeu_pd( y + 2, _mm_add_pd( _mm_loadu_pd( y + 2 ), hi ) );
+#else
+    for ( int k = 0; k < 4; ++k ) y[k] += w*x[k];
+#endif
+}
+
+const char SCORES_MAGIC[8] = { 'A', 'Z', 'R', 'V', 'E', 'V', 'C', '1' };
+
+/**
+ * Save a score vector: the magic "AZRVEVC1", the number of vertices
+ * (uint64) and the scores (double), in host byte order. With 'sync' the
+ * file is on disk before returning, for a checkpoint.
+ */
+void write_scores( const string &filename,
+                   const double *scores,
+                   const size_t num_verts,
+                   const bool sync = false ) {
+
+    FILE *fp = fopen_csv( filename, "w", false );
+
+    uint64_t n = num_verts;
+    if ( fwrite( SCORES_MAGIC, sizeof(SCORES_MAGIC), 1, fp ) != 1 ||
+         fwrite( &n, sizeof(n), 1, fp ) != 1 ||
+         fwrite( scores, sizeof(double), num_verts, fp ) != num_verts ||
+         ( sync && ( fflush( fp ) != 0 || fsync( fileno( fp ) ) != 0 ) ) ) {
+        fprintf( stderr, "Could not write scores: %s\n", filename.c_str() );
+        abort();
+    }
+
+    fclose( fp );
+}
+
+/**
+ * Load a saved score vector as a unit start vector. Vertices added since
+ * it was saved start at the smallest saved score. Returns false, leaving
+ * 'scores' undefined, if there is no usable file.
+ */
+bool read_scores( const string &filename,
+                  double *scores,
+                  const size_t num_verts ) {
+
+    FILE *fp = fopen( filename.c_str(), "r" );
+    if ( fp == NULL ) return false;
+
+    char magic[sizeof(SCORES_MAGIC)];
+    uint64_t n = 0;
+
+    bool ok = ( fread( magic, sizeof(magic), 1, fp ) == 1 &&
+                memcmp( magic, SCORES_MAGIC, sizeof(magic) ) == 0 &&
+                fread( &n, sizeof(n), 1, fp ) == 1 && n > 0 );
+
+    if ( ok && n > num_verts ) {
+        fprintf( stderr, "Scores for %zd vertices, not %zd: %s\n",
+                         static_cast<size_t>( n ), num_verts,
+                         filename.c_str() );
+        ok = false;
+    }
+
+    ok = ok && fread( scores, sizeof(double), n, fp ) == n;
+
+    fclose( fp );
+
+    if ( !ok ) {
+        fprintf( stderr, "Cold start, no usable scores: %s\n",
+                                                        filename.c_str() );
+        return false;
+    }
+
+    double least = scores[0];
+    for ( size_t v = 1; v < n; ++v ) least = std::min( least, scores[v] );
+    for ( size_t v = n; v < num_verts; ++v ) scores[v] = least;
+
+    double norm_sq = 0.0;
+    for ( size_t v = 0; v < num_verts; ++v ) norm_sq += scores[v]*scores[v];
+    if ( !( norm_sq > 0.0 ) ) return false;
+
+    double inv_norm = 1.0/sqrt( norm_sq );
+    for ( size_t v = 0; v < num_verts; ++v ) scores[v] *= inv_norm;
+
+    fprintf( stderr, "Warm start from %s, %zd new vertices\n",
+                     filename.c_str(), num_verts - static_cast<size_t>( n ) );
+
+    return true;
+}
+
+/**
+ * Load a vector saved by write_scores exactly as it was, to resume an
+ * iteration. Returns false unless it holds num_verts scores.
+ */
+bool read_snapshot( const string &filename,
+                    double *scores,
+                    const size_t num_verts ) {
+
+    FILE *fp = fopen( filename.c_str(), "r" );
+    if ( fp == NULL ) return false;
+
+    char magic[sizeof(SCORES_MAGIC)];
+    uint64_t n = 0;
+
+    bool ok = ( fread( magic, sizeof(magic), 1, fp ) == 1 &&
+                memcmp( magic, SCORES_MAGIC, sizeof(magic) ) == 0 &&
+                fread( &n, sizeof(n), 1, fp ) == 1 && n == num_verts &&
+                fread( scores, sizeof(double), n, fp ) == n );
+
+    fclose( fp );
+
+    return ok;
+}
+
+}
+
 /**
  * A simple rountine for creating the degree distribution in an
  * out-of-core network.
  */ 
 
-void Graph::degree_dist( const string &edge_filename, 
-                         const string &output_filename ) {
+template <typename V, typename W>
+void BasicGraph<V,W>::degree_dist( const string &edge_filename, 
+                                   const string &output_filename ) {
 
-    vector<size_t> degree( _num_verts );
+    vector<V> degree( _num_verts );
 
-    FILE *edge_file = fopen_csv( edge_filename, "r" );
+    BasicEdgeStream<V,W> edges( edge_filename );
+    edges.rewind();
 
-    size_t source;
-    size_t target;
-    size_t weight;
+    const BasicEdge<V,W> *batch;
+    size_t count;
 
-    while( 1 ) {
+    while( ( batch = edges.next_batch( count ) ) != NULL ) {
 
-        scan_pos_int( edge_file, source );
-        scan_pos_int( edge_file, target );
-        scan_pos_int( edge_file, weight );
+        for ( size_t e = 0; e < count; ++e ) {
+            ++degree[batch[e].source];
+            ++degree[batch[e].target];
+        }
 
-        if ( weight == EOF ) break;
+    }
 
-        ++degree[source];
-        ++degree[target];
+    TsvWriter output( output_filename );
+
+    output.put( "node\tdegree\n" );
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        output.row( v, degree[v] );
+    }
+    output.close();
+}
 
+/**
+ * The backbone of the graph by the disparity filter of Serrano, Boguna
+ * and Vespignani. An edge of weight w at a vertex of strength s and
+ * degree k > 1 has the p-value
+ *
+ *     alpha = ( 1 - w/s )^( k - 1 )
+ *
+ * against the weights of the vertex being split uniformly at random over
+ * its edges. An edge is kept if it is significant, alpha below the given
+ * level, at either end; at a vertex of degree 1 it is never significant.
+ * The strengths and degrees take one pass over the edges and the kept
+ * edges are written, in the same format and order, in a second. The
+ * edges and total weight before and after go to report_filename. Returns
+ * the number of edges kept.
+ */
+template <typename V, typename W>
+size_t BasicGraph<V,W>::disparity_filter( const string &edge_filename,
+                                          const string &output_filename,
+                                          const string &report_filename,
+                                          const double alpha ) {
+
+    StageTimer timer( "disparity_filter" );
+    timer.add_file( edge_filename );
+
+    vector<uint64_t> strength( _num_verts );
+    vector<V> degree( _num_verts );
+
+    BasicEdgeStream<V,W> edges( edge_filename );
+    edges.rewind();
+
+    const BasicEdge<V,W> *batch;
+    size_t count;
+
+    while( ( batch = edges.next_batch( count ) ) != NULL ) {
+
+        timer.add_rows( count );
+
+        for ( size_t e = 0; e < count; ++e ) {
+            size_t last = std::max( batch[e].source, batch[e].target );
+            if ( last >= _num_verts ) {
+                fprintf( stderr, "Vertex out of range in %s: %zd\n",
+                                 edge_filename.c_str(), last );
+                abort();
+            }
+            strength[batch[e].source] += batch[e].weight;
+            strength[batch[e].target] += batch[e].weight;
+            ++degree[batch[e].source];
+            ++degree[batch[e].target];
+        }
     }
 
-    fclose( edge_file );
+    auto significant = [&]( const V v, const W weight ) {
+        if ( degree[v] < 2 ) return false;
+        double share = static_cast<double>( weight )/
+                       static_cast<double>( strength[v] );
+        return pow( 1.0 - share, static_cast<double>( degree[v] - 1 ) ) <
+                                                                    alpha;
+    };
 
-    FILE *output = fopen_csv( output_filename, "w", false );
+    TsvWriter output( output_filename );
+    output.put( "source\ttarget\tweight\n" );
 
-    fprintf( output, "node\tdegree\n" );
-    for ( size_t v = 0; v < _num_verts; ++v ) {
-        fprintf( output, "%zd\t%zd\n", v, degree[v] );
+    size_t num_edges = 0;
+    size_t num_kept = 0;
+    uint64_t total_weight = 0;
+    uint64_t kept_weight = 0;
+
+    edges.rewind();
+
+    while( ( batch = edges.next_batch( count ) ) != NULL ) {
+
+        timer.add_rows( count );
+
+        for ( size_t e = 0; e < count; ++e ) {
+
+            V source = batch[e].source;
+            V target = batch[e].target;
+            W weight = batch[e].weight;
+
+            ++num_edges;
+            total_weight += weight;
+
+            if ( significant( source, weight ) ||
+                 significant( target, weight ) ) {
+                output.row( source, target, weight );
+                ++num_kept;
+                kept_weight += weight;
+            }
+        }
     }
-    fclose( output );
-}
 
-void Graph::eigen_vect_cent( const string &edge_filename, 
-                             const string &output_filename,
-                             const int num_it,
-                             const double eps ) {
+    output.close();
+
+    fprintf( stderr, "backbone edges: %zd of %zd (%.2f%%)\n",
+                     num_kept, num_edges,
+                     100.0*num_kept/std::max( num_edges, size_t(1) ) );
+    fprintf( stderr, "backbone weight: %llu of %llu (%.2f%%)\n",
+                     static_cast<unsigned long long>( kept_weight ),
+                     static_cast<unsigned long long>( total_weight ),
+                     100.0*kept_weight/
+                            std::max( total_weight, uint64_t(1) ) );
 
+    TsvWriter report( report_filename );
+    report.put( "edges\tkept_edges\tweight\tkept_weight\n" );
+    report.row( num_edges, num_kept, total_weight, kept_weight );
+    report.close();
 
+    return num_kept;
+}
 
-    FILE *edge_file = fopen_csv( edge_filename, "r" );
+/**
+ * Eigenvector centrality by power iteration, written as ranks. With
+ * scores_filename the score vector is saved too, and with start_filename
+ * the iteration starts from a saved vector instead of the uniform one,
+ * so that after a small update to the edges it converges in a few
+ * iterations.
+ *
+ * With checkpoint_filename every iteration saves its vector, alternately
+ * to checkpoint_filename.0 and .1 so the one logged last is never being
+ * overwritten, and logs the iteration count and the running norms. A
+ * killed run carries on from the last iteration logged, with the same
+ * result as if it had not been interrupted.
+ */
+template <typename V, typename W>
+void BasicGraph<V,W>::eigen_vect_cent( const string &edge_filename, 
+                                       const string &output_filename,
+                                       const int num_it,
+                                       const double eps,
+                                       const string &scores_filename,
+                                       const string &start_filename,
+                                       const string &checkpoint_filename ) {
+
+
+
+    BasicEdgeStream<V,W> edges( edge_filename );
 
     double *rold = new double[_num_verts];
     double *rnew = new double[_num_verts];
     double *tmp;
 
-    double dnorm = sqrt( 1.0/static_cast<double>(_num_verts) );
-    for ( size_t v = 0; v < _num_verts; ++v ){
-        rold[v] = dnorm;
-    }
-    
+    Checkpoint checkpoint( checkpoint_filename,
+                           "eigen_vect_cent " +
+                           Checkpoint::fingerprint( { edge_filename,
+                                                      start_filename } ) +
+                           " verts=" + std::to_string( _num_verts ) );
+
     double wnorm = 1.0;
     long   wsq = 0;
 
-    size_t source;
-    size_t target;
-    size_t weight;
-
-    char *line = NULL;
-    size_t len = 0;
-
     double norm_last = 1.0;
     double delta = 1.0;
-    int it;
+    int it = 0;
+
+    // a record is the next iteration, wsq, norm_last, delta and the
+    // snapshot holding rold
+    if ( !checkpoint.records().empty() ) {
+        int slot = 0;
+        if ( sscanf( checkpoint.records().back().c_str(), "%d %ld %lg %lg %d",
+                     &it, &wsq, &norm_last, &delta, &slot ) != 5 ||
+             !read_snapshot( checkpoint_filename + "." +
+                                            std::to_string( slot ),
+                             rold, _num_verts ) ) {
+            fprintf( stderr, "Unusable checkpoint, starting afresh\n" );
+            it = 0;
+            wsq = 0;
+            norm_last = 1.0;
+            delta = 1.0;
+        } else {
+            wnorm = 1.0/sqrt( static_cast<double>(wsq) );
+        }
+    }
 
-    for ( it = 0; it < num_it; ++it ) {
+    if ( it == 0 && ( start_filename.empty() ||
+                      !read_scores( start_filename, rold, _num_verts ) ) ) {
+        double dnorm = sqrt( 1.0/static_cast<double>(_num_verts) );
+        for ( size_t v = 0; v < _num_verts; ++v ){
+            rold[v] = dnorm;
+        }
+    }
+    
+    // the newest normalized vector, which is rold after the swap when the
+    // iterations run out before converging
+    double *latest = rold;
 
-        fprintf(stderr,"%3d %14.7e %14.7e\n",it,delta,norm_last);
+    const BasicEdge<V,W> *batch;
+    size_t count;
 
-        rewind( edge_file );
-    
+    for ( ; it < num_it; ++it ) {
 
-        //pop the header line
-        int read = getline( &line, &len, edge_file );
+        fprintf(stderr,"%3d %14.7e %14.7e\n",it,delta,norm_last);
 
-        if ( read == EOF ) {
-            fprintf(stderr,"Bad file\n");
-            fclose( edge_file );
-            abort();
-        }
+        StageTimer timer( "eigen_vect_cent.iteration" );
+        timer.add_file( edge_filename );
+
+        edges.rewind();
 
         memset( rnew, 0, _num_verts*sizeof(double) );
 
-        
+        while( ( batch = edges.next_batch( count ) ) != NULL ) {
 
-        while( 1 ) {
+            timer.add_rows( count );
 
-            scan_pos_int( edge_file, source );
-            scan_pos_int( edge_file, target );
-            scan_pos_int( edge_file, weight );
+            for ( size_t e = 0; e < count; ++e ) {
 
-            if ( weight == EOF ) break;
+                size_t source = batch[e].source;
+                size_t target = batch[e].target;
+                size_t weight = batch[e].weight;
 
-            double dweight = static_cast<double>(weight)*wnorm;
+                double dweight = static_cast<double>(weight)*wnorm;
 
-            rnew[source] += dweight*rold[target];
-            rnew[target] += dweight*rold[source];
+                rnew[source] += dweight*rold[target];
+                rnew[target] += dweight*rold[source];
 
-            if ( it == 0 ) {
-                wsq += weight*weight;
+                if ( it == 0 ) {
+                    wsq += weight*weight;
+                }
             }
 
         }
@@ -144,6 +511,7 @@ void Graph::eigen_vect_cent( const string &edge_filename,
         for ( size_t i = 0; i < _num_verts; ++i ){
             rnew[i] *= inv_norm;
         }
+        latest = rnew;
 
         delta = fabs( (norm - norm_last) )/norm_last;
         if ( delta < eps ) break;
@@ -153,105 +521,299 @@ void Graph::eigen_vect_cent( const string &edge_filename,
         tmp = rold;
         rold = rnew;
         rnew = tmp;
-    }
 
-    fclose( edge_file );
+        if ( checkpoint.enabled() ) {
+            string snapshot = checkpoint_filename + "." +
+                                                std::to_string( it % 2 );
+            write_scores( snapshot, rold, _num_verts, true );
+
+            char record[128];
+            snprintf( record, sizeof(record), "%d %ld %.17g %.17g %d",
+                      it + 1, wsq, norm_last, delta, it % 2 );
+            checkpoint.record( record );
+        }
+    }
 
     fprintf(stderr,"num iterations: %d\n", it );
     fprintf(stderr,"eigenvalue: %14.7e\n", norm_last );
 
-    vector<size_t> ranks = sort_indexes( rnew, _num_verts );
+    vector<size_t> ranks = sort_indexes( latest, _num_verts );
 
-    FILE *output = fopen_csv( output_filename, "w", false );
+    TsvWriter output( output_filename );
 
-    fprintf( output, "node\trank\n" );
+    output.put( "node\trank\n" );
     for ( size_t v = 0; v < _num_verts; ++v ) {
-        fprintf( output, "%zd\t%zd\n", ranks[v], (v+1) );
+        output.row( ranks[v], (v+1) );
+    }
+    output.close();
+
+    if ( !scores_filename.empty() ) {
+        write_scores( scores_filename, latest, _num_verts );
     }
-    fclose( output );
 
     delete[] rnew;
     delete[] rold;
+
+    if ( checkpoint.enabled() ) {
+        checkpoint.finish();
+        unlink( ( checkpoint_filename + ".0" ).c_str() );
+        unlink( ( checkpoint_filename + ".1" ).c_str() );
+    }
 }
 
-void Graph::cluster_stats( const string &edge_filename, 
-                           const string &output_filename ) {
+/**
+ * Eigenvector centrality, Katz centrality and PageRank from one sequence
+ * of sweeps over the edges. The three vectors are interleaved, four
+ * doubles per vertex with one lane spare, so each edge read updates all
+ * of them with one SIMD multiply-add per end point; every lane is scaled
+ * on the way in so that the sweep itself is the same product for all.
+ *
+ * Eigenvector and Katz use the weights over their Frobenius norm, so the
+ * spectral radius is at most 1 and Katz converges for katz_alpha < 1:
+ *
+ *     eigenvector    x <- A x/|A x|, stopping like eigen_vect_cent
+ *     katz           x <- katz_alpha A x + 1
+ *     pagerank       x <- (1-damping)/N + damping A D^-1 x, with the
+ *                    rank of vertices without edges spread evenly
+ *
+ * Katz and PageRank stop once the L1 change is below eps relative to the
+ * L1 norm. A converged lane is frozen while the others go on. The scores
+ * are written as "node\teigenvector\tkatz\tpagerank".
+ */
+template <typename V, typename W>
+void BasicGraph<V,W>::centrality_sweep( const string &edge_filename,
+                                        const string &output_filename,
+                                        const int num_it,
+                                        const double eps,
+                                        const double katz_alpha,
+                                        const double damping ) {
+
+    StageTimer timer( "centrality_sweep" );
+
+    BasicEdgeStream<V,W> edges( edge_filename );
+
+    const BasicEdge<V,W> *batch;
+    size_t count;
+
+    // weighted degrees and the Frobenius norm of the weights
+
+    vector<double> strength( _num_verts, 0.0 );
+    double wsq = 0.0;
+
+    edges.rewind();
+    while( ( batch = edges.next_batch( count ) ) != NULL ) {
+        timer.add_rows( count );
+        for ( size_t e = 0; e < count; ++e ) {
+            double weight = static_cast<double>( batch[e].weight );
+            strength[batch[e].source] += weight;
+            strength[batch[e].target] += weight;
+            wsq += weight*weight;
+        }
+    }
 
-    FILE *edge_fp = fopen_csv( edge_filename, "r" );
+    double wnorm = ( wsq > 0.0 ? 1.0/sqrt( wsq ) : 0.0 );
+    double n = static_cast<double>( _num_verts );
 
-    vector<size_t> membership( _num_verts );
-    vector<size_t> degree( _num_verts );
-    vector<unordered_set<size_t>> clusters(1);
+    vector<double> score( 4*_num_verts );
+    vector<double> in( 4*_num_verts, 0.0 );
+    vector<double> out( 4*_num_verts );
 
-    size_t source;
-    size_t target;
-    size_t weight;
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        score[4*v+EIG_LANE] = sqrt( 1.0/n );
+        score[4*v+KATZ_LANE] = 1.0;
+        score[4*v+PR_LANE] = 1.0/n;
+    }
 
-    stack<size_t> cluster_ids;
-    size_t max_id = 1;
+    bool converged[3] = { false, false, false };
+    double norm_last = 1.0;
+    int it;
+
+    for ( it = 0; it < num_it; ++it ) {
+
+        StageTimer sweep_timer( "centrality_sweep.iteration" );
+        sweep_timer.add_file( edge_filename );
+
+        double dangling = 0.0;
+
+        for ( size_t v = 0; v < _num_verts; ++v ) {
+            in[4*v+EIG_LANE] = wnorm*score[4*v+EIG_LANE];
+            in[4*v+KATZ_LANE] = katz_alpha*wnorm*score[4*v+KATZ_LANE];
+            if ( strength[v] > 0.0 ) {
+                in[4*v+PR_LANE] = damping*score[4*v+PR_LANE]/strength[v];
+            } else {
+                dangling += score[4*v+PR_LANE];
+            }
+        }
+
+        std::fill( out.begin(), out.end(), 0.0 );
+
+        edges.rewind();
+        while( ( batch = edges.next_batch( count ) ) != NULL ) {
+
+            sweep_timer.add_rows( count );
+
+            for ( size_t e = 0; e < count; ++e ) {
+                size_t source = batch[e].source;
+                size_t target = batch[e].target;
+                double weight = static_cast<double>( batch[e].weight );
+                axpy4( &out[4*source], weight, &in[4*target] );
+                axpy4( &out[4*target], weight, &in[4*source] );
+            }
+        }
+
+        double norm_sq = 0.0;
+        for ( size_t v = 0; v < _num_verts; ++v ) {
+            norm_sq += out[4*v+EIG_LANE]*out[4*v+EIG_LANE];
+        }
+        double norm = sqrt( norm_sq );
+
+        double teleport = ( 1.0 - damping )/n + damping*dangling/n;
+
+        double change[3] = { 0.0, 0.0, 0.0 };
+        double total[3] = { 0.0, 0.0, 0.0 };
+
+        for ( size_t v = 0; v < _num_verts; ++v ) {
+
+            double *s = &score[4*v];
+            const double *o = &out[4*v];
+
+            if ( !converged[EIG_LANE] && norm > 0.0 ) {
+                s[EIG_LANE] = o[EIG_LANE]/norm;
+            }
+            if ( !converged[KATZ_LANE] ) {
+                double x = o[KATZ_LANE] + 1.0;
+                change[KATZ_LANE] += fabs( x - s[KATZ_LANE] );
+                total[KATZ_LANE] += x;
+                s[KATZ_LANE] = x;
+            }
+            if ( !converged[PR_LANE] ) {
+                double x = o[PR_LANE] + teleport;
+                change[PR_LANE] += fabs( x - s[PR_LANE] );
+                total[PR_LANE] += x;
+                s[PR_LANE] = x;
+            }
+        }
+
+        if ( !converged[EIG_LANE] ) {
+            double delta = fabs( norm - norm_last )/norm_last;
+            norm_last = norm;
+            converged[EIG_LANE] = ( delta < eps );
+        }
+        for ( int lane = KATZ_LANE; lane <= PR_LANE; ++lane ) {
+            if ( !converged[lane] ) {
+                converged[lane] = ( change[lane] < eps*total[lane] );
+            }
+        }
+
+        fprintf(stderr,"%3d %14.7e %d %d %d\n", it, norm,
+                        converged[EIG_LANE], converged[KATZ_LANE],
+                        converged[PR_LANE] );
+
+        if ( converged[EIG_LANE] && converged[KATZ_LANE] &&
+                                            converged[PR_LANE] ) {
+            ++it;
+            break;
+        }
+    }
+
+    fprintf(stderr,"num sweeps: %d\n", it );
+    fprintf(stderr,"eigenvalue: %14.7e\n", norm_last );
+
+    TsvWriter output( output_filename );
+
+    output.put( "node\teigenvector\tkatz\tpagerank\n" );
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        output.row( v, Fixed( score[4*v+EIG_LANE], 10 ),
+                       Fixed( score[4*v+KATZ_LANE], 10 ),
+                       Fixed( score[4*v+PR_LANE], 10 ) );
+    }
+    output.close();
+}
+
+template <typename V, typename W>
+void BasicGraph<V,W>::cluster_stats( const string &edge_filename, 
+                                     const string &output_filename ) {
+
+    StageTimer timer( "cluster_stats" );
+    timer.add_file( edge_filename );
+
+    BasicEdgeStream<V,W> edges( edge_filename );
+
+    vector<V> membership( _num_verts );
+    vector<V> degree( _num_verts );
+    vector<unordered_set<V>> clusters(1);
+
+    const BasicEdge<V,W> *batch;
+    size_t count;
+
+    stack<V> cluster_ids;
+    V max_id = 1;
 
     cluster_ids.push(max_id);
 
-    while( 1 ) {
+    edges.rewind();
 
-        scan_pos_int( edge_fp, source );
-        scan_pos_int( edge_fp, target );
-        scan_pos_int( edge_fp, weight );
+    while( ( batch = edges.next_batch( count ) ) != NULL ) {
 
-        if ( weight == EOF ) break;
+        timer.add_rows( count );
 
-        degree[source] += 1;
-        degree[target] += 1;
+        for ( size_t e = 0; e < count; ++e ) {
 
-        int seen_1 = membership[source];
-        int seen_2 = membership[target];
+            V source = batch[e].source;
+            V target = batch[e].target;
 
-        if ( !seen_1 && !seen_2 ) {
-            size_t cid = cluster_ids.top();
-            cluster_ids.pop();
-            membership[source] =  cid;
-            membership[target] =  cid;
-            if ( cid < max_id ) {
-                clusters[cid].insert( source );
+            degree[source] += 1;
+            degree[target] += 1;
+
+            V seen_1 = membership[source];
+            V seen_2 = membership[target];
+
+            if ( !seen_1 && !seen_2 ) {
+                V cid = cluster_ids.top();
+                cluster_ids.pop();
+                membership[source] =  cid;
+                membership[target] =  cid;
+                if ( cid < max_id ) {
+                    clusters[cid].insert( source );
+                    clusters[cid].insert( target );
+                } else {
+                    unordered_set<V> cluster;
+                    cluster.insert(source);
+                    cluster.insert(target);
+                    clusters.push_back( cluster );
+                    ++max_id;
+                    cluster_ids.push(max_id);
+                }
+            } else if ( seen_1 && !seen_2 ) {
+                V cid = membership[source];
+                membership[target] = cid;
                 clusters[cid].insert( target );
+            } else if ( !seen_1 && seen_2 ) {
+                V cid = membership[target];
+                membership[source] = cid;
+                clusters[cid].insert( source );
             } else {
-                unordered_set<size_t> cluster;
-                cluster.insert(source);
-                cluster.insert(target);
-                clusters.push_back( cluster );
-                ++max_id;
-                cluster_ids.push(max_id);
-            }
-        } else if ( seen_1 && !seen_2 ) {
-            size_t cid = membership[source];
-            membership[target] = cid;
-            clusters[cid].insert( target );
-        } else if ( !seen_1 && seen_2 ) {
-            size_t cid = membership[target];
-            membership[source] = cid;
-            clusters[cid].insert( source );
-        } else {
-            size_t cid1 = membership[source];
-            size_t cid2 = membership[target];
-            if ( cid1 < cid2 ) {
-                for ( size_t vert : clusters[cid2] ) {
-                    membership[vert] = cid1;
-                    clusters[cid1].insert(vert);
+                V cid1 = membership[source];
+                V cid2 = membership[target];
+                if ( cid1 < cid2 ) {
+                    for ( V vert : clusters[cid2] ) {
+                        membership[vert] = cid1;
+                        clusters[cid1].insert(vert);
+                    }
+                    clusters[cid2].clear();
+                    cluster_ids.push(cid2);
+                } else if ( cid2 < cid1 ) {
+                    for ( V vert : clusters[cid1] ) {
+                        membership[vert] = cid2;
+                        clusters[cid2].insert(vert);
+                    }
+                    clusters[cid1].clear();
+                    cluster_ids.push(cid1);
                 }
-                clusters[cid2].clear();
-                cluster_ids.push(cid2);
-            } else if ( cid2 < cid1 ) {
-                for ( size_t vert : clusters[cid1] ) {
-                    membership[vert] = cid2;
-                    clusters[cid2].insert(vert);
-                }
-                clusters[cid1].clear();
-                cluster_ids.push(cid1);
             }
         }
-    }
 
-    fclose( edge_fp );
+    }
 
     fprintf(stderr,"size cluster 0: %zd\n",clusters[0].size() );
 
@@ -260,7 +822,7 @@ void Graph::cluster_stats( const string &edge_filename,
     double frag = 1.0;
     double nverts = static_cast<double>( _num_verts );
     double norm = 1.0/( nverts*( nverts - 1.0 ) );
-    for ( unordered_set<size_t> cluster : clusters ) {
+    for ( const unordered_set<V> &cluster : clusters ) {
         double cs = static_cast<double>( cluster.size() );
         frag -= (cs*(cs-1.0)*norm);
     }
@@ -273,7 +835,7 @@ void Graph::cluster_stats( const string &edge_filename,
     long num_clusters = 0;
     long max_cluster = 0;
     long num_nodes = 0;
-    for ( unordered_set<size_t> cluster : clusters ) {
+    for ( const unordered_set<V> &cluster : clusters ) {
         long cs = cluster.size();
         if ( cs > 0 ) {
             if ( max_cluster < cs ) max_cluster = cs; 
@@ -295,107 +857,684 @@ void Graph::cluster_stats( const string &edge_filename,
 
     fprintf(stderr,"Saving memberships ...\n");
 
-    FILE *out_fp = fopen_csv( output_filename, "w" );
+    TsvWriter out_fp( output_filename );
 
-    fprintf( out_fp, "node\tmembership\n");
+    out_fp.put( "node\tmembership\n" );
     size_t cluster_id = 1;
-    for ( unordered_set<size_t> cluster : clusters ) {
+    for ( const unordered_set<V> &cluster : clusters ) {
         if ( cluster.size() > 0 ) {
-            for ( size_t node : cluster ) {
-                fprintf( out_fp, "%zd\t%zd\n", node, cluster_id );
+            for ( V node : cluster ) {
+                out_fp.row( node, cluster_id );
             }
             ++cluster_id;
         }
     }
-    fclose( out_fp );
+    out_fp.close();
 
 }
 
-double Graph::modularity( const string &edges_filename,
-                          const string &dc_filename,
-                          const string &membership_filename ) {
+/**
+ * Count the triangles through every vertex and the local clustering
+ * coefficients. The edges are oriented from lower to higher (degree, id)
+ * rank so that every triangle is found exactly once, by intersecting the
+ * out-lists of the two lower ranked corners. Returns the global
+ * transitivity.
+ */
+template <typename V, typename W>
+double BasicGraph<V,W>::triangle_stats( const string &edge_filename,
+                                        const string &output_filename ) {
 
-    // Read in the membership
-    fprintf(stderr,"Reading in memberships...\n");
+    fprintf(stderr,"Loading edges...\n");
 
-    vector<int> membership( _num_verts );
+    CSR graph( _num_verts );
+    graph.load( edge_filename );
 
-    size_t vertex;
-    size_t community;
+    fprintf(stderr,"Orienting edges...\n");
+
+    // relabel by degree, lowest first, ties by id
+    vector<size_t> degree( _num_verts );
+    for ( size_t v = 0; v < _num_verts; ++v ) degree[v] = graph.degree( v );
+    vector<size_t> order = radix_argsort( degree.data(), _num_verts, false );
+    vector<size_t>().swap( degree );
+
+    vector<uint32_t> new_id( _num_verts );
+    for ( size_t r = 0; r < _num_verts; ++r ) new_id[order[r]] = r;
+
+    vector<size_t> offsets( _num_verts + 1, 0 );
+    for ( size_t r = 0; r < _num_verts; ++r ) {
+        uint32_t v = order[r];
+        const uint32_t *nbrs = graph.neighbors( v );
+        size_t out = 0;
+        for ( size_t e = 0; e < graph.degree( v ); ++e ) {
+            if ( new_id[nbrs[e]] > r ) ++out;
+        }
+        offsets[r+1] = offsets[r] + out;
+    }
+
+    vector<uint32_t> out_list( offsets[_num_verts] );
+    for ( size_t r = 0; r < _num_verts; ++r ) {
+        uint32_t v = order[r];
+        const uint32_t *nbrs = graph.neighbors( v );
+        size_t fill = offsets[r];
+        for ( size_t e = 0; e < graph.degree( v ); ++e ) {
+            if ( new_id[nbrs[e]] > r ) out_list[fill++] = new_id[nbrs[e]];
+        }
+        std::sort( out_list.begin() + offsets[r], out_list.begin() + fill );
+    }
 
-    FILE *memb_fp = fopen_csv( membership_filename, "r" );
+    fprintf(stderr,"Counting triangles...\n");
 
-    while( 1 ) {
-        scan_pos_int( memb_fp, vertex );
-        scan_pos_int( memb_fp, community );
+    ThreadPool &pool = ThreadPool::instance();
 
-        if ( community == EOF ) break;
+    // per-slot counts, split by the out-degrees so that the rows of the
+    // hubs are spread over the workers
+    vector<vector<uint64_t>> local( pool.max_slots() );
 
-        membership[vertex] = community;
+    pool.parallel_for_weighted( offsets.data(), _num_verts,
+                                [&]( size_t begin, size_t end ) {
+
+        vector<uint64_t> &tri = local[ThreadPool::slot()];
+        if ( tri.empty() ) tri.assign( _num_verts, 0 );
+
+        for ( size_t u = begin; u < end; ++u ) {
+            const uint32_t *nu = out_list.data() + offsets[u];
+            size_t du = offsets[u+1] - offsets[u];
+            for ( size_t e = 0; e < du; ++e ) {
+                uint32_t v = nu[e];
+                const uint32_t *nv = out_list.data() + offsets[v];
+                size_t dv = offsets[v+1] - offsets[v];
+                intersect_sorted( nu, du, nv, dv, [&]( uint32_t w ) {
+                    ++tri[u];
+                    ++tri[v];
+                    ++tri[w];
+                });
+            }
+        }
+    });
+
+    vector<uint64_t> tri( _num_verts, 0 );
+    for ( vector<uint64_t> &counts : local ) {
+        if ( counts.empty() ) continue;
+        for ( size_t r = 0; r < _num_verts; ++r ) tri[r] += counts[r];
+        vector<uint64_t>().swap( counts );
     }
 
-    fclose( memb_fp );
+    uint64_t tri_sum = 0;
+    double triples = 0.0;
+    for ( size_t r = 0; r < _num_verts; ++r ) {
+        double d = static_cast<double>( graph.degree( order[r] ) );
+        tri_sum += tri[r];
+        triples += 0.5*d*( d - 1.0 );
+    }
 
-    // Load node degrees
+    double transitivity = ( triples > 0.0 ?
+                            static_cast<double>( tri_sum )/triples : 0.0 );
 
-    fprintf(stderr,"Loading node derees...\n");
+    fprintf(stderr,"number of triangles: %zd\n", tri_sum/3 );
+    fprintf(stderr,"transitivity: %14.7e\n", transitivity );
+
+    TsvWriter output( output_filename );
+
+    output.put( "node\ttriangles\tclustering\n" );
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        double d = static_cast<double>( graph.degree( v ) );
+        uint64_t t = tri[new_id[v]];
+        double cc = ( d > 1.0 ?
+                        static_cast<double>( t )/( 0.5*d*( d - 1.0 ) ) : 0.0 );
+        output.row( v, t, Fixed( cc, 6 ) );
+    }
+    output.close();
+
+    return transitivity;
+}
+
+/**
+ * The core number of every vertex: the largest k such that the vertex is
+ * in the k-core, the maximal subgraph with minimum degree k. With one
+ * thread in the ThreadPool the vertices are peeled in order of degree
+ * from an array of degree buckets (Batagelj and Zaversnik), in O(V+E).
+ * With more, every level k peels its whole frontier in parallel: the
+ * degree of a neighbor is decremented atomically and it joins the
+ * frontier when it drops to k, or the bucket of its new degree when that
+ * is higher, so a level only looks at its own bucket. Returns the
+ * degeneracy, the largest core number.
+ */
+template <typename V, typename W>
+size_t BasicGraph<V,W>::core_decomposition( const string &edge_filename,
+                                            const string &output_filename ) {
+
+    StageTimer timer( "core_decomposition" );
+    timer.add_file( edge_filename );
+
+    fprintf(stderr,"Loading edges...\n");
+
+    CSR graph( _num_verts );
+    graph.load( edge_filename );
+
+    timer.add_rows( graph.num_edges() );
+
+    ThreadPool &pool = ThreadPool::instance();
+
+    fprintf(stderr,"Peeling cores...\n");
+
+    vector<uint32_t> core( _num_verts );
+
+    if ( pool.num_threads() == 1 ) {
+
+        size_t max_degree = 0;
+        for ( size_t v = 0; v < _num_verts; ++v ) {
+            core[v] = graph.degree( v );
+            max_degree = std::max( max_degree, graph.degree( v ) );
+        }
+
+        // vertices sorted by current degree, bin[d] the start of degree d
+        vector<size_t> bin( max_degree + 2, 0 );
+        for ( size_t v = 0; v < _num_verts; ++v ) ++bin[core[v]+1];
+        for ( size_t d = 0; d <= max_degree; ++d ) bin[d+1] += bin[d];
+
+        vector<uint32_t> vert( _num_verts );
+        vector<size_t> pos( _num_verts );
+        {
+            vector<size_t> fill( bin.begin(), bin.end() - 1 );
+            for ( size_t v = 0; v < _num_verts; ++v ) {
+                pos[v] = fill[core[v]]++;
+                vert[pos[v]] = v;
+            }
+        }
+
+        for ( size_t i = 0; i < _num_verts; ++i ) {
+            uint32_t v = vert[i];
+            const uint32_t *nbrs = graph.neighbors( v );
+            for ( size_t e = 0; e < graph.degree( v ); ++e ) {
+                uint32_t u = nbrs[e];
+                if ( core[u] <= core[v] ) continue;
+                // swap u with the first vertex of its bin, then shrink
+                // the bin past it
+                uint32_t du = core[u];
+                size_t pu = pos[u];
+                size_t pw = bin[du];
+                uint32_t w = vert[pw];
+                if ( u != w ) {
+                    vert[pu] = w;
+                    pos[w] = pu;
+                    vert[pw] = u;
+                    pos[u] = pw;
+                }
+                ++bin[du];
+                --core[u];
+            }
+        }
+
+    } else {
+
+        unique_ptr<std::atomic<uint32_t>[]> degree(
+                                    new std::atomic<uint32_t>[_num_verts] );
+        size_t max_degree = 0;
+        for ( size_t v = 0; v < _num_verts; ++v ) {
+            degree[v].store( graph.degree( v ), std::memory_order_relaxed );
+            max_degree = std::max( max_degree, graph.degree( v ) );
+        }
+
+        // bucket[d] holds every vertex whose degree has been d, the
+        // candidates of level d: a vertex is added once initially and
+        // once per decrement, so the levels scan O(V+E) entries in all
+        vector<vector<uint32_t>> bucket( max_degree + 1 );
+        for ( size_t v = 0; v < _num_verts; ++v ) {
+            bucket[graph.degree( v )].push_back( v );
+        }
+
+        vector<uint32_t> frontier;
+        vector<size_t> frontier_degrees;
+        vector<vector<uint32_t>> local( pool.max_slots() );
+        vector<vector<std::pair<uint32_t,uint32_t>>> moved(
+                                                        pool.max_slots() );
+
+        size_t num_peeled = 0;
+
+        // gather the vertices found by every slot into the frontier, and
+        // those whose degree dropped above the level into their buckets
+        auto gather = [&]() {
+            frontier.clear();
+            for ( vector<uint32_t> &found : local ) {
+                frontier.insert( frontier.end(), found.begin(), found.end() );
+                found.clear();
+            }
+            for ( auto &slot_moved : moved ) {
+                for ( const auto &m : slot_moved ) {
+                    bucket[m.first].push_back( m.second );
+                }
+                slot_moved.clear();
+            }
+        };
+
+        for ( uint32_t k = 0; num_peeled < _num_verts; ++k ) {
+
+            // the vertices of the bucket left with degree k
+            const vector<uint32_t> candidates( std::move( bucket[k] ) );
+            pool.parallel_for( 0, candidates.size(),
+                               [&]( size_t begin, size_t end ) {
+                vector<uint32_t> &found = local[ThreadPool::slot()];
+                for ( size_t i = begin; i < end; ++i ) {
+                    uint32_t v = candidates[i];
+                    if ( degree[v].load( std::memory_order_relaxed ) == k ) {
+                        found.push_back( v );
+                    }
+                }
+            });
+            gather();
+
+            while ( !frontier.empty() ) {
+
+                // a peeled vertex keeps degree k: never found again, and
+                // never decremented by later levels
+                for ( uint32_t v : frontier ) core[v] = k;
+                num_peeled += frontier.size();
 
-    vector<int> degrees( _num_verts );
+                const vector<uint32_t> current( std::move( frontier ) );
 
-    FILE *deg_fp = fopen_csv( dc_filename, "r" );
+                frontier_degrees.assign( 1, 0 );
+                for ( uint32_t v : current ) {
+                    frontier_degrees.push_back( frontier_degrees.back() +
+                                                graph.degree( v ) );
+                }
 
-    size_t degree;
+                pool.parallel_for_weighted( frontier_degrees.data(),
+                                            current.size(),
+                                            [&]( size_t begin, size_t end ) {
+                    vector<uint32_t> &found = local[ThreadPool::slot()];
+                    auto &slot_moved = moved[ThreadPool::slot()];
+                    for ( size_t i = begin; i < end; ++i ) {
+                        uint32_t v = current[i];
+                        const uint32_t *nbrs = graph.neighbors( v );
+                        for ( size_t e = 0; e < graph.degree( v ); ++e ) {
+                            uint32_t u = nbrs[e];
+                            if ( degree[u].load(
+                                    std::memory_order_relaxed ) <= k ) {
+                                continue;
+                            }
+                            uint32_t old = degree[u].fetch_sub( 1 );
+                            if ( old == k + 1 ) {
+                                found.push_back( u );
+                            } else if ( old > k + 1 ) {
+                                slot_moved.emplace_back( old - 1, u );
+                            } else {
+                                degree[u].fetch_add( 1 );
+                            }
+                        }
+                    }
+                });
+                gather();
+            }
+        }
+    }
 
-    while( 1 ) {
+    uint32_t max_core = 0;
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        max_core = std::max( max_core, core[v] );
+    }
 
-        scan_pos_int( deg_fp, vertex );
-        scan_pos_int( deg_fp, degree );
+    fprintf(stderr,"degeneracy: %u\n", max_core );
 
-        if ( degree == EOF ) break;
+    TsvWriter output( output_filename );
 
-        degrees[vertex] = degree;
+    output.put( "node\tcore\n" );
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        output.row( v, core[v] );
+    }
+    output.close();
+
+    return max_core;
+}
+
+/**
+ * Write the k-core, the edges between vertices of core number k or more,
+ * as a new edge file. The vertices of the core are renumbered densely in
+ * order of their old ids and the map file lists, for every new id, the
+ * old one. Returns the number of vertices of the core.
+ */
+template <typename V, typename W>
+size_t BasicGraph<V,W>::core_subgraph( const string &edge_filename,
+                                       const string &core_filename,
+                                       const size_t k,
+                                       const string &subgraph_filename,
+                                       const string &map_filename ) {
+
+    StageTimer timer( "core_subgraph" );
+    timer.add_file( edge_filename );
+
+    vector<uint64_t> rows;
+    size_t num_rows;
+
+    vector<V> new_id( _num_verts, 0 );
+    vector<bool> in_core( _num_verts, false );
+
+    TsvReader core_fp( core_filename, 2 );
+
+    while( ( num_rows = core_fp.read_rows( rows ) ) > 0 ) {
+        for ( size_t r = 0; r < num_rows; ++r ) {
+            if ( rows[2*r] >= _num_verts ) {
+                fprintf( stderr, "Vertex out of range in %s: %zd\n",
+                                 core_filename.c_str(), rows[2*r] );
+                abort();
+            }
+            if ( rows[2*r+1] >= k ) in_core[rows[2*r]] = true;
+        }
     }
 
-    fclose( deg_fp );
+    TsvWriter map_out( map_filename );
+
+    map_out.put( "node\treviewer\n" );
+    size_t num_core = 0;
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        if ( in_core[v] ) {
+            new_id[v] = num_core;
+            map_out.row( num_core, v );
+            ++num_core;
+        }
+    }
+    map_out.close();
+
+    BasicEdgeStream<V,W> edges( edge_filename );
+    edges.rewind();
+
+    const BasicEdge<V,W> *batch;
+    size_t count;
+    size_t num_edges = 0;
+    size_t num_kept = 0;
+
+    TsvWriter output( subgraph_filename );
+
+    output.put( "source\ttarget\tweight\n" );
+
+    while( ( batch = edges.next_batch( count ) ) != NULL ) {
+
+        num_edges += count;
+
+        for ( size_t e = 0; e < count; ++e ) {
+            V source = batch[e].source;
+            V target = batch[e].target;
+            if ( in_core[source] && in_core[target] ) {
+                output.row( new_id[source], new_id[target], batch[e].weight );
+                ++num_kept;
+            }
+        }
+    }
+    output.close();
+
+    timer.add_rows( num_edges );
+
+    fprintf(stderr,"%zd-core: %zd of %zd vertices, %zd of %zd edges\n",
+                    k, num_core, _num_verts, num_kept, num_edges );
+
+    return num_core;
+}
+
+/**
+ * Hop distances in the largest cluster of the membership file, from
+ * direction-optimizing BFS on the CSR copy of the edges.
+ *
+ * Four double sweeps, each from the farthest vertex of the last, bound
+ * the diameter: every eccentricity is a lower bound and twice any is an
+ * upper one. BFS from num_sources random members estimate the distance
+ * distribution, written as "hops\tfraction\tcumulative", and the
+ * closeness of every member (Eppstein and Wang), written as
+ * "node\tcloseness". Returns the effective diameter, the interpolated
+ * hop count within which 90% of the connected pairs lie.
+ */
+template <typename V, typename W>
+double BasicGraph<V,W>::distance_stats( const string &edge_filename,
+                                        const string &membership_filename,
+                                        const string &distances_filename,
+                                        const string &closeness_filename,
+                                        const size_t num_sources,
+                                        const uint64_t seed ) {
+
+    StageTimer timer( "distance_stats" );
+    timer.add_file( edge_filename );
+
+    fprintf(stderr,"Loading edges...\n");
+
+    CSR graph( _num_verts );
+    graph.load( edge_filename );
+
+    // the members of the largest cluster
+
+    vector<uint64_t> rows;
+    size_t num_rows;
+
+    vector<V> membership( _num_verts, 0 );
+    unordered_map<V,size_t> cluster_size;
+
+    TsvReader memb_fp( membership_filename, 2 );
+
+    while( ( num_rows = memb_fp.read_rows( rows ) ) > 0 ) {
+        for ( size_t r = 0; r < num_rows; ++r ) {
+            if ( rows[2*r] >= _num_verts ) {
+                fprintf( stderr, "Vertex out of range in %s: %zd\n",
+                                 membership_filename.c_str(), rows[2*r] );
+                abort();
+            }
+            membership[rows[2*r]] = rows[2*r+1];
+            ++cluster_size[rows[2*r+1]];
+        }
+    }
+
+    V giant = 0;
+    size_t giant_size = 0;
+    for ( const pair<const V,size_t> &cs : cluster_size ) {
+        if ( cs.second > giant_size ||
+             ( cs.second == giant_size && cs.first < giant ) ) {
+            giant = cs.first;
+            giant_size = cs.second;
+        }
+    }
+
+    if ( giant_size < 2 ) {
+        fprintf( stderr, "No cluster in %s\n", membership_filename.c_str() );
+        abort();
+    }
+
+    vector<uint32_t> members;
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        if ( membership[v] == giant ) members.push_back( v );
+    }
+
+    // a random sample of sources, by a partial Fisher-Yates shuffle
+
+    size_t k = std::min( std::max( num_sources, size_t( 1 ) ),
+                         members.size() );
+    for ( size_t i = 0; i < k; ++i ) {
+        size_t j = i + mix64( seed + i ) % ( members.size() - i );
+        std::swap( members[i], members[j] );
+    }
+
+    BFS bfs( graph );
+
+    fprintf(stderr,"Bounding the diameter...\n");
+
+    uint32_t lower = 0;
+    uint32_t upper = std::numeric_limits<uint32_t>::max();
+    uint32_t sweep = members[0];
+    for ( int it = 0; it < 4; ++it ) {
+        bfs.run( sweep );
+        lower = std::max( lower, bfs.eccentricity() );
+        upper = std::min( upper, 2*bfs.eccentricity() );
+        sweep = bfs.farthest();
+    }
+
+    fprintf(stderr,"diameter: [%u, %u]\n", lower, upper );
+
+    fprintf(stderr,"Sampling distances...\n");
+
+    vector<uint64_t> hops;
+    vector<uint64_t> dist_sum( _num_verts, 0 );
+    size_t num_unreached = 0;
+
+    std::chrono::steady_clock::time_point start =
+                                        std::chrono::steady_clock::now();
+
+    for ( size_t i = 0; i < k; ++i ) {
+
+        size_t num_reached = bfs.run( members[i] );
+        timer.add_rows( num_reached );
+
+        const vector<uint32_t> &dist = bfs.distances();
+
+        if ( hops.size() <= bfs.eccentricity() ) {
+            hops.resize( bfs.eccentricity() + 1, 0 );
+        }
+        // a member the source does not reach is in another component of
+        // the edges than the membership file says
+        for ( uint32_t v : members ) {
+            if ( dist[v] == BFS::UNREACHED ) {
+                ++num_unreached;
+                continue;
+            }
+            ++hops[dist[v]];
+            dist_sum[v] += dist[v];
+        }
+    }
+
+    if ( num_unreached > 0 ) {
+        fprintf(stderr,"%zd source and member pairs not connected, skipped: "
+                       "%s does not match the edges\n",
+                       num_unreached, membership_filename.c_str() );
+    }
+
+    std::chrono::duration<double> elapsed =
+                            std::chrono::steady_clock::now() - start;
+
+    fprintf(stderr,"seconds per BFS: %10.3e\n", elapsed.count()/k );
+
+    // the distance distribution over the connected pairs, hop 0 excluded
+
+    double num_pairs = 0.0;
+    for ( size_t h = 1; h < hops.size(); ++h ) num_pairs += hops[h];
+
+    TsvWriter dist_out( distances_filename );
+
+    dist_out.put( "hops\tfraction\tcumulative\n" );
+
+    double cumulative = 0.0;
+    double effective = 0.0;
+    for ( size_t h = 1; h < hops.size(); ++h ) {
+        double fraction = hops[h]/num_pairs;
+        if ( cumulative < 0.9 && cumulative + fraction >= 0.9 ) {
+            effective = ( h - 1 ) + ( 0.9 - cumulative )/fraction;
+        }
+        cumulative += fraction;
+        dist_out.row( h, Fixed( fraction, 7 ), Fixed( cumulative, 7 ) );
+    }
+    dist_out.close();
+
+    fprintf(stderr,"effective diameter: %10.3e\n", effective );
+
+    // closeness, with the mean distance to all members estimated from the
+    // mean distance to the sources
+
+    double n = static_cast<double>( members.size() );
+
+    std::sort( members.begin(), members.end() );
+
+    TsvWriter close_out( closeness_filename );
+
+    close_out.put( "node\tcloseness\n" );
+    for ( uint32_t v : members ) {
+        double mean = n/( k*( n - 1.0 ) )*static_cast<double>( dist_sum[v] );
+        close_out.row( v, Fixed( mean > 0.0 ? 1.0/mean : 0.0, 7 ) );
+    }
+    close_out.close();
+
+    return effective;
+}
+
+template <typename V, typename W>
+double BasicGraph<V,W>::modularity( const string &edges_filename,
+                                    const string &dc_filename,
+                                    const string &membership_filename ) {
+
+    StageTimer timer( "modularity" );
+    timer.add_file( edges_filename );
+
+    // Read in the membership
+    fprintf(stderr,"Reading in memberships...\n");
+
+    vector<V> membership( _num_verts );
+
+    vector<uint64_t> rows;
+    size_t num_rows;
+
+    TsvReader memb_fp( membership_filename, 2 );
+
+    while( ( num_rows = memb_fp.read_rows( rows ) ) > 0 ) {
+        for ( size_t r = 0; r < num_rows; ++r ) {
+            if ( rows[2*r] >= _num_verts ) {
+                fprintf( stderr, "Vertex out of range in %s: %zd\n",
+                                 membership_filename.c_str(), rows[2*r] );
+                abort();
+            }
+            membership[rows[2*r]] = rows[2*r+1];
+        }
+    }
+
+    // Load node degrees
+
+    fprintf(stderr,"Loading node derees...\n");
+
+    vector<V> degrees( _num_verts );
+
+    TsvReader deg_fp( dc_filename, 2 );
+
+    while( ( num_rows = deg_fp.read_rows( rows ) ) > 0 ) {
+        for ( size_t r = 0; r < num_rows; ++r ) {
+            if ( rows[2*r] >= _num_verts ) {
+                fprintf( stderr, "Vertex out of range in %s: %zd\n",
+                                 dc_filename.c_str(), rows[2*r] );
+                abort();
+            }
+            degrees[rows[2*r]] = rows[2*r+1];
+        }
+    }
 
     // Process the edges
 
     fprintf(stderr,"Processing edges ...\n");
 
 
-    FILE *edges_fp = fopen_csv( edges_filename, "r" );
+    BasicEdgeStream<V,W> edges( edges_filename );
+    edges.rewind();
 
-    size_t source;
-    size_t target;
-    size_t weight;
+    const BasicEdge<V,W> *batch;
+    size_t count;
     long Ql = 0;
-    unordered_map<size_t,long> c_degree;
+    unordered_map<V,long> c_degree;
     long total_weight = 0;
-    while( 1 ) {
+    while( ( batch = edges.next_batch( count ) ) != NULL ) {
+
+        timer.add_rows( count );
 
-        scan_pos_int( edges_fp, source );
-        scan_pos_int( edges_fp, target );
-        scan_pos_int( edges_fp, weight );
+        for ( size_t e = 0; e < count; ++e ) {
 
-        if ( weight == EOF ) break;
+            size_t source = batch[e].source;
+            size_t target = batch[e].target;
+            long weight = batch[e].weight;
 
 /*
-        if ( membership[source] == 78363 ||
-             membership[target] == 78363    ) continue;
+            if ( membership[source] == 78363 ||
+                 membership[target] == 78363    ) continue;
 */
 
-        Ql += ( membership[source] == membership[target] ? weight : 0 );
-        c_degree[membership[source]] += weight;
-        c_degree[membership[target]] += weight;
-        total_weight += weight;
+            Ql += ( membership[source] == membership[target] ? weight : 0 );
+            c_degree[membership[source]] += weight;
+            c_degree[membership[target]] += weight;
+            total_weight += weight;
+        }
 
     }
 
-    fclose( edges_fp );
-
     fprintf(stderr,"Processing degrees...\n");
     long Qd = 0;
-    for ( pair<size_t,long> dc : c_degree ) {
+    for ( const pair<const V,long> &dc : c_degree ) {
         Qd += dc.second*dc.second;
     }
 
@@ -412,86 +1551,106 @@ double Graph::modularity( const string &edges_filename,
 
 
 
-void Graph::convert_list_to_mat( const string &edge_filename,
-                                 const string &dc_filename,
-                                 const string &evc_filename,
-                                 const string &bucket_dir,
-                                 const string &mat_filename ) {
-
-
-    map_graph( edge_filename, dc_filename, evc_filename, bucket_dir );
-    reduce_graph( bucket_dir, evc_filename, mat_filename );
+/**
+ * Write the compressed adjacency file of the edges, by mapping them to
+ * buckets of rows and sorting each bucket in turn. With checkpoint_filename
+ * the end of the map and every bucket written are logged, so that a killed
+ * run carries on after the last bucket.
+ */
+template <typename V, typename W>
+void BasicGraph<V,W>::convert_list_to_mat( const string &edge_filename,
+                                           const string &dc_filename,
+                                           const string &evc_filename,
+                                           const string &bucket_dir,
+                                           const string &mat_filename,
+                                           const string &checkpoint_filename ) {
+
+    StageTimer timer( "convert_list_to_mat" );
+    timer.add_file( edge_filename );
+
+    Checkpoint checkpoint( checkpoint_filename,
+                           "convert_list_to_mat " +
+                           Checkpoint::fingerprint( { edge_filename,
+                                                      dc_filename,
+                                                      evc_filename } ) );
+
+    if ( checkpoint.records().empty() ) {
+        map_graph( edge_filename, dc_filename, evc_filename, bucket_dir,
+                   checkpoint );
+    }
+    reduce_graph( bucket_dir, evc_filename, mat_filename, checkpoint );
 
+    checkpoint.finish();
 }
 
 
-void Graph::map_graph( const string &edge_filename,
-                       const string &dc_filename,
-                       const string &evc_filename,
-                       const string &bucket_dir ) {
+template <typename V, typename W>
+void BasicGraph<V,W>::map_graph( const string &edge_filename,
+                                 const string &dc_filename,
+                                 const string &evc_filename,
+                                 const string &bucket_dir,
+                                 Checkpoint &checkpoint ) {
 
     size_t num_buckets = 251;
 
-    vector<size_t> vert_degree( _num_verts );
-    unordered_map<size_t,size_t> bucket_map;
+    vector<V> vert_degree( _num_verts );
+    vector<uint8_t> bucket_map( _num_verts, 0 );
 
     // Read in the node degrees
     fprintf(stderr,"Reading in node degrees...\n");
 
-    size_t vertex;
-    size_t degree;
+    vector<uint64_t> rows;
+    size_t num_rows;
 
-    FILE *dc_fp = fopen_csv( dc_filename, "r" );
+    TsvReader dc_fp( dc_filename, 2 );
 
     size_t num_edges = 0;
 
-    while( 1 ) {
-        scan_pos_int( dc_fp, vertex );
-        scan_pos_int( dc_fp, degree );
-
-        if ( degree == EOF ) break;
-
-        vert_degree[vertex] = degree;
+    while( ( num_rows = dc_fp.read_rows( rows ) ) > 0 ) {
+        for ( size_t r = 0; r < num_rows; ++r ) {
+            if ( rows[2*r] >= _num_verts ) {
+                fprintf( stderr, "Vertex out of range in %s: %zd\n",
+                                 dc_filename.c_str(), rows[2*r] );
+                abort();
+            }
+            vert_degree[rows[2*r]] = rows[2*r+1];
 
-        num_edges += degree;
+            num_edges += rows[2*r+1];
+        }
     }
 
-    fclose( dc_fp );
-
     // Read in the eigenvector centralities
     fprintf(stderr,"Reading in evc...\n");
 
-    FILE *evc_fp = fopen_csv( evc_filename, "r" );
-
-    size_t rank;
+    TsvReader evc_fp( evc_filename, 2 );
 
     size_t bucket_size = num_edges/num_buckets + (num_edges % num_buckets);
     size_t current_bucket = 0;
     size_t contents = 0;
 
-    while( 1 ) {
+    while( ( num_rows = evc_fp.read_rows( rows ) ) > 0 ) {
 
-        scan_pos_int( evc_fp, vertex );
-        scan_pos_int( evc_fp, rank );
+        for ( size_t r = 0; r < num_rows; ++r ) {
 
-        if ( rank == EOF ) break;
+            size_t vertex = rows[2*r];
 
-        bucket_map[vertex] = current_bucket;
+            if ( vertex >= _num_verts ) continue;
 
-        contents += vert_degree[vertex];
-        
-        if ( contents > bucket_size ) {
-            ++current_bucket;
-            contents = 0;
-            if ( current_bucket >= num_buckets ) {
-                fprintf( stderr, "not enough buckets!\n");
-                abort();
+            bucket_map[vertex] = current_bucket;
+
+            contents += vert_degree[vertex];
+
+            if ( contents > bucket_size ) {
+                ++current_bucket;
+                contents = 0;
+                if ( current_bucket >= num_buckets ) {
+                    fprintf( stderr, "not enough buckets!\n");
+                    abort();
+                }
             }
         }
     }
 
-    fclose( evc_fp );
-
     // Create the buckets
 
     fprintf(stderr,"Creating buckets...\n");
@@ -508,9 +1667,9 @@ void Graph::map_graph( const string &edge_filename,
         }
     }
 
-    vector<FILE*> buckets(num_buckets);
+    vector<unique_ptr<TsvWriter>> buckets(num_buckets);
     for ( size_t i = 0; i < num_buckets; ++i ) {
-        buckets[i] = fopen( bucket_filenames[i].c_str(), "w" );
+        buckets[i].reset( new TsvWriter( bucket_filenames[i], true, 1 << 16 ) );
     }
 
 
@@ -518,66 +1677,70 @@ void Graph::map_graph( const string &edge_filename,
 
     fprintf(stderr,"Processing edges...\n");
 
-    FILE *edge_fp = fopen_csv( edge_filename, "r" );
+    BasicEdgeStream<V,W> edges( edge_filename );
+    edges.rewind();
 
-    size_t nodeA, nodeB, weight;
+    const BasicEdge<V,W> *batch;
+    size_t count;
 
-    while( 1 ) {
+    while( ( batch = edges.next_batch( count ) ) != NULL ) {
 
-        scan_pos_int( edge_fp, nodeA );
-        scan_pos_int( edge_fp, nodeB );
-        scan_pos_int( edge_fp, weight );
+        for ( size_t e = 0; e < count; ++e ) {
 
-        if ( weight == EOF ) break;
+            V nodeA = batch[e].source;
+            V nodeB = batch[e].target;
+            W weight = batch[e].weight;
 
-        size_t bucketA = bucket_map[nodeA];
-        size_t bucketB = bucket_map[nodeB];
+            size_t bucketA = bucket_map[nodeA];
+            size_t bucketB = bucket_map[nodeB];
 
-        //fprintf(stderr,"%zd %zd %zd\n",bucketA,bucketB,buckets.size());
+            //fprintf(stderr,"%zd %zd %zd\n",bucketA,bucketB,buckets.size());
 
-        fprintf(buckets[bucketA],"%zd\t%zd\t%zd\n",nodeA,nodeB,weight);
-        fprintf(buckets[bucketB],"%zd\t%zd\t%zd\n",nodeB,nodeA,weight);
+            buckets[bucketA]->row( nodeA, nodeB, weight );
+            buckets[bucketB]->row( nodeB, nodeA, weight );
+        }
 
     }
 
-    fclose( edge_fp );
-
     fprintf(stderr,"Cleaning up ...\n");
     for ( size_t i = 0; i < num_buckets; ++i ) {
-        fclose( buckets[i] );
+        if ( checkpoint.enabled() ) buckets[i]->sync();
+        buckets[i]->close();
     }
 
+    checkpoint.record( "mapped" );
 }
  
-void Graph::reduce_graph( const string &bucket_dir,
-                          const string &evc_filename,
-                          const string &mat_filename ) {
+template <typename V, typename W>
+void BasicGraph<V,W>::reduce_graph( const string &bucket_dir,
+                                    const string &evc_filename,
+                                    const string &mat_filename,
+                                    Checkpoint &checkpoint ) {
 
     size_t num_buckets = 251;
 
-    unordered_map<size_t,size_t> rank_map;
+    vector<uint32_t> ranks( _num_verts, 0 );
 
 // Read in the eigenvector centralities
     fprintf(stderr,"Reading in evc...\n");
 
-    FILE *evc_fp = fopen_csv( evc_filename, "r" );
+    vector<uint64_t> rows;
+    size_t num_rows;
 
-    size_t vertex;
-    size_t rank;
+    TsvReader evc_fp( evc_filename, 2 );
 
-    while( 1 ) {
+    while( ( num_rows = evc_fp.read_rows( rows ) ) > 0 ) {
 
-        scan_pos_int( evc_fp, vertex );
-        scan_pos_int( evc_fp, rank );
+        for ( size_t r = 0; r < num_rows; ++r ) {
 
-        if ( rank == EOF ) break;
+            size_t vertex = rows[2*r];
+            size_t rank = rows[2*r+1];
 
-        rank_map[vertex] = rank;
+            if ( vertex < _num_verts ) ranks[vertex] = rank;
+        }
 
     }
 
-    fclose( evc_fp );
-
 
     fprintf(stderr,"Sorting buckets...\n");
 
@@ -593,55 +1756,451 @@ void Graph::reduce_graph( const string &bucket_dir,
         }
     }
 
+    // after "mapped", a record is the next bucket, the file position and
+    // the number of edges after it, and the rows of the bucket, each as
+    // vertex:position
+
+    size_t resume_at = 0;
+    unsigned long long pos = 0;
+    size_t num_edges = 0;
+    vector<pair<size_t,uint64_t>> resumed;
+
+    const vector<string> &records = checkpoint.records();
+    if ( records.size() > 1 ) {
+        const char *p = records.back().c_str();
+        if ( sscanf( p, "%zd %llu %zd", &resume_at, &pos, &num_edges ) != 3 ||
+                            !Checkpoint::cut_back( mat_filename, pos ) ) {
+            resume_at = 0;
+            num_edges = 0;
+        }
+    }
+
+    for ( size_t r = 1; resume_at > 0 && r < records.size(); ++r ) {
+        const char *p = records[r].c_str();
+        char *end;
+        for ( int field = 0; field < 3; ++field ) {
+            strtoull( p, &end, 10 );
+            p = end;
+        }
+        while ( *p == ' ' ) {
+            size_t vertex = strtoull( p, &end, 10 );
+            uint64_t offset = strtoull( end + 1, &end, 10 );
+            resumed.push_back( pair<size_t,uint64_t>( vertex, offset ) );
+            p = end;
+        }
+    }
+
     fprintf(stderr,"Processing edges...\n");
 
-    FILE *outfile = fopen_csv( mat_filename, "w" );
+    AdjWriter outfile( mat_filename, ranks, resume_at > 0 );
+    outfile.resume( resumed, num_edges );
+
+    // vertices without a rank come first
+    auto rank = [&ranks]( const uint64_t v ) -> uint64_t {
+        return ( v < ranks.size() ? ranks[v] : 0 );
+    };
 
-    MapCompare compare_rank( &rank_map );
+    vector<uint64_t> edges;
+    vector<uint64_t> keys;
+    vector<size_t> order;
+    vector<pair<V,W>> row;
 
-    for ( size_t b = 0; b < num_buckets; ++b ) {
+    string record;
+
+    for ( size_t b = resume_at; b < num_buckets; ++b ) {
 
         fprintf(stderr,"... %s\n", bucket_filenames[b].c_str() );
 
-        FILE *bucket = fopen_csv( bucket_filenames[b], "r", false );
+        TsvReader bucket( bucket_filenames[b], 3, false );
 
-        size_t nodeA, nodeB, weight;
+        edges.clear();
+        keys.clear();
 
-        map<size_t,vector<pair<size_t,size_t>>,MapCompare> 
-                                                    graph( compare_rank );
+        while( ( num_rows = bucket.read_rows( rows ) ) > 0 ) {
 
-        while( 1 ) {
+            for ( size_t r = 0; r < num_rows; ++r ) {
+                keys.push_back( rank( rows[3*r] ) << 32 |
+                                rank( rows[3*r+1] ) );
+            }
+            edges.insert( edges.end(), rows.begin(),
+                          rows.begin() + 3*num_rows );
 
-            scan_pos_int( bucket, nodeA );
-            scan_pos_int( bucket, nodeB );
-            scan_pos_int( bucket, weight );
+        }
 
-            if ( weight == EOF ) break;
+        // the edges by the rank of their source, then of their target
 
-            graph[nodeA].push_back( pair<size_t,size_t>(nodeB, weight) );
+        order.resize( keys.size() );
+        for ( size_t e = 0; e < order.size(); ++e ) order[e] = e;
 
-        }
+        radix_sort_pairs( keys, order );
 
-        fclose( bucket );
+        record.clear();
 
-        map<size_t,vector<pair<size_t,size_t>>,MapCompare>::iterator git;
-        for ( git = graph.begin(); git != graph.end(); ++git ) {
-            fwrite( &(git->first), sizeof(size_t), 1, outfile );
-            size_t nn = static_cast<size_t>( git->second.size() );
+        for ( size_t i = 0; i < order.size(); ) {
 
-            sort( git->second.begin(), git->second.end(), compare_rank );
+            V source = edges[3*order[i]];
+
+            row.clear();
+            for ( ; i < order.size() && edges[3*order[i]] == source; ++i ) {
+                row.push_back( pair<V,W>( edges[3*order[i]+1],
+                                          edges[3*order[i]+2] ) );
+            }
 
-            fwrite( &nn, sizeof(size_t), 1, outfile );
-            for ( pair<size_t,size_t> edge : git->second ) {
-                fwrite( &(edge.first), sizeof(size_t), 1, outfile );
-                fwrite( &(edge.second), sizeof(size_t), 1, outfile );
+            if ( checkpoint.enabled() ) {
+                record += " " + std::to_string( source ) + ":" +
+                          std::to_string( outfile.position() );
             }
+
+            outfile.write_row( source, row );
+
+            num_edges += row.size();
+        }
+
+        if ( checkpoint.enabled() && b + 1 < num_buckets ) {
+            outfile.sync();
+            checkpoint.record( std::to_string( b + 1 ) + " " +
+                               std::to_string( outfile.position() ) + " " +
+                               std::to_string( num_edges ) + record );
         }
 
     }
 
-    fclose( outfile );
+    outfile.close();
 
     
 }
 
+/**
+ * Degree estimates from an edge sample. Returns the estimated number of
+ * edges.
+ */
+template <typename V, typename W>
+Estimate BasicGraph<V,W>::sampled_degree_dist( const string &edge_filename,
+                                               const string &output_filename,
+                                               const EdgeSample &sample ) {
+
+    vector<SampledEdge<V>> kept;
+    load_sample<V,W>( edge_filename, sample, kept );
+
+    const size_t K = sample.num_groups();
+
+    vector<double> degree( _num_verts, 0.0 );
+    vector<double> group_edges( K, 0.0 );
+    double num_edges = 0.0;
+
+    for ( const SampledEdge<V> &edge : kept ) {
+        degree[edge.source] += edge.scale;
+        degree[edge.target] += edge.scale;
+        group_edges[edge.group] += edge.scale;
+        num_edges += edge.scale;
+    }
+
+    vector<double> replicates( K );
+    for ( size_t g = 0; g < K; ++g ) {
+        replicates[g] = ( num_edges - group_edges[g] )*K/( K - 1.0 );
+    }
+
+    Estimate estimate = jackknife( num_edges, replicates );
+
+    fprintf(stderr,"number of edges: %14.7e [%14.7e, %14.7e]\n",
+                    estimate.value, estimate.lower, estimate.upper );
+
+    TsvWriter output( output_filename );
+
+    output.put( "node\tdegree\n" );
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        output.row( v, static_cast<uint64_t>( llround( degree[v] ) ) );
+    }
+    output.close();
+
+    return estimate;
+}
+
+/**
+ * Eigenvector centrality of the sampled graph, with every edge weighted
+ * by the inverse of its inclusion probability so that the sampled
+ * adjacency matrix is an unbiased estimate of the full one.
+ *
+ * The leading eigenvalue of a sparse sample is inflated by its noise, and
+ * many power iterations converge to vectors localized on that noise. So
+ * the eigenvalue is cross-fitted: the vector iterated on all groups but g
+ * gives a Rayleigh quotient on the edges of group g alone, an unbiased
+ * estimate of a lower bound on the eigenvalue. The number of iterations
+ * is the one with the largest mean quotient over the groups, and the
+ * estimate that mean, relative to the Frobenius norm of the weights like
+ * eigen_vect_cent.
+ */
+template <typename V, typename W>
+Estimate BasicGraph<V,W>::sampled_eigen_vect_cent(
+                                        const string &edge_filename,
+                                        const string &output_filename,
+                                        const int num_it,
+                                        const double eps,
+                                        const EdgeSample &sample ) {
+
+    vector<SampledEdge<V>> kept;
+    load_sample<V,W>( edge_filename, sample, kept );
+
+    const size_t K = sample.num_groups();
+    const double group_scale = K/( K - 1.0 );
+
+    double wsq = 0.0;
+    for ( const SampledEdge<V> &edge : kept ) {
+        wsq += edge.weight*edge.weight*edge.scale;
+    }
+    double wnorm = ( wsq > 0.0 ? 1.0/sqrt( wsq ) : 0.0 );
+
+    vector<double> rold( _num_verts );
+    vector<double> rnew( _num_verts );
+
+    // quotients[it][g], the held out quotient of group g after it+1
+    // iterations
+    vector<vector<double>> quotients( num_it, vector<double>( K, 0.0 ) );
+
+    // iterate without group 'exclude', or on every group for exclude < 0
+    // and stop after num_iterations; leaves the unit vector in rold
+    auto power = [&]( const int exclude, const int num_iterations ) {
+
+        double dnorm = sqrt( 1.0/static_cast<double>(_num_verts) );
+        std::fill( rold.begin(), rold.end(), dnorm );
+
+        double norm_last = 1.0;
+
+        for ( int it = 0; it < num_iterations; ++it ) {
+
+            std::fill( rnew.begin(), rnew.end(), 0.0 );
+
+            for ( const SampledEdge<V> &edge : kept ) {
+                double w = edge.weight*replicate_scale( edge, exclude,
+                                                        group_scale );
+                rnew[edge.source] += w*rold[edge.target];
+                rnew[edge.target] += w*rold[edge.source];
+            }
+
+            double norm_sq = 0.0;
+            for ( size_t i = 0; i < _num_verts; ++i ) {
+                norm_sq += rnew[i]*rnew[i];
+            }
+            double norm = sqrt( norm_sq );
+            if ( norm == 0.0 ) return;
+
+            for ( size_t i = 0; i < _num_verts; ++i ) rnew[i] /= norm;
+
+            rold.swap( rnew );
+
+            if ( exclude >= 0 ) {
+                double q = 0.0;
+                for ( const SampledEdge<V> &edge : kept ) {
+                    if ( edge.group != exclude ) continue;
+                    q += edge.weight*edge.scale*
+                                    rold[edge.source]*rold[edge.target];
+                }
+                quotients[it][exclude] = 2.0*K*q*wnorm;
+            }
+
+            double delta = fabs( norm - norm_last )/norm_last;
+            norm_last = norm;
+            if ( delta < eps ) {
+                for ( int rest = it + 1; rest < num_iterations; ++rest ) {
+                    if ( exclude >= 0 ) {
+                        quotients[rest][exclude] = quotients[it][exclude];
+                    }
+                }
+                break;
+            }
+        }
+    };
+
+    for ( size_t g = 0; g < K; ++g ) power( g, num_it );
+
+    int best = 0;
+    double best_mean = -1.0;
+    for ( int it = 0; it < num_it; ++it ) {
+        double mean = 0.0;
+        for ( double q : quotients[it] ) mean += q;
+        mean /= K;
+        if ( mean > best_mean ) {
+            best_mean = mean;
+            best = it;
+        }
+    }
+
+    double var = 0.0;
+    for ( double q : quotients[best] ) {
+        var += ( q - best_mean )*( q - best_mean );
+    }
+    double half = 1.96*sqrt( var/( K - 1.0 )/K );
+
+    Estimate estimate;
+    estimate.value = best_mean;
+    estimate.lower = best_mean - half;
+    estimate.upper = best_mean + half;
+
+    fprintf(stderr,"num iterations: %d\n", best + 1 );
+    fprintf(stderr,"eigenvalue: %14.7e [%14.7e, %14.7e]\n",
+                    estimate.value, estimate.lower, estimate.upper );
+
+    power( -1, best + 1 );
+
+    vector<size_t> ranks = sort_indexes( rold.data(), _num_verts );
+
+    TsvWriter output( output_filename );
+
+    output.put( "node\trank\n" );
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        output.row( ranks[v], (v+1) );
+    }
+    output.close();
+
+    return estimate;
+}
+
+/**
+ * Connected components of the sampled graph. Returns the estimated share
+ * of the vertices in the largest component. A sample drops edges, so this
+ * is biased low; the interval only reflects the sampling variance.
+ */
+template <typename V, typename W>
+Estimate BasicGraph<V,W>::sampled_cluster_stats(
+                                        const string &edge_filename,
+                                        const string &output_filename,
+                                        const EdgeSample &sample ) {
+
+    vector<SampledEdge<V>> kept;
+    load_sample<V,W>( edge_filename, sample, kept );
+
+    const size_t K = sample.num_groups();
+
+    vector<V> parent( _num_verts );
+    vector<V> size( _num_verts );
+
+    auto components = [&]( const int exclude ) {
+
+        for ( size_t v = 0; v < _num_verts; ++v ) {
+            parent[v] = v;
+            size[v] = 1;
+        }
+
+        for ( const SampledEdge<V> &edge : kept ) {
+            if ( edge.group == exclude ) continue;
+            V a = find_root( parent, edge.source );
+            V b = find_root( parent, edge.target );
+            if ( a == b ) continue;
+            if ( size[a] < size[b] ) std::swap( a, b );
+            parent[b] = a;
+            size[a] += size[b];
+        }
+
+        size_t largest = 0;
+        for ( size_t v = 0; v < _num_verts; ++v ) {
+            if ( parent[v] == v && size[v] > largest ) largest = size[v];
+        }
+
+        return static_cast<double>( largest )/
+                                        static_cast<double>( _num_verts );
+    };
+
+    vector<double> replicates( K );
+    for ( size_t g = 0; g < K; ++g ) replicates[g] = components( g );
+
+    Estimate estimate = jackknife( components( -1 ), replicates );
+
+    fprintf(stderr,"largest cluster share: %14.7e [%14.7e, %14.7e]\n",
+                    estimate.value, estimate.lower, estimate.upper );
+
+    fprintf(stderr,"Saving memberships ...\n");
+
+    vector<V> cluster_id( _num_verts, 0 );
+    V num_clusters = 0;
+
+    TsvWriter out_fp( output_filename );
+
+    out_fp.put( "node\tmembership\n" );
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        V root = find_root( parent, static_cast<V>( v ) );
+        if ( size[root] < 2 ) continue;
+        if ( cluster_id[root] == 0 ) cluster_id[root] = ++num_clusters;
+        out_fp.row( v, cluster_id[root] );
+    }
+    out_fp.close();
+
+    return estimate;
+}
+
+/**
+ * Modularity of a membership from an edge sample: the within cluster and
+ * cluster degree sums are estimated from the inverse probability weighted
+ * edges.
+ */
+template <typename V, typename W>
+Estimate BasicGraph<V,W>::sampled_modularity(
+                                        const string &edge_filename,
+                                        const string &membership_filename,
+                                        const EdgeSample &sample ) {
+
+    vector<V> membership( _num_verts );
+
+    vector<uint64_t> rows;
+    size_t num_rows;
+
+    TsvReader memb_fp( membership_filename, 2 );
+
+    while( ( num_rows = memb_fp.read_rows( rows ) ) > 0 ) {
+        for ( size_t r = 0; r < num_rows; ++r ) {
+            if ( rows[2*r] >= _num_verts ) {
+                fprintf( stderr, "Vertex out of range in %s: %zd\n",
+                                 membership_filename.c_str(), rows[2*r] );
+                abort();
+            }
+            membership[rows[2*r]] = rows[2*r+1];
+        }
+    }
+
+    vector<SampledEdge<V>> kept;
+    load_sample<V,W>( edge_filename, sample, kept );
+
+    const size_t K = sample.num_groups();
+    const double group_scale = K/( K - 1.0 );
+
+    auto modularity = [&]( const int exclude ) {
+
+        double Ql = 0.0;
+        double total_weight = 0.0;
+        unordered_map<V,double> c_degree;
+
+        for ( const SampledEdge<V> &edge : kept ) {
+            double w = edge.weight*replicate_scale( edge, exclude,
+                                                    group_scale );
+            V cs = membership[edge.source];
+            V ct = membership[edge.target];
+            if ( cs == ct ) Ql += w;
+            c_degree[cs] += w;
+            c_degree[ct] += w;
+            total_weight += w;
+        }
+
+        double Qd = 0.0;
+        for ( const pair<const V,double> &dc : c_degree ) {
+            Qd += dc.second*dc.second;
+        }
+
+        if ( total_weight == 0.0 ) return 0.0;
+
+        double inv_norm = 1.0/total_weight;
+
+        return Ql*inv_norm - Qd*inv_norm*inv_norm*0.25;
+    };
+
+    vector<double> replicates( K );
+    for ( size_t g = 0; g < K; ++g ) replicates[g] = modularity( g );
+
+    Estimate estimate = jackknife( modularity( -1 ), replicates );
+
+    fprintf(stderr,"modularity: %14.7e [%14.7e, %14.7e]\n",
+                    estimate.value, estimate.lower, estimate.upper );
+
+    return estimate;
+}
+
+template class BasicGraph<uint32_t,uint32_t>;
+template class BasicGraph<uint64_t,uint64_t>;
@@ -3,28 +3,74 @@
 
 #include <string>
 
-class Graph {
+#include "checkpoint.h"
+#include "sample.h"
+#include "types.h"
+
+/**
+ * Out-of-core analytics on a weighted edge file. V is the integer type of
+ * the vertex ids and W that of the edge weights.
+ */
+template <typename V, typename W>
+class BasicGraph {
 
  private:
     size_t _num_verts;
     size_t _num_edges;
 
  public:
-    Graph( const size_t num_verts){
+    typedef V vertex_type;
+    typedef W weight_type;
+
+    BasicGraph( const size_t num_verts){
        _num_verts = num_verts; 
     };
 
     void degree_dist( const std::string &edge_filename, 
                       const std::string &output_filename );
 
+    size_t disparity_filter( const std::string &edge_filename,
+                             const std::string &output_filename,
+                             const std::string &report_filename,
+                             const double alpha );
+
     void eigen_vect_cent( const std::string &edge_filename, 
                           const std::string &output_filename,
                           const int num_it,
-                          const double eps );
+                          const double eps,
+                          const std::string &scores_filename = "",
+                          const std::string &start_filename = "",
+                          const std::string &checkpoint_filename = "" );
+
+    void centrality_sweep( const std::string &edge_filename,
+                           const std::string &output_filename,
+                           const int num_it,
+                           const double eps,
+                           const double katz_alpha = 0.5,
+                           const double damping = 0.85 );
 
     void cluster_stats( const std::string &edge_filename, 
                         const std::string &output_filename );
 
+    double triangle_stats( const std::string &edge_filename,
+                           const std::string &output_filename );
+
+    double distance_stats( const std::string &edge_filename,
+                           const std::string &membership_filename,
+                           const std::string &distances_filename,
+                           const std::string &closeness_filename,
+                           const size_t num_sources,
+                           const uint64_t seed = 1 );
+
+    size_t core_decomposition( const std::string &edge_filename,
+                               const std::string &output_filename );
+
+    size_t core_subgraph( const std::string &edge_filename,
+                          const std::string &core_filename,
+                          const size_t k,
+                          const std::string &subgraph_filename,
+                          const std::string &map_filename );
+
     double modularity( const std::string &edge_filename,
                        const std::string &dc_filename,
                        const std::string &membership_filename );
@@ -33,20 +79,43 @@ class Graph {
                               const std::string &dc_filename,
                               const std::string &evc_filename,
                               const std::string &bucket_dir,
-                              const std::string &mat_filename );
+                              const std::string &mat_filename,
+                              const std::string &checkpoint_filename = "" );
+
+    Estimate sampled_degree_dist( const std::string &edge_filename,
+                                  const std::string &output_filename,
+                                  const EdgeSample &sample );
+
+    Estimate sampled_eigen_vect_cent( const std::string &edge_filename,
+                                      const std::string &output_filename,
+                                      const int num_it,
+                                      const double eps,
+                                      const EdgeSample &sample );
+
+    Estimate sampled_cluster_stats( const std::string &edge_filename,
+                                    const std::string &output_filename,
+                                    const EdgeSample &sample );
+
+    Estimate sampled_modularity( const std::string &edge_filename,
+                                 const std::string &membership_filename,
+                                 const EdgeSample &sample );
 
  private:
 
     void map_graph( const std::string &edge_filename,
                     const std::string &dc_filename,
                     const std::string &evc_filename,
-                    const std::string &bucket_dir );
+                    const std::string &bucket_dir,
+                    Checkpoint &checkpoint );
  
     void reduce_graph( const std::string &bucket_dir,
                        const std::string &evc_filename,
-                       const std::string &mat_filename );
+                       const std::string &mat_filename,
+                       Checkpoint &checkpoint );
  
 
 };
 
+typedef BasicGraph<vertex_t,weight_t> Graph;
+
 #endif // GRAPH_H
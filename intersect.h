@@ -0,0 +1,99 @@
+#ifndef INTERSECT_H
+#define INTERSECT_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Intersect two sorted lists of distinct vertex IDs, calling 'visit' on
+ * every common element. Blocks of both lists are compared all-against-all
+ * with SIMD compares: eight at a time with AVX2, four with SSE2. The tails
+ * are merged with scalar code, which is also used when neither instruction
+ * set is enabled at compile time.
+ */
+template <typename F>
+inline void intersect_sorted( const uint32_t *a, const size_t na,
+                              const uint32_t *b, const size_t nb,
+                              F visit ) {
+
+    size_t i = 0;
+    size_t j = 0;
+
+#if defined(__AVX2__)
+
+    const __m256i rot1 = _mm256_setr_epi32( 1, 2, 3, 4, 5, 6, 7, 0 );
+
+    while ( i + 8 <= na && j + 8 <= nb ) {
+
+        __m256i va = _mm256_loadu_si256(
+                            reinterpret_cast<const __m256i*>( a + i ) );
+        __m256i vb = _mm256_loadu_si256(
+                            reinterpret_cast<const __m256i*>( b + j ) );
+
+        __m256i cmp = _mm256_cmpeq_epi32( va, vb );
+        for ( int r = 1; r < 8; ++r ) {
+            vb = _mm256_permutevar8x32_epi32( vb, rot1 );
+            cmp = _mm256_or_si256( cmp, _mm256_cmpeq_epi32( va, vb ) );
+        }
+
+        unsigned mask = _mm256_movemask_ps( _mm256_castsi256_ps( cmp ) );
+        while ( mask ) {
+            visit( a[i + __builtin_ctz( mask )] );
+            mask &= mask - 1;
+        }
+
+        uint32_t a_max = a[i+7];
+        uint32_t b_max = b[j+7];
+        if ( a_max <= b_max ) i += 8;
+        if ( b_max <= a_max ) j += 8;
+    }
+
+#elif defined(__SSE2__)
+
+    while ( i + 4 <= na && j + 4 <= nb ) {
+
+        __m128i va = _mm_loadu_si128(
+                            reinterpret_cast<const __m128i*>( a + i ) );
+        __m128i vb = _mm_loadu_si128(
+                            reinterpret_cast<const __m128i*>( b + j ) );
+
+        __m128i cmp = _mm_cmpeq_epi32( va, vb );
+        vb = _mm_shuffle_epi32( vb, _MM_SHUFFLE( 0, 3, 2, 1 ) );
+        cmp = _mm_or_si128( cmp, _mm_cmpeq_epi32( va, vb ) );
+        vb = _mm_shuffle_epi32( vb, _MM_SHUFFLE( 0, 3, 2, 1 ) );
+        cmp = _mm_or_si128( cmp, _mm_cmpeq_epi32( va, vb ) );
+        vb = _mm_shuffle_epi32( vb, _MM_SHUFFLE( 0, 3, 2, 1 ) );
+        cmp = _mm_or_si128( cmp, _mm_cmpeq_epi32( va, vb ) );
+
+        unsigned mask = _mm_movemask_ps( _mm_castsi128_ps( cmp ) );
+        while ( mask ) {
+            visit( a[i + __builtin_ctz( mask )] );
+            mask &= mask - 1;
+        }
+
+        uint32_t a_max = a[i+3];
+        uint32_t b_max = b[j+3];
+        if ( a_max <= b_max ) i += 4;
+        if ( b_max <= a_max ) j += 4;
+    }
+
+#endif
+
+    while ( i < na && j < nb ) {
+        if ( a[i] < b[j] ) {
+            ++i;
+        } else if ( b[j] < a[i] ) {
+            ++j;
+        } else {
+            visit( a[i] );
+            ++i;
+            ++j;
+        }
+    }
+}
+
+#endif // INTERSECT_H
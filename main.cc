@@ -1,81 +1,676 @@
-
+#include <algorithm>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
+
+#include <sys/stat.h>
 
+#include "bipartite.h"
+#include "connectivity.h"
+#include "csr.h"
+#include "misc.h"
 #include "reviews.h"
 #include "graph.h"
+#include "minhash.h"
+#include "pipeline.h"
+#include "sample.h"
+#include "server.h"
+#include "sharded_graph.h"
+#include "stats.h"
+#include "thread_pool.h"
 
+using std::map;
 using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+/**
+ * The number of vertices: the rows of the reviewer index, less the header.
+ */
+size_t count_vertices( const string &index_filename ) {
+
+    FILE *fp = fopen_csv( index_filename, "r" );
+
+    char *line = NULL;
+    size_t len = 0;
+    size_t num_rows = 0;
+
+    while ( getline( &line, &len, fp ) != -1 ) ++num_rows;
+
+    free( line );
+    fclose( fp );
+
+    return num_rows;
+}
+
+/**
+ * The number of reviews of every reviewer, the last column of the reviewer
+ * index. A cheap proxy for the degrees, known before the projection.
+ */
+vector<double> reviewer_activity( const string &index_filename ) {
+
+    FILE *fp = fopen_csv( index_filename, "r" );
+
+    char *line = NULL;
+    size_t len = 0;
+    vector<double> activity;
+
+    while ( getline( &line, &len, fp ) != -1 ) {
+        char *last = strrchr( line, '\t' );
+        activity.push_back( last ? strtod( last + 1, NULL ) : 1.0 );
+    }
+
+    free( line );
+    fclose( fp );
+
+    return activity;
+}
+
+/**
+ * The time windows of the temporal projection: the explicit list
+ * "windows=b:e,b:e,...", or else sliding windows of window_length every
+ * window_step from the first review, or else time_windows equal windows
+ * covering all reviews.
+ */
+vector<TimeWindow> time_windows( map<string,string> &params,
+                                 const long first, const long last ) {
+
+    vector<TimeWindow> windows;
+
+    if ( !params["windows"].empty() ) {
+        const char *p = params["windows"].c_str();
+        while ( *p ) {
+            char *end;
+            TimeWindow window;
+            window.begin = strtol( p, &end, 10 );
+            if ( *end != ':' ) break;
+            window.end = strtol( end + 1, &end, 10 );
+            windows.push_back( window );
+            p = ( *end == ',' ? end + 1 : end );
+            if ( *end != ',' && *end != '\0' ) break;
+        }
+        if ( *p ) {
+            fprintf( stderr, "Bad time windows: %s\n",
+                                                params["windows"].c_str() );
+            exit(1);
+        }
+        return windows;
+    }
+
+    long length = atol( params["window_length"].c_str() );
+
+    if ( length > 0 ) {
+        long step = atol( params["window_step"].c_str() );
+        if ( step <= 0 ) step = length;
+        for ( long begin = first; begin <= last; begin += step ) {
+            windows.push_back( { begin, begin + length } );
+        }
+        return windows;
+    }
+
+    long num = std::max( 1l, atol( params["time_windows"].c_str() ) );
+    long span = ( last - first )/num + 1;
+    for ( long w = 0; w < num; ++w ) {
+        windows.push_back( { first + w*span, first + ( w + 1 )*span } );
+    }
+    return windows;
+}
+
+}
 
 int main( int argc, char* argv[] ) {
 
     if ( argc < 2 ) {
-        fprintf( stderr, "Usage: %s <metadata filename>\n", argv[0] );
+        fprintf( stderr, "Usage: %s <metadata filename> "
+                         "[--force] [key=value ...] [stage ...]\n"
+                         "       sample=<edge rate> sample_mode=uniform|degree"
+                         " products=<product rate>\n"
+                         "       estimate degree, evc, components and"
+                         " modularity from a sample, in Data/sample/\n"
+                         "       core_k=<k> the k-core written by kcore\n"
+                         "       bfs_sources=<n> BFS samples for distances\n"
+                         "       evc_warm=1 start centrality from the saved"
+                         " scores\n"
+                         "       katz_alpha=<a> damping=<d> centrality_eps=<e>"
+                         " centrality_iterations=<n>\n"
+                         "       eigenvector, Katz and PageRank in one sweep,"
+                         " and by coreview without the projection\n"
+                         "       time_windows=<n> window_length=<s>"
+                         " window_step=<s> windows=<b:e,...> max_dt=<s>\n"
+                         "       the windows of the temporal projection\n"
+                         "       threads=<n> pin=0|1 worker threads, 0 for"
+                         " one per core\n"
+                         "       checkpoint=0|1 let the long stages resume"
+                         " where a killed run stopped\n"
+                         "       reduce_memory=<MB> bound on the edge counts"
+                         " held by reduce and temporal\n"
+                         "       backbone=<alpha> analyse only the edges"
+                         " significant at alpha by the disparity filter\n"
+                         "       shards=<n> transport=shm|socket degree,"
+                         " evc and components in n worker processes\n"
+                         "       %s <metadata filename> serve <socket>\n"
+                         "       %s <metadata filename> connect <edge file>\n"
+                         "       add new edges to the components, and write"
+                         " their membership\n",
+                         argv[0], argv[0], argv[0] );
         exit(1);
     }
 
+    string metadata_file = argv[1];
+
+    bool serve_mode = ( argc > 3 && string( argv[2] ) == "serve" );
+    bool connect_mode = ( argc > 3 && string( argv[2] ) == "connect" );
+
+    // stage names, parameters and flags
+
+    map<string,string> params;
+    params["evc_iterations"] = "20";
+    params["evc_eps"] = "1.0e-10";
+    params["evc_warm"] = "0";
+    params["katz_alpha"] = "0.5";
+    params["damping"] = "0.85";
+    params["centrality_eps"] = "1.0e-9";
+    params["centrality_iterations"] = "100";
+    params["jaccard"] = "0.5";
+    params["sample"] = "1";
+    params["sample_mode"] = "uniform";
+    params["products"] = "1";
+    params["core_k"] = "2";
+    params["bfs_sources"] = "64";
+    params["threads"] = "0";
+    params["time_windows"] = "4";
+    params["window_length"] = "0";
+    params["window_step"] = "0";
+    params["windows"] = "";
+    params["max_dt"] = "0";
+    params["pin"] = "0";
+    params["checkpoint"] = "1";
+    params["reduce_memory"] = "1024";
+    params["backbone"] = "0";
+    params["shards"] = "0";
+    params["transport"] = "shm";
+
+    vector<string> targets;
+    bool force = false;
+
+    for ( int a = 2; a < argc && !serve_mode && !connect_mode; ++a ) {
+        string arg = argv[a];
+        size_t eq = arg.find( '=' );
+        if ( arg == "--force" ) {
+            force = true;
+        } else if ( eq != string::npos ) {
+            string key = arg.substr( 0, eq );
+            if ( !params.count( key ) ) {
+                fprintf( stderr, "Unknown parameter: %s\n", key.c_str() );
+                exit(1);
+            }
+            params[key] = arg.substr( eq + 1 );
+        } else {
+            targets.push_back( arg );
+        }
+    }
+
+    // the approximate mode: a sample of the products is projected and/or
+    // the estimating stages run on a sample of the edges. They read the
+    // exact upstream files, and only what the sample changes, with its
+    // stamps, goes to Data/sample/, so that the stages and the server
+    // reading the exact results never see the estimates
+
+    double edge_rate = atof( params["sample"].c_str() );
+    double product_rate = atof( params["products"].c_str() );
+    bool approximate = ( edge_rate < 1.0 || product_rate < 1.0 );
+
     string output_dir = "Data/";
+    string sample_dir = "Data/sample/";
+    string projection_dir = ( product_rate < 1.0 ? sample_dir : output_dir );
+    string estimate_dir = ( approximate ? sample_dir : output_dir );
+
     string reviewer_index_filename = output_dir + "index_reviewers.csv";
-    string edges_dir = output_dir + "tmp3";
-    string edges_file = output_dir + "ar_edges.csv";
-    string degree_dist_file = output_dir + "ar_degree_dist.csv";
-    string evc_file = output_dir + "ar_evc.csv";
+    string edges_dir = projection_dir + "tmp3";
+    string edges_file = projection_dir + "ar_edges.csv";
+    string backbone_file = projection_dir + "ar_backbone.csv";
+    string backbone_report_file = projection_dir + "ar_backbone_report.tsv";
+    string degree_dist_file = estimate_dir + "ar_degree_dist.csv";
+    string evc_file = estimate_dir + "ar_evc.csv";
+    string evc_scores_file = output_dir + "ar_evc_scores.bin";
+    string centrality_file = output_dir + "ar_centrality.csv";
+    string coreview_file = output_dir + "ar_coreview.csv";
     string tmp_buckets = output_dir + "tmp4";
     string mat_file = output_dir + "ar_mat.bin";
-    string cluster_mem_file = output_dir + "ar_cluster_mem.csv";
+    string cluster_mem_file = estimate_dir + "ar_cluster_mem.csv";
+    string modularity_file = estimate_dir + "ar_modularity.txt";
+    string triangles_file = output_dir + "ar_triangles.csv";
+    string similar_file = output_dir + "ar_similar.csv";
+    string temporal_dir = output_dir + "tmp5";
+    string shard_dir = output_dir + "tmp6";
+    string temporal_file = output_dir + "ar_temporal_edges.csv";
+    string distances_file = output_dir + "ar_distances.csv";
+    string closeness_file = output_dir + "ar_closeness.csv";
+    string cores_file = output_dir + "ar_cores.csv";
+    string kcore_edges_file = output_dir + "ar_kcore_edges.csv";
+    string kcore_map_file = output_dir + "ar_kcore_map.csv";
+    string components_file = output_dir + "ar_components.bin";
+    string components_mem_file = output_dir + "ar_components_mem.csv";
+    string cluster_stats_file = output_dir + "ar_cluster_stats.tsv";
+    string stats_file = estimate_dir + "ar_stats.json";
+    string degree_est_file = estimate_dir + "ar_degree_est.tsv";
+    string evc_est_file = estimate_dir + "ar_evc_est.tsv";
+    string cluster_est_file = estimate_dir + "ar_cluster_est.tsv";
+    string modularity_est_file = estimate_dir + "ar_modularity_est.tsv";
+
+    string stamp_dir = output_dir + ".stamps";
+    string projection_stamps = projection_dir + ".stamps";
+    string estimate_stamps = estimate_dir + ".stamps";
+
+    // the rest of the analytics has no estimate, so an approximate run
+    // brings only the estimating stages up to date
+    const vector<string> estimators = { "degree", "evc", "components",
+                                        "modularity" };
+
+    if ( serve_mode ) {
 
-/*
-    fprintf( stderr, "Loading the reviews...\n" );
+        fprintf( stderr, "Loading the reviews...\n" );
 
-    Reviews reviews( argv[1] );
+        Reviews reviews( metadata_file, TITLE_COLUMN );
+        reviews.condense_links();
 
-    fprintf( stderr, "Number of reviewers: %zd\n", reviews.num_reviewers() );
+        fprintf( stderr, "Loading the graph...\n" );
 
-    fprintf( stderr, "Condensing...\n" );
+        CSR graph( reviews.num_reviewers() );
+        graph.load( edges_file );
 
-    long num_droped = reviews.condense_links();
+        QueryServer server( reviews, graph, cluster_mem_file, evc_file );
+        server.serve( argv[3] );
 
-    fprintf( stderr, "Number Condensed: %ld\n",num_droped);
+        return 0;
+    }
+
+    if ( connect_mode ) {
 
-    fprintf( stderr, "Reviewer stats...\n" );
+        mkdir( output_dir.c_str(), 0755 );
 
-    reviews.reviews_per_reviewer();
+        Connectivity components( components_file );
 
-    fprintf( stderr, "Outputing reviewer index...\n" );
+        size_t num_edges = components.add_edges( argv[3] );
 
-    reviews.output_reviewer_index( reviewer_index_filename );
+        fprintf( stderr, "Number of new edges: %zd\n", num_edges );
+        fprintf( stderr, "number of clusters: %zd\n",
+                                            components.num_clusters() );
+        fprintf( stderr, "max cluster size: %zd\n",
+                                            components.max_cluster() );
+        fprintf( stderr, "fragmentation: %14.7e\n",
+                                            components.fragmentation() );
 
-    fprintf( stderr, "Mapping edges ...\n" );
+        components.write_membership( components_mem_file );
+        components.write_stats( cluster_stats_file );
+
+        return 0;
+    }
 
-    reviews.map_edges( edges_dir );
+    ThreadPool::configure( atoi( params["threads"].c_str() ),
+                           params["pin"] == "1" );
 
-    fprintf( stderr, "Number of reviews: %zd\n",reviews.num_reviews() );
-    fprintf( stderr, "Number of reviewers: %zd\n",reviews.num_reviewers() );
-    fprintf( stderr, "Number of products: %zd\n",reviews.num_products() );
-    fprintf( stderr, "Number of titles: %zd\n",reviews.num_titles() );
+    mkdir( "Data", 0755 );
+    mkdir( output_dir.c_str(), 0755 );
+    if ( approximate ) mkdir( sample_dir.c_str(), 0755 );
+    mkdir( edges_dir.c_str(), 0755 );
+    mkdir( tmp_buckets.c_str(), 0755 );
+    mkdir( temporal_dir.c_str(), 0755 );
+
+    unique_ptr<Reviews> reviews;
+
+    size_t num_verts = 0;
+    std::once_flag count_once;
+    auto vertices = [&]() {
+        std::call_once( count_once, [&]() {
+            num_verts = count_vertices( reviewer_index_filename );
+        });
+        return num_verts;
+    };
+    auto graph = [&]() {
+        return Graph( vertices() );
+    };
+
+    string sample_params;
+    if ( approximate ) {
+        sample_params = "sample=" + params["sample"] +
+                        " sample_mode=" + params["sample_mode"] +
+                        " products=" + params["products"];
+    }
+
+    EdgeSample sample( edge_rate, sample_mode( params["sample_mode"] ) );
+    sample.set_product_rate( product_rate );
+
+    std::once_flag sample_once;
+    auto edge_sample = [&]() -> const EdgeSample& {
+        std::call_once( sample_once, [&]() {
+            if ( params["sample_mode"] == "degree" ) {
+                sample.set_sizes(
+                            reviewer_activity( reviewer_index_filename ) );
+            }
+        });
+        return sample;
+    };
+
+    // the backbone mode: the analytics after the projection read only the
+    // edges kept by the disparity filter
+
+    bool backbone = ( atof( params["backbone"].c_str() ) > 0.0 );
+
+    string graph_edges_file = edges_file;
+    string edge_stage = "reduce";
+    string edge_params;
+    if ( backbone ) {
+        graph_edges_file = backbone_file;
+        edge_stage = "backbone";
+        edge_params = " backbone=" + params["backbone"];
+    }
+
+    vector<string> edge_deps = { edge_stage, "index" };
+
+    // the partitioned mode: degree, evc and components run in worker
+    // processes over the shards of the edges, with the same results
+
+    size_t num_shards = atol( params["shards"].c_str() );
+    bool sharded = ( num_shards > 0 && !approximate );
+
+    vector<string> graph_deps = edge_deps;
+    string shard_params;
+    if ( sharded ) {
+        graph_deps.push_back( "partition" );
+        shard_params = " shards=" + params["shards"];
+    }
 
-    fprintf( stderr, "Reducing edges ...\n" );
-    Reviews::reduce_edges( edges_dir, edges_file );
+    auto sharded_graph = [&]() {
+        return ShardedGraph( vertices(), shard_dir, params["transport"] );
+    };
 
-    fprintf( stderr, "Degree distribution ...\n" );
+    Pipeline pipeline( stamp_dir );
+
+    // the progress logs of the long stages sit with the stamps
+    auto checkpoint_file = [&]( const string &stage,
+                                const string &dir ) -> string {
+        if ( params["checkpoint"] != "1" ) return "";
+        return dir + "/" + stage + ".checkpoint";
+    };
+
+    pipeline.add( { "load", {}, { metadata_file }, {}, "", [&]() {
+
+        // only the columns the stages of this run read
+        unsigned columns = TITLE_COLUMN;
+        if ( pipeline.scheduled( "index" ) ) columns |= SCREEN_NAME_COLUMN;
+        if ( pipeline.scheduled( "temporal" ) ) columns |= METADATA_COLUMNS;
+
+        reviews.reset( new Reviews( metadata_file, columns ) );
+
+        fprintf( stderr, "Number of reviewers: %zd\n",
+                                                reviews->num_reviewers() );
+    }});
+
+    pipeline.add( { "condense", { "load" }, {}, {}, "", [&]() {
+
+        long num_droped = reviews->condense_links();
+
+        fprintf( stderr, "Number Condensed: %ld\n",num_droped);
+
+        reviews->reviews_per_reviewer();
+
+        fprintf( stderr, "Number of reviews: %zd\n",reviews->num_reviews() );
+        fprintf( stderr, "Number of products: %zd\n",reviews->num_products() );
+        fprintf( stderr, "Number of titles: %zd\n",reviews->num_titles() );
+    }});
+
+    pipeline.add( { "index", { "condense" }, {},
+                    { reviewer_index_filename }, "", [&]() {
+
+        reviews->output_reviewer_index( reviewer_index_filename );
+    }});
+
+    pipeline.add( { "project", { "condense" }, {}, { edges_dir },
+                    params["products"], [&]() {
+
+        reviews->map_edges( edges_dir, product_rate, 1,
+                            checkpoint_file( "project", projection_stamps ) );
+    }}, projection_stamps );
+
+    pipeline.add( { "reduce", { "project" }, {}, { edges_file }, "", [&]() {
+
+        Reviews::reduce_edges( edges_dir, edges_file,
+                               checkpoint_file( "reduce", projection_stamps ),
+                               atol( params["reduce_memory"].c_str() ) << 20 );
+    }}, projection_stamps );
+
+    if ( backbone ) {
+        pipeline.add( { "backbone", { "reduce", "index" }, {},
+                        { backbone_file, backbone_report_file },
+                        params["backbone"], [&]() {
+
+            graph().disparity_filter( edges_file, backbone_file,
+                                      backbone_report_file,
+                                      atof( params["backbone"].c_str() ) );
+        }}, projection_stamps );
+    }
+
+    pipeline.add( { "temporal", { "condense" }, {}, { temporal_file },
+                    params["time_windows"] + " " + params["window_length"] +
+                    " " + params["window_step"] + " " + params["windows"] +
+                    " " + params["max_dt"], [&]() {
+
+        long first, last;
+        reviews->time_range( first, last );
+
+        vector<TimeWindow> windows = time_windows( params, first, last );
+
+        fprintf( stderr, "Number of time windows: %zd\n", windows.size() );
+
+        reviews->map_temporal_edges( temporal_dir, windows,
+                                     atol( params["max_dt"].c_str() ) );
+        Reviews::reduce_temporal_edges( temporal_dir, temporal_file,
+                                        windows.size(),
+                                        atol( params["reduce_memory"].c_str() )
+                                                                    << 20 );
+    }});
+
+    if ( sharded ) {
+        pipeline.add( { "partition", edge_deps, {},
+                        { shard_dir + "/ranges.tsv" },
+                        params["shards"] + edge_params,
+                        [&]() {
+
+            sharded_graph().partition( graph_edges_file, num_shards );
+        }});
+    }
+
+    pipeline.add( { "degree", graph_deps, {}, { degree_dist_file },
+                    sample_params + shard_params + edge_params, [&]() {
+
+        if ( approximate ) {
+            write_estimate( degree_est_file, "edges",
+                            graph().sampled_degree_dist( graph_edges_file,
+                                                         degree_dist_file,
+                                                         edge_sample() ) );
+        } else if ( sharded ) {
+            sharded_graph().degree_dist( degree_dist_file );
+        } else {
+            graph().degree_dist( graph_edges_file, degree_dist_file );
+        }
+    }}, estimate_stamps );
+
+    // the saved scores for evc_warm come only from the exact, single
+    // process run
+    vector<string> evc_outputs = { evc_file };
+    if ( !approximate && !sharded ) evc_outputs.push_back( evc_scores_file );
+
+    pipeline.add( { "evc", graph_deps, {}, evc_outputs,
+                    params["evc_iterations"] + " " + params["evc_eps"] +
+                    " " + params["evc_warm"] + " " + sample_params +
+                    shard_params + edge_params, [&]() {
+
+        int num_it = atoi( params["evc_iterations"].c_str() );
+        double eps = atof( params["evc_eps"].c_str() );
+
+        if ( approximate ) {
+            write_estimate( evc_est_file, "eigenvalue",
+                            graph().sampled_eigen_vect_cent( graph_edges_file,
+                                                             evc_file,
+                                                             num_it, eps,
+                                                             edge_sample() ) );
+        } else if ( sharded ) {
+            sharded_graph().eigen_vect_cent( evc_file, num_it, eps );
+        } else {
+            graph().eigen_vect_cent( graph_edges_file, evc_file, num_it, eps,
+                                     evc_scores_file,
+                                     params["evc_warm"] == "1" ?
+                                                    evc_scores_file : "",
+                                     checkpoint_file( "evc", stamp_dir ) );
+        }
+    }}, estimate_stamps );
+
+    pipeline.add( { "centrality", edge_deps, {}, { centrality_file },
+                    params["centrality_iterations"] + " " +
+                    params["centrality_eps"] + " " + params["katz_alpha"] +
+                    " " + params["damping"] + edge_params, [&]() {
+
+        graph().centrality_sweep( graph_edges_file, centrality_file,
+                              atoi( params["centrality_iterations"].c_str() ),
+                              atof( params["centrality_eps"].c_str() ),
+                              atof( params["katz_alpha"].c_str() ),
+                              atof( params["damping"].c_str() ) );
+    }});
+
+    // the same scores straight from the reviews, without the projection
+    pipeline.add( { "coreview", { "condense" }, {}, { coreview_file },
+                    params["centrality_iterations"] + " " +
+                    params["centrality_eps"] + " " + params["damping"],
+                    [&]() {
+
+        Bipartite coreview( reviews->product_reviewers(),
+                            reviews->num_reviewers() );
+        coreview.centrality( coreview_file,
+                             atoi( params["centrality_iterations"].c_str() ),
+                             atof( params["centrality_eps"].c_str() ),
+                             atof( params["damping"].c_str() ) );
+    }});
+
+    pipeline.add( { "mat", { "degree", "evc" }, {}, { mat_file }, edge_params,
+                    [&]() {
+
+        graph().convert_list_to_mat( graph_edges_file,
+                                     degree_dist_file,
+                                     evc_file,
+                                     tmp_buckets,
+                                     mat_file,
+                                     checkpoint_file( "mat", stamp_dir ) );
+    }});
+
+    pipeline.add( { "components", graph_deps, {}, { cluster_mem_file },
+                    sample_params + shard_params + edge_params, [&]() {
+
+        if ( approximate ) {
+            write_estimate( cluster_est_file, "largest_cluster_share",
+                            graph().sampled_cluster_stats( graph_edges_file,
+                                                           cluster_mem_file,
+                                                           edge_sample() ) );
+        } else if ( sharded ) {
+            sharded_graph().cluster_stats( cluster_mem_file );
+        } else {
+            graph().cluster_stats( graph_edges_file, cluster_mem_file );
+        }
+    }}, estimate_stamps );
+
+    pipeline.add( { "modularity", { "degree", "components" }, {},
+                    { modularity_file }, sample_params + edge_params, [&]() {
+
+        double Q;
+
+        if ( approximate ) {
+            Estimate estimate = graph().sampled_modularity( graph_edges_file,
+                                                            cluster_mem_file,
+                                                            edge_sample() );
+            write_estimate( modularity_est_file, "modularity", estimate );
+            Q = estimate.value;
+        } else {
+            Q = graph().modularity( graph_edges_file,
+                                    degree_dist_file,
+                                    cluster_mem_file );
+        }
+
+        fprintf(stdout,"modularity: %14.7e\n", Q );
+
+        FILE *fp = fopen_csv( modularity_file, "w", false );
+        fprintf( fp, "%14.7e\n", Q );
+        fclose( fp );
+    }}, estimate_stamps );
+
+    pipeline.add( { "triangles", edge_deps, {}, { triangles_file },
+                    edge_params, [&]() {
+
+        graph().triangle_stats( graph_edges_file, triangles_file );
+    }});
+
+    pipeline.add( { "distances", { edge_stage, "components" }, {},
+                    { distances_file, closeness_file },
+                    params["bfs_sources"] + edge_params, [&]() {
+
+        graph().distance_stats( graph_edges_file, cluster_mem_file,
+                                distances_file, closeness_file,
+                                atol( params["bfs_sources"].c_str() ) );
+    }});
+
+    pipeline.add( { "cores", edge_deps, {}, { cores_file }, edge_params,
+                    [&]() {
+
+        graph().core_decomposition( graph_edges_file, cores_file );
+    }});
+
+    pipeline.add( { "kcore", { "cores" }, {},
+                    { kcore_edges_file, kcore_map_file },
+                    params["core_k"] + edge_params, [&]() {
+
+        graph().core_subgraph( graph_edges_file, cores_file,
+                               atol( params["core_k"].c_str() ),
+                               kcore_edges_file, kcore_map_file );
+    }});
+
+    pipeline.add( { "similar", { "condense" }, {}, { similar_file },
+                    params["jaccard"], [&]() {
+
+        vector<vector<uint32_t>> rev_prods;
+        reviews->reviewer_products( rev_prods );
+
+        MinHashIndex lsh;
+        lsh.build( rev_prods );
+
+        size_t num_pairs = lsh.similar_pairs( similar_file,
+                                            atof( params["jaccard"].c_str() ) );
+
+        fprintf( stderr, "Number of similar pairs: %zd\n", num_pairs );
+    }});
+
+    if ( approximate ) {
+        if ( targets.empty() ) targets = estimators;
+        for ( const string &target : targets ) {
+            if ( std::find( estimators.begin(), estimators.end(),
+                            target ) == estimators.end() ) {
+                fprintf( stderr, "No estimate for stage %s; only degree, evc,"
+                                 " components and modularity are sampled\n",
+                                 target.c_str() );
+                exit(1);
+            }
+        }
+    }
 
-    Graph graph( reviews.num_reviewers() );
-    graph.degree_dist( edges_file, degree_dist_file );
-    graph.eigen_vect_cent( edges_file, evc_file, 20, 1.0e-10 );
+    if ( targets.empty() ) targets = pipeline.stage_names();
 
-    graph.convert_list_to_mat( edges_file,
-                               degree_dist_file,
-                               evc_file,
-                               tmp_buckets,
-                               mat_file );
-    graph.cluster_stats( edges_file, cluster_mem_file );
-*/
+    pipeline.run( targets, force );
 
-    Graph graph( 2588990 );
-    double Q = graph.modularity( edges_file, 
-                                 degree_dist_file, 
-                                 cluster_mem_file );
+    write_stats_report( stats_file );
 
-    fprintf(stdout,"modularity: %14.7e\n", Q );
-    
 }
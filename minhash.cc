@@ -0,0 +1,255 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "minhash.h"
+#include "misc.h"
+#include "thread_pool.h"
+#include "tsv_writer.h"
+
+using std::pair;
+using std::string;
+using std::vector;
+
+MinHashIndex::MinHashIndex( const size_t num_bands,
+                            const size_t num_rows,
+                            const uint64_t seed ) {
+
+    _num_bands = num_bands;
+    _num_rows = num_rows;
+    _num_sets = 0;
+
+    _seeds.resize( num_hashes() );
+    uint64_t state = seed;
+    for ( size_t h = 0; h < num_hashes(); ++h ) {
+        state += 0x9e3779b97f4a7c15ull;
+        _seeds[h] = mix64( state );
+    }
+}
+
+/**
+ * Compute the signature and band keys of every set with at least min_size
+ * elements, then sort each band by key so that buckets are contiguous.
+ */
+void MinHashIndex::build( const vector<vector<uint32_t>> &sets,
+                          const size_t min_size ) {
+
+    const size_t nh = num_hashes();
+
+    _num_sets = sets.size();
+    _signatures.assign( _num_sets*nh, std::numeric_limits<uint32_t>::max() );
+    _band_keys.assign( _num_sets*_num_bands, 0 );
+    _indexed.assign( _num_sets, false );
+
+    for ( size_t s = 0; s < _num_sets; ++s ) {
+        _indexed[s] = ( sets[s].size() >= min_size );
+    }
+
+    parallel_for( 0, _num_sets, [&]( size_t begin, size_t end ) {
+
+        for ( size_t s = begin; s < end; ++s ) {
+
+            if ( !_indexed[s] ) continue;
+
+            uint32_t *sig = &_signatures[s*nh];
+
+            for ( uint32_t x : sets[s] ) {
+                for ( size_t h = 0; h < nh; ++h ) {
+                    uint32_t v = static_cast<uint32_t>(
+                                        mix64( x ^ _seeds[h] ) >> 32 );
+                    if ( v < sig[h] ) sig[h] = v;
+                }
+            }
+
+            for ( size_t b = 0; b < _num_bands; ++b ) {
+                uint64_t key = b;
+                for ( size_t r = 0; r < _num_rows; ++r ) {
+                    key = mix64( key ^ sig[b*_num_rows + r] );
+                }
+                _band_keys[s*_num_bands + b] = key;
+            }
+        }
+    });
+
+    _bands.assign( _num_bands, vector<pair<uint64_t,uint32_t>>() );
+
+    parallel_for( 0, _num_bands, [&]( size_t begin, size_t end ) {
+
+        for ( size_t b = begin; b < end; ++b ) {
+            vector<pair<uint64_t,uint32_t>> &band = _bands[b];
+            for ( size_t s = 0; s < _num_sets; ++s ) {
+                if ( _indexed[s] ) {
+                    band.push_back( pair<uint64_t,uint32_t>(
+                                        _band_keys[s*_num_bands + b], s ) );
+                }
+            }
+            std::sort( band.begin(), band.end() );
+        }
+    });
+
+}
+
+size_t MinHashIndex::num_indexed() const {
+    return std::count( _indexed.begin(), _indexed.end(), true );
+}
+
+/**
+ * The fraction of agreeing minimum hashes, an unbiased estimate of the
+ * Jaccard similarity of the two sets.
+ */
+double MinHashIndex::similarity( const size_t a, const size_t b ) const {
+
+    if ( a >= _num_sets || b >= _num_sets ) return 0.0;
+    if ( !_indexed[a] || !_indexed[b] ) return 0.0;
+
+    const size_t nh = num_hashes();
+    const uint32_t *sig_a = &_signatures[a*nh];
+    const uint32_t *sig_b = &_signatures[b*nh];
+
+    size_t same = 0;
+    for ( size_t h = 0; h < nh; ++h ) {
+        same += ( sig_a[h] == sig_b[h] );
+    }
+
+    return static_cast<double>( same )/static_cast<double>( nh );
+}
+
+/**
+ * All indexed sets sharing at least one band bucket with 'set' whose
+ * estimated similarity is at least 'threshold', most similar first.
+ */
+void MinHashIndex::query( const size_t set,
+                          const double threshold,
+                          vector<pair<uint32_t,double>> &similar ) const {
+
+    similar.clear();
+
+    if ( set >= _num_sets || !_indexed[set] ) return;
+
+    vector<uint32_t> candidates;
+
+    for ( size_t b = 0; b < _num_bands; ++b ) {
+
+        const vector<pair<uint64_t,uint32_t>> &band = _bands[b];
+        uint64_t key = _band_keys[set*_num_bands + b];
+
+        auto it = std::lower_bound( band.begin(), band.end(),
+                                    pair<uint64_t,uint32_t>( key, 0 ) );
+
+        for ( ; it != band.end() && it->first == key; ++it ) {
+            if ( it->second != set ) candidates.push_back( it->second );
+        }
+    }
+
+    std::sort( candidates.begin(), candidates.end() );
+    candidates.erase( std::unique( candidates.begin(), candidates.end() ),
+                      candidates.end() );
+
+    for ( uint32_t c : candidates ) {
+        double sim = similarity( set, c );
+        if ( sim >= threshold ) {
+            similar.push_back( pair<uint32_t,double>( c, sim ) );
+        }
+    }
+
+    std::sort( similar.begin(), similar.end(),
+               []( const pair<uint32_t,double> &a,
+                   const pair<uint32_t,double> &b ) {
+                    return a.second > b.second; } );
+}
+
+/**
+ * Write every pair of sets sharing a band bucket whose estimated similarity
+ * is at least 'threshold'. Buckets larger than max_bucket are skipped, as
+ * they would reintroduce the quadratic blow up the index is meant to avoid.
+ *
+ * The buckets of all bands are checked in one loop, split by their pair
+ * counts, so that a few large buckets are spread over the workers; the
+ * pairs are sorted afterwards, so the output does not depend on the split.
+ */
+size_t MinHashIndex::similar_pairs( const string &output_filename,
+                                    const double threshold,
+                                    const size_t max_bucket ) const {
+
+    struct Bucket {
+        size_t band;
+        size_t first;
+        size_t last;
+    };
+
+    vector<Bucket> buckets;
+    vector<size_t> costs( 1, 0 );
+
+    for ( size_t b = 0; b < _num_bands; ++b ) {
+
+        const vector<pair<uint64_t,uint32_t>> &band = _bands[b];
+
+        size_t first = 0;
+        while ( first < band.size() ) {
+
+            size_t last = first + 1;
+            while ( last < band.size() &&
+                    band[last].first == band[first].first ) ++last;
+
+            size_t size = last - first;
+            if ( size > 1 && size <= max_bucket ) {
+                buckets.push_back( Bucket{ b, first, last } );
+                costs.push_back( costs.back() + size*( size - 1 )/2 );
+            }
+
+            first = last;
+        }
+    }
+
+    ThreadPool &pool = ThreadPool::instance();
+
+    vector<vector<uint64_t>> found( pool.max_slots() );
+
+    pool.parallel_for_weighted( costs.data(), buckets.size(),
+                                [&]( size_t begin, size_t end ) {
+
+        vector<uint64_t> &local = found[ThreadPool::slot()];
+
+        for ( size_t k = begin; k < end; ++k ) {
+
+            const vector<pair<uint64_t,uint32_t>> &band =
+                                                    _bands[buckets[k].band];
+            const size_t first = buckets[k].first;
+            const size_t last = buckets[k].last;
+
+            for ( size_t i = first; i < last; ++i ) {
+                for ( size_t j = i + 1; j < last; ++j ) {
+                    uint64_t lo = std::min( band[i].second, band[j].second );
+                    uint64_t hi = std::max( band[i].second, band[j].second );
+                    if ( similarity( lo, hi ) >= threshold ) {
+                        local.push_back( ( lo << 32 ) | hi );
+                    }
+                }
+            }
+        }
+    });
+
+    vector<uint64_t> pairs;
+    for ( vector<uint64_t> &slot_pairs : found ) {
+        pairs.insert( pairs.end(), slot_pairs.begin(), slot_pairs.end() );
+        vector<uint64_t>().swap( slot_pairs );
+    }
+    std::sort( pairs.begin(), pairs.end() );
+    pairs.erase( std::unique( pairs.begin(), pairs.end() ), pairs.end() );
+
+    TsvWriter output( output_filename );
+
+    output.put( "source\ttarget\tjaccard\n" );
+    for ( uint64_t p : pairs ) {
+        size_t a = p >> 32;
+        size_t b = p & 0xffffffffull;
+        output.row( a, b, Fixed( similarity( a, b ), 4 ) );
+    }
+    output.close();
+
+    return pairs.size();
+}
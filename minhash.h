@@ -0,0 +1,64 @@
+#ifndef MINHASH_H
+#define MINHASH_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * MinHash signatures and a banded locality sensitive hash index over a
+ * collection of integer sets, e.g. the products reviewed by each reviewer.
+ *
+ * Each signature holds num_bands*num_rows minimum hashes. Two sets land in
+ * the same bucket of some band with probability 1-(1-J^r)^b, where J is
+ * their Jaccard similarity, so the index behaves like a threshold near
+ * (1/b)^(1/r). Candidates are confirmed against the signature estimate.
+ *
+ * Each of the num_bands bands costs n(n-1)/2 checks per bucket of n sets,
+ * so similar_pairs skips buckets of more than max_bucket sets: at the
+ * default of 1000, at most about 5*10^5 checks per bucket and band.
+ */
+class MinHashIndex {
+
+ private:
+    size_t _num_bands;
+    size_t _num_rows;
+    size_t _num_sets;
+
+    std::vector<uint64_t> _seeds;
+    std::vector<uint32_t> _signatures;
+    std::vector<uint64_t> _band_keys;
+    std::vector<bool> _indexed;
+
+    // for each band, the (key, set) pairs sorted by key
+    std::vector<std::vector<std::pair<uint64_t,uint32_t>>> _bands;
+
+ public:
+    MinHashIndex( const size_t num_bands = 20,
+                  const size_t num_rows = 5,
+                  const uint64_t seed = 0x9e3779b97f4a7c15ull );
+
+    void build( const std::vector<std::vector<uint32_t>> &sets,
+                const size_t min_size = 2 );
+
+    size_t num_indexed() const;
+
+    double similarity( const size_t a, const size_t b ) const;
+
+    void query( const size_t set,
+                const double threshold,
+                std::vector<std::pair<uint32_t,double>> &similar ) const;
+
+    size_t similar_pairs( const std::string &output_filename,
+                          const double threshold,
+                          const size_t max_bucket = 1000 ) const;
+
+ private:
+    size_t num_hashes() const {
+        return _num_bands*_num_rows;
+    }
+
+};
+
+#endif // MINHASH_H
@@ -4,8 +4,19 @@
 
 #include <algorithm>
 #include <cerrno>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.h"
 
 /**
  * A simple function for tokenizing a string based upon a set of delimiters.
@@ -67,6 +78,19 @@ inline void hash_combine( std::size_t& seed, const T& v) {
     seed ^= hasher(v) + 0x9e3779b9 + (seed<<6) + (seed>>2);
 }
 
+/**
+ * The splitmix64 finalizer, a cheap and well mixed 64 bit hash
+ */
+
+inline uint64_t mix64( uint64_t x ) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
 /**
  * A function for hasing a pair of integers
  */
@@ -88,56 +112,240 @@ public:
 
 
 /**
- * A fast method for reading in positive integers.
- * Use with caution as few checks are made for input errors.
+ * Map a key to an unsigned 64 bit integer with the same order, for radix
+ * sorting. Signed integers have their sign bit flipped; floating point
+ * numbers have the sign bit set when positive and all bits flipped when
+ * negative, so that -0.0 sorts just below 0.0.
  */
 template <typename T>
-void scan_pos_int( FILE *fp, T &x ) {
+inline typename std::enable_if<std::is_integral<T>::value, uint64_t>::type
+radix_key( const T x ) {
+    uint64_t u = static_cast<uint64_t>( x );
+    return ( std::is_signed<T>::value ? u ^ ( 1ull << 63 ) : u );
+}
 
-    int c = getc_unlocked( fp );
+inline uint64_t radix_key( const double x ) {
+    uint64_t u;
+    memcpy( &u, &x, sizeof(u) );
+    return ( u >> 63 ? ~u : u | ( 1ull << 63 ) );
+}
 
-    if ( c == EOF ) {
-        x = EOF;
-        return;
-    }
+inline uint64_t radix_key( const float x ) {
+    return radix_key( static_cast<double>( x ) );
+}
 
-    x = 0;
+/**
+ * Sort (key, value) pairs by key, stably, with a parallel LSD radix sort
+ * by bytes. One pass counts all eight bytes, and a byte which is the same
+ * for every key, e.g. the high bytes of small integers, is skipped. Each
+ * remaining byte is counted per chunk of the current order and scattered
+ * with the chunks writing to disjoint ranges, so the result does not
+ * depend on the number of threads.
+ */
+template <typename T>
+void radix_sort_pairs( std::vector<uint64_t> &keys, std::vector<T> &values ) {
+
+    const size_t n = keys.size();
+    if ( n < 2 ) return;
+
+    ThreadPool &pool = ThreadPool::instance();
+
+    const size_t CHUNK = 1 << 16;
+    const size_t num_chunks = std::min( ( n + CHUNK - 1 )/CHUNK,
+                                        4*pool.num_threads() );
+    const size_t chunk = ( n + num_chunks - 1 )/num_chunks;
+
+    // every byte of every key, per chunk, to find the bytes to skip
+    std::vector<size_t> counts( num_chunks*8*256, 0 );
+    pool.parallel_for( 0, num_chunks, [&]( size_t begin, size_t end ) {
+        for ( size_t c = begin; c < end; ++c ) {
+            size_t *count = &counts[c*8*256];
+            size_t stop = std::min( n, ( c + 1 )*chunk );
+            for ( size_t i = c*chunk; i < stop; ++i ) {
+                uint64_t key = keys[i];
+                for ( int d = 0; d < 8; ++d ) {
+                    ++count[d*256 + ( ( key >> ( 8*d ) ) & 0xff )];
+                }
+            }
+        }
+    }, 1 );
+
+    std::vector<uint64_t> keys_out( n );
+    std::vector<T> values_out( n );
+    std::vector<size_t> offsets( num_chunks*256 );
 
-    for ( ; ( c < 48 || c > 57 ); c = getc_unlocked( fp ) );
+    for ( int d = 0; d < 8; ++d ) {
 
-    for ( ; c > 47 && c < 58; c = getc_unlocked( fp ) ) {
-        x = ( x << 1 ) + ( x << 3 ) + (c - 48);
+        bool constant = false;
+        for ( int b = 0; b < 256 && !constant; ++b ) {
+            size_t total = 0;
+            for ( size_t c = 0; c < num_chunks; ++c ) {
+                total += counts[( c*8 + d )*256 + b];
+            }
+            constant = ( total == n );
+        }
+        if ( constant ) continue;
+
+        const int shift = 8*d;
+
+        pool.parallel_for( 0, num_chunks, [&]( size_t begin, size_t end ) {
+            for ( size_t c = begin; c < end; ++c ) {
+                size_t *count = &offsets[c*256];
+                std::fill( count, count + 256, 0 );
+                size_t stop = std::min( n, ( c + 1 )*chunk );
+                for ( size_t i = c*chunk; i < stop; ++i ) {
+                    ++count[( keys[i] >> shift ) & 0xff];
+                }
+            }
+        }, 1 );
+
+        size_t sum = 0;
+        for ( int b = 0; b < 256; ++b ) {
+            for ( size_t c = 0; c < num_chunks; ++c ) {
+                size_t count = offsets[c*256 + b];
+                offsets[c*256 + b] = sum;
+                sum += count;
+            }
+        }
+
+        pool.parallel_for( 0, num_chunks, [&]( size_t begin, size_t end ) {
+            for ( size_t c = begin; c < end; ++c ) {
+                size_t *next = &offsets[c*256];
+                size_t stop = std::min( n, ( c + 1 )*chunk );
+                for ( size_t i = c*chunk; i < stop; ++i ) {
+                    size_t pos = next[( keys[i] >> shift ) & 0xff]++;
+                    keys_out[pos] = keys[i];
+                    values_out[pos] = values[i];
+                }
+            }
+        }, 1 );
+
+        keys.swap( keys_out );
+        values.swap( values_out );
     }
 }
 
+/**
+ * The indexes of v in order of value, largest first unless 'descending'
+ * is false; equal values keep the order of their indexes.
+ */
 template <typename T>
-std::vector<size_t> sort_indexes( const T *v, const int len) {
+std::vector<size_t> radix_argsort( const T *v, const size_t len,
+                                   const bool descending = true ) {
 
-  // initialize original index locations
+    std::vector<uint64_t> keys( len );
     std::vector<size_t> idx( len );
-    for (size_t i = 0; i != len; ++i) idx[i] = i;
 
-  // sort indexes based on comparing values in v
-    std::sort( idx.begin(), idx.end(),
-                [&v](size_t i1, size_t i2) {return v[i1] > v[i2];});
+    parallel_for( 0, len, [&]( size_t begin, size_t end ) {
+        for ( size_t i = begin; i < end; ++i ) {
+            keys[i] = ( descending ? ~radix_key( v[i] ) : radix_key( v[i] ) );
+            idx[i] = i;
+        }
+    });
+
+    radix_sort_pairs( keys, idx );
 
     return idx;
 }
 
+/**
+ * The indexes of the k largest values of v, largest first, with ties in
+ * the order of their indexes. A histogram of the top 16 bits of the keys
+ * finds the bucket holding the k'th largest, and only the values down to
+ * that bucket are sorted.
+ */
 template <typename T>
-std::vector<size_t> sort_indexes( const std::vector<T> &v ) {
+std::vector<size_t> top_indexes( const T *v, const size_t len, size_t k ) {
 
-  // initialize original index locations
-    std::vector<size_t> idx(v.size());
-    for (size_t i = 0; i < v.size(); ++i) idx[i] = i;
+    k = std::min( k, len );
+    if ( k == 0 ) return std::vector<size_t>();
+
+    const size_t CHUNK = 1 << 16;
+
+    // a short list, e.g. the neighbors of a vertex, is not worth the
+    // histogram
+    if ( len < CHUNK ) {
+        std::vector<std::pair<uint64_t,size_t>> keyed( len );
+        for ( size_t i = 0; i < len; ++i ) {
+            keyed[i] = std::pair<uint64_t,size_t>( ~radix_key( v[i] ), i );
+        }
+        std::partial_sort( keyed.begin(), keyed.begin() + k, keyed.end() );
+        std::vector<size_t> idx( k );
+        for ( size_t i = 0; i < k; ++i ) idx[i] = keyed[i].second;
+        return idx;
+    }
 
-  // sort indexes based on comparing values in v
-    std::sort( idx.begin(), idx.end(),
-       [&v](size_t i1, size_t i2) {return v[i1] > v[i2];});
+    ThreadPool &pool = ThreadPool::instance();
+
+    const size_t num_chunks = std::min( ( len + CHUNK - 1 )/CHUNK,
+                                        4*pool.num_threads() );
+    const size_t chunk = ( len + num_chunks - 1 )/num_chunks;
+
+    std::vector<size_t> counts( num_chunks << 16, 0 );
+    pool.parallel_for( 0, num_chunks, [&]( size_t begin, size_t end ) {
+        for ( size_t c = begin; c < end; ++c ) {
+            size_t *count = &counts[c << 16];
+            size_t stop = std::min( len, ( c + 1 )*chunk );
+            for ( size_t i = c*chunk; i < stop; ++i ) {
+                ++count[~radix_key( v[i] ) >> 48];
+            }
+        }
+    }, 1 );
+
+    uint64_t last = 0;
+    for ( size_t total = 0; ; ++last ) {
+        for ( size_t c = 0; c < num_chunks; ++c ) {
+            total += counts[( c << 16 ) + last];
+        }
+        if ( total >= k ) break;
+    }
+
+    // the candidates of each chunk, in index order
+    std::vector<size_t> found( num_chunks + 1, 0 );
+    for ( size_t c = 0; c < num_chunks; ++c ) {
+        size_t total = 0;
+        for ( uint64_t b = 0; b <= last; ++b ) {
+            total += counts[( c << 16 ) + b];
+        }
+        found[c + 1] = found[c] + total;
+    }
+
+    std::vector<uint64_t> keys( found[num_chunks] );
+    std::vector<size_t> idx( found[num_chunks] );
+
+    pool.parallel_for( 0, num_chunks, [&]( size_t begin, size_t end ) {
+        for ( size_t c = begin; c < end; ++c ) {
+            size_t fill = found[c];
+            size_t stop = std::min( len, ( c + 1 )*chunk );
+            for ( size_t i = c*chunk; i < stop; ++i ) {
+                uint64_t key = ~radix_key( v[i] );
+                if ( ( key >> 48 ) <= last ) {
+                    keys[fill] = key;
+                    idx[fill++] = i;
+                }
+            }
+        }
+    }, 1 );
+
+    radix_sort_pairs( keys, idx );
+    idx.resize( k );
 
     return idx;
 }
 
+/**
+ * The indexes of v from the largest value to the smallest.
+ */
+template <typename T>
+std::vector<size_t> sort_indexes( const T *v, const size_t len ) {
+    return radix_argsort( v, len );
+}
+
+template <typename T>
+std::vector<size_t> sort_indexes( const std::vector<T> &v ) {
+    return radix_argsort( v.data(), v.size() );
+}
+
 inline
 FILE* fopen_csv( const std::string &filename, 
                  const std::string &mode, 
@@ -170,33 +378,5 @@ FILE* fopen_csv( const std::string &filename,
     return( fp );
 }
 
-struct MapCompare : public std::binary_function<size_t,size_t,bool> {
-
-    std::unordered_map<size_t,size_t> *map_;
-
-    MapCompare( std::unordered_map<size_t,size_t> *map ) {
-        map_ = map;
-    }
-
-    bool operator() ( const size_t a,  const size_t b) const {
-        size_t a_r = std::numeric_limits<size_t>::min();
-        if ( map_->count(a) ) a_r = map_->at( a );
-        size_t b_r = std::numeric_limits<size_t>::min();
-        if ( map_->count(b) ) b_r = map_->at( b );
-        return ( a_r < b_r);
-    }
-
-    bool operator() ( const std::pair<size_t,size_t> a,
-                                    const std::pair<size_t,size_t> b) const {
-        size_t a_r = std::numeric_limits<size_t>::min();
-        if ( map_->count(a.first) ) a_r = map_->at( a.first );
-        size_t b_r = std::numeric_limits<size_t>::min();
-        if ( map_->count(b.first) ) b_r = map_->at( b.first );
-        return ( a_r < b_r);
-    }
-};
-
-
-
 #endif   // MISC_H
 
@@ -0,0 +1,246 @@
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "pipeline.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+
+/**
+ * Modification time of a file in nanoseconds, or -1 if it does not exist.
+ */
+long long file_time( const string &filename ) {
+
+    struct stat st;
+    if ( stat( filename.c_str(), &st ) != 0 ) return -1;
+
+    return static_cast<long long>( st.st_mtim.tv_sec )*1000000000ll +
+                                                    st.st_mtim.tv_nsec;
+}
+
+string read_file( const string &filename ) {
+    std::ifstream in( filename );
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+}
+
+
+Pipeline::Pipeline( const string &stamp_dir ) {
+    _stamp_dir = stamp_dir;
+    mkdir( _stamp_dir.c_str(), 0755 );
+}
+
+/**
+ * Stages must be added after the stages they depend upon. A stage whose
+ * outputs live apart from the others, e.g. those of a sampled run, keeps
+ * its stamp in 'stamp_dir' rather than the pipeline's.
+ */
+void Pipeline::add( const Stage &stage, const string &stamp_dir ) {
+
+    for ( const string &dep : stage.deps ) {
+        if ( !_index.count( dep ) ) {
+            fprintf( stderr, "Stage %s depends on unknown stage %s\n",
+                             stage.name.c_str(), dep.c_str() );
+            abort();
+        }
+    }
+
+    if ( !stamp_dir.empty() ) mkdir( stamp_dir.c_str(), 0755 );
+
+    _index[stage.name] = _stages.size();
+    _stages.push_back( stage );
+    _stamp_dirs.push_back( stamp_dir.empty() ? _stamp_dir : stamp_dir );
+}
+
+vector<string> Pipeline::stage_names() const {
+    vector<string> names;
+    for ( const Stage &stage : _stages ) names.push_back( stage.name );
+    return names;
+}
+
+string Pipeline::stamp_file( const size_t s ) const {
+    return _stamp_dirs[s] + "/" + _stages[s].name + ".stamp";
+}
+
+/**
+ * Whether a stage with outputs has to run again. The inputs of in-memory
+ * stages it depends on count as its own inputs; 'inputs' returns them.
+ */
+bool Pipeline::is_stale( const size_t s,
+                         const vector<bool> &stale,
+                         vector<string> &inputs ) const {
+
+    const Stage &stage = _stages[s];
+
+    long long stamp_time = file_time( stamp_file( s ) );
+    if ( stamp_time < 0 ) return true;
+    if ( read_file( stamp_file( s ) ) != stage.params ) return true;
+
+    for ( const string &output : stage.outputs ) {
+        if ( file_time( output ) < 0 ) return true;
+    }
+
+    // walk through the in-memory dependencies to the stages with files
+    vector<size_t> pending( 1, s );
+    while ( !pending.empty() ) {
+
+        const Stage &current = _stages[pending.back()];
+        pending.pop_back();
+
+        inputs.insert( inputs.end(), current.inputs.begin(),
+                                     current.inputs.end() );
+
+        for ( const string &dep : current.deps ) {
+            size_t d = _index.at( dep );
+            if ( _stages[d].outputs.empty() ) {
+                pending.push_back( d );
+            } else if ( stale[d] ||
+                        file_time( stamp_file( d ) ) > stamp_time ) {
+                return true;
+            }
+        }
+    }
+
+    for ( const string &input : inputs ) {
+        if ( file_time( input ) > stamp_time ) return true;
+    }
+
+    return false;
+}
+
+/**
+ * Whether the current run executes a stage, e.g. for an in-memory stage
+ * to load only what the stages after it use.
+ */
+bool Pipeline::scheduled( const string &name ) const {
+
+    std::map<string,size_t>::const_iterator it = _index.find( name );
+
+    return ( it != _index.end() && it->second < _scheduled.size() &&
+             _scheduled[it->second] );
+}
+
+/**
+ * Bring the targets, and every stage they depend on, up to date.
+ */
+void Pipeline::run( const vector<string> &targets, const bool force ) {
+
+    const size_t num_stages = _stages.size();
+
+    vector<bool> needed( num_stages, false );
+    for ( const string &target : targets ) {
+        if ( !_index.count( target ) ) {
+            fprintf( stderr, "Unknown stage: %s\n", target.c_str() );
+            abort();
+        }
+        needed[_index[target]] = true;
+    }
+    for ( size_t s = num_stages; s-- > 0; ) {
+        if ( !needed[s] ) continue;
+        for ( const string &dep : _stages[s].deps ) {
+            needed[_index[dep]] = true;
+        }
+    }
+
+    vector<bool> stale( num_stages, false );
+    for ( size_t s = 0; s < num_stages; ++s ) {
+        if ( !needed[s] || _stages[s].outputs.empty() ) continue;
+        vector<string> inputs;
+        stale[s] = force || is_stale( s, stale, inputs );
+        if ( !stale[s] ) {
+            fprintf( stderr, "[%s] up to date\n", _stages[s].name.c_str() );
+        }
+    }
+
+    // in-memory stages run only for the stages which need them
+    for ( size_t s = num_stages; s-- > 0; ) {
+        if ( !stale[s] ) continue;
+        for ( const string &dep : _stages[s].deps ) {
+            size_t d = _index[dep];
+            if ( _stages[d].outputs.empty() ) stale[d] = true;
+        }
+    }
+
+    _scheduled = stale;
+
+    enum { WAITING, RUNNING, DONE };
+    vector<int> state( num_stages, WAITING );
+    size_t remaining = 0;
+    for ( size_t s = 0; s < num_stages; ++s ) remaining += stale[s];
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    vector<std::thread> threads;
+
+    auto execute = [&]( const size_t s ) {
+
+        const Stage &stage = _stages[s];
+
+        fprintf( stderr, "[%s] running\n", stage.name.c_str() );
+
+        // a stage killed part way must be stale on the next run, where it
+        // picks up from its checkpoint if it keeps one
+        remove( stamp_file( s ).c_str() );
+
+        std::chrono::steady_clock::time_point start =
+                                            std::chrono::steady_clock::now();
+        stage.run();
+        std::chrono::duration<double> elapsed =
+                                std::chrono::steady_clock::now() - start;
+
+        if ( !stage.outputs.empty() ) {
+            std::ofstream stamp( stamp_file( s ), std::ios::trunc );
+            stamp << stage.params;
+        }
+
+        fprintf( stderr, "[%s] done in %.1f s\n", stage.name.c_str(),
+                                                  elapsed.count() );
+
+        std::lock_guard<std::mutex> lock( mutex );
+        state[s] = DONE;
+        --remaining;
+        finished.notify_all();
+    };
+
+    std::unique_lock<std::mutex> lock( mutex );
+
+    while ( remaining > 0 ) {
+
+        for ( size_t s = 0; s < num_stages; ++s ) {
+
+            if ( !stale[s] || state[s] != WAITING ) continue;
+
+            bool ready = true;
+            for ( const string &dep : _stages[s].deps ) {
+                size_t d = _index[dep];
+                if ( stale[d] && state[d] != DONE ) ready = false;
+            }
+
+            if ( ready ) {
+                state[s] = RUNNING;
+                threads.emplace_back( execute, s );
+            }
+        }
+
+        finished.wait( lock );
+    }
+
+    lock.unlock();
+
+    for ( std::thread &thread : threads ) thread.join();
+}
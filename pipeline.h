@@ -0,0 +1,63 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * A step of the analysis. A stage with no outputs keeps its results in
+ * memory, e.g. the loaded reviews; it runs only when a stage depending on
+ * it has to run.
+ */
+struct Stage {
+    std::string name;
+    std::vector<std::string> deps;
+    std::vector<std::string> inputs;
+    std::vector<std::string> outputs;
+    std::string params;
+    std::function<void()> run;
+};
+
+/**
+ * An incremental driver for a graph of stages. After a stage succeeds its
+ * parameters are written to a stamp file. A stage is skipped when its
+ * stamp holds the same parameters, all of its outputs exist, and the stamp
+ * is newer than its input files and the stamps of the stages it depends
+ * on. Stages whose dependencies are satisfied run concurrently.
+ *
+ * The stamp of a stage is removed when it starts, so that a stage killed
+ * part way runs again, resuming from its Checkpoint if it keeps one.
+ */
+class Pipeline {
+
+ private:
+    std::string _stamp_dir;
+    std::vector<Stage> _stages;
+    std::vector<std::string> _stamp_dirs;
+    std::map<std::string,size_t> _index;
+    std::vector<bool> _scheduled;
+
+ public:
+    Pipeline( const std::string &stamp_dir );
+
+    void add( const Stage &stage, const std::string &stamp_dir = "" );
+
+    void run( const std::vector<std::string> &targets,
+              const bool force = false );
+
+    std::vector<std::string> stage_names() const;
+
+    bool scheduled( const std::string &name ) const;
+
+ private:
+    std::string stamp_file( const size_t s ) const;
+
+    bool is_stale( const size_t s,
+                   const std::vector<bool> &stale,
+                   std::vector<std::string> &inputs ) const;
+
+};
+
+#endif // PIPELINE_H
@@ -1,38 +1,171 @@
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <functional>
 #include <iterator>
+#include <limits>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
+#include <sys/stat.h>
+
+#include "checkpoint.h"
 #include "misc.h"
 #include "reviews.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "tsv_writer.h"
 
 using std::next;
 using std::pair;
 using std::string;
 using std::stoi;
+using std::unique_ptr;
 using std::unordered_map;
 using std::unordered_set;
 using std::vector;
 
+namespace {
+
+/**
+ * The name of map bucket i, bucket_000 to bucket_126.
+ */
+string bucket_filename( const string &dirname, const int i ) {
+    string number = std::to_string( i );
+    return dirname + "/bucket_" + string( 3 - number.size(), '0' ) + number;
+}
+
+// rows mapped between checkpoints of map_edges
+const size_t CHECKPOINT_ROWS = 1ul << 24;
+
+// bytes resident while counting a map bucket, per byte of the bucket, if
+// every pair in it is distinct: its hash node, then its copy in the
+// counted vector
+const size_t RESIDENT_PER_BYTE = 8;
+
+/**
+ * The end of the window of map buckets counted together from first: at
+ * most max_buckets, and no more than fit memory_budget bytes resident,
+ * but always at least one.
+ */
+int bucket_window( const string *bucket_filenames,
+                   const int first,
+                   const int max_buckets,
+                   const size_t memory_budget ) {
+
+    size_t resident = 0;
+    int last = first;
+
+    while ( last < 127 && last - first < max_buckets ) {
+        struct stat st;
+        if ( stat( bucket_filenames[last].c_str(), &st ) == 0 ) {
+            resident += RESIDENT_PER_BYTE*st.st_size;
+        }
+        if ( last > first && resident > memory_budget ) break;
+        ++last;
+    }
+
+    return last;
+}
+
+/**
+ * Sync the buckets and describe them for a checkpoint: the number of
+ * products done, then the size of every bucket.
+ */
+string bucket_record( const size_t done,
+                      unique_ptr<TsvWriter> *buckets,
+                      const int num_buckets ) {
+
+    string record = std::to_string( done );
+    for ( int i = 0; i < num_buckets; ++i ) {
+        record += " " + std::to_string( buckets[i]->sync() );
+    }
+    return record;
+}
+
+/**
+ * Cut the buckets back to the sizes in a bucket_record. Returns the number
+ * of products done, or 0 if the buckets do not match the record.
+ */
+size_t resume_buckets( const string &record,
+                       const string *bucket_filenames,
+                       const int num_buckets ) {
+
+    const char *p = record.c_str();
+    char *end;
+
+    size_t done = strtoull( p, &end, 10 );
+    vector<size_t> sizes( num_buckets );
+    for ( int i = 0; i < num_buckets; ++i ) {
+        p = end;
+        sizes[i] = strtoull( p, &end, 10 );
+        if ( end == p ) return 0;
+    }
+
+    for ( int i = 0; i < num_buckets; ++i ) {
+        if ( !Checkpoint::cut_back( bucket_filenames[i], sizes[i] ) ) {
+            return 0;
+        }
+    }
+
+    return done;
+}
+
+/**
+ * Abort before the count'th id would overflow V.
+ */
+template <typename V>
+void check_id( const V count, const char *what ) {
+    if ( count == std::numeric_limits<V>::max() ) {
+        fprintf( stderr, "Too many %s for %zd bit ids\n", what,
+                                                        8*sizeof( V ) );
+        abort();
+    }
+}
+
+}
 
-Reviews::Reviews( const std::string &filename ) {
+template <typename V>
+BasicReviews<V>::BasicReviews( const std::string &filename,
+                               const unsigned columns ) {
     _filename = filename;
+    _columns = columns;
 
     load_reviews( _filename );
 }
 
-Reviews::Reviews( const char *filename ) {
+template <typename V>
+BasicReviews<V>::BasicReviews( const char *filename,
+                               const unsigned columns ) {
     _filename = string( filename );
+    _columns = columns;
 
     load_reviews( _filename );
 }
 
-void Reviews::load_reviews( const string &filename ) {
+/**
+ * Abort if a column was not loaded.
+ */
+template <typename V>
+void BasicReviews<V>::require( const unsigned column,
+                               const char *what ) const {
+    if ( !( _columns & column ) ) {
+        fprintf( stderr, "The %s of the reviews were not loaded\n", what );
+        abort();
+    }
+}
+
+template <typename V>
+void BasicReviews<V>::load_reviews( const string &filename ) {
+
+    StageTimer timer( "load_reviews" );
 
     FILE *fp = fopen_csv( filename, "r" );
 
@@ -40,38 +173,51 @@ void Reviews::load_reviews( const string &filename ) {
     size_t len = 0;
     ssize_t read = 0;
 
-    long num_prod = 0;
-    long num_rev = 0;
-    long num_tit = 0;
+    std::hash<std::string_view> hash_title;
+
+    V num_prod = 0;
+    V num_rev = 0;
+    V num_tit = 0;
+    _num_rows = 0;
     while ( ( read = getline( &line, &len, fp ) ) != -1 ) {
 
+        ++_num_rows;
+        timer.add_rows( 1 );
+        timer.add_bytes( read );
+
         char *begin = line;
         char *end = index( line, '\t' );
         string product_id = string( begin, (end-begin) );
 
-        begin = end + 1;
-        end = index( begin, '\t' );
-        string title = string( begin, (end-begin) );
-
-        long prod_id = num_prod;
+        V prod_id = num_prod;
         if ( prod_index.count( product_id ) ) {
             prod_id = prod_index[product_id];
         } else {
+            check_id( num_prod, "products" );
             prod_index[product_id] = prod_id;
             products.push_back( product_id ); 
             ++num_prod;
         }
 
-        long tit_id = num_tit;
-        if ( title_index.count( title ) ) {
-            tit_id = title_index[ title ];
-        } else {
-            title_index[ title ] = tit_id;
-            titles.push_back( title );
-            ++num_tit;
-        }
+        begin = end + 1;
+        end = index( begin, '\t' );
+
+        if ( _columns & TITLE_COLUMN ) {
 
-        title_prod[tit_id].insert( prod_id );
+            uint64_t title = hash_title( std::string_view( begin,
+                                                           (end-begin) ) );
+
+            V tit_id = num_tit;
+            if ( title_index.count( title ) ) {
+                tit_id = title_index[ title ];
+            } else {
+                check_id( num_tit, "titles" );
+                title_index[ title ] = tit_id;
+                ++num_tit;
+            }
+
+            title_prod[tit_id].insert( prod_id );
+        }
 
         begin = end + 1;
         end = index( begin, '\t' );
@@ -79,20 +225,24 @@ void Reviews::load_reviews( const string &filename ) {
 
         begin = end + 1;
         end = index( begin, '\t' );
-        string screen_name = string( begin, (end-begin) );
 
-        long rev_id = num_rev;
+        V rev_id = num_rev;
         if ( rev_index.count( reviewer_id ) ) {
             rev_id = rev_index[reviewer_id];
         } else {
+            check_id( num_rev, "reviewers" );
             rev_index[reviewer_id] = rev_id;
             reviewers.push_back( reviewer_id ); 
-            screen_names.push_back( screen_name ); 
+            if ( _columns & SCREEN_NAME_COLUMN ) {
+                screen_names.push_back( string( begin, (end-begin) ) );
+            }
             ++num_rev;
         }
 
         prod_rev[prod_id].insert( rev_id );
 
+        if ( !( _columns & METADATA_COLUMNS ) ) continue;
+
         begin = end + 1;
         end = index( begin, '\t' );
         string helpfulness = string( begin, (end-begin) );
@@ -126,14 +276,21 @@ void Reviews::load_reviews( const string &filename ) {
     fclose(fp);
 }
 
-long Reviews::condense_links() {
+template <typename V>
+long BasicReviews<V>::condense_links() {
+
+    StageTimer timer( "condense_links" );
+
+    require( TITLE_COLUMN, "titles" );
 
     long num_droped = 0;
-    for ( pair<size_t,unordered_set<size_t>> prods : title_prod ) {
+    for ( const pair<const V,unordered_set<V>> &prods : title_prod ) {
+
+        timer.add_rows( 1 );
 
         if ( prods.second.size() > 1 ) {
 
-            unordered_set<size_t>::iterator iusit, jusit;
+            typename unordered_set<V>::const_iterator iusit, jusit;
 
             for( iusit = prods.second.begin(); iusit != prods.second.end(); 
                                                                 ++iusit ) {
@@ -151,62 +308,136 @@ long Reviews::condense_links() {
     return( num_droped );
 }
 
-void Reviews::reviews_per_reviewer() {
+template <typename V>
+void BasicReviews<V>::reviews_per_reviewer() {
 
     rev_num_revs.clear();
     rev_num_revs.resize( reviewers.size() );
 
-    for ( pair<size_t,unordered_set<size_t>> pr : prod_rev ) {
-        for ( size_t rev : pr.second ) {
+    for ( const pair<const V,unordered_set<V>> &pr : prod_rev ) {
+        for ( V rev : pr.second ) {
             rev_num_revs[rev] += 1; 
         }
     }
 
 }
 
-void Reviews::output_reviewer_index( const string &filename ) {
+/**
+ * Invert the product to reviewer incidence: for every reviewer, the sorted
+ * list of products reviewed. The lists hold 32 bit ids, as MinHashIndex
+ * hashes them, so a larger product id is an error rather than cut short.
+ */
+template <typename V>
+void BasicReviews<V>::reviewer_products(
+                            vector<vector<uint32_t>> &rev_prods ) const {
+
+    rev_prods.clear();
+    rev_prods.resize( reviewers.size() );
+
+    for ( const pair<const V,unordered_set<V>> &pr : prod_rev ) {
+        if ( pr.first > std::numeric_limits<uint32_t>::max() ) {
+            fprintf( stderr, "Product id out of range: %zd\n",
+                             static_cast<size_t>( pr.first ) );
+            abort();
+        }
+        for ( V rev : pr.second ) {
+            rev_prods[rev].push_back( pr.first );
+        }
+    }
+
+    parallel_for( 0, rev_prods.size(), [&]( size_t begin, size_t end ) {
+        for ( size_t r = begin; r < end; ++r ) {
+            std::sort( rev_prods[r].begin(), rev_prods[r].end() );
+        }
+    });
+}
+
+template <typename V>
+void BasicReviews<V>::output_reviewer_index( const string &filename ) {
 
-    FILE *fp = fopen_csv( filename, "w", false );
+    require( SCREEN_NAME_COLUMN, "screen names" );
 
-    fprintf(fp,"vertexID\treviewerID\tScreenName\treviews\n");
+    TsvWriter fp( filename );
+
+    fp.put( "vertexID\treviewerID\tScreenName\treviews\n" );
     for( size_t r = 0; r < reviewers.size(); ++r ) {
-        fprintf(fp,"%zd\t%s\t%s\t%ld\n", r, reviewers[r].c_str(),
-                                       screen_names[r].c_str(),
-                                       rev_num_revs[r] );
+        fp.row( r, reviewers[r], screen_names[r], rev_num_revs[r] );
     }
 
-    fclose(fp);
+    fp.close();
 
 
 }
 
-void Reviews::map_edges( const string &dirname ) {
+/**
+ * Write the reviewer pairs of every product into 127 buckets, hashed by
+ * the lower reviewer. With product_rate < 1 only a deterministic sample of
+ * the products is projected, for the approximate analytics.
+ *
+ * With a checkpoint file the buckets are synced every few million rows
+ * and their sizes logged with the number of products done, so that a
+ * killed run cuts them back and carries on from that product.
+ */
+template <typename V>
+void BasicReviews<V>::map_edges( const string &dirname,
+                                 const double product_rate,
+                                 const uint64_t seed,
+                                 const string &checkpoint_filename ) {
+
+    StageTimer timer( "map_edges" );
 
     string bucket_filenames[127];
-    string base = dirname + "/bucket_";
-
     for ( int i = 0; i < 127; ++i ) {
-        if ( i < 10 ) {
-            bucket_filenames[i] = base + "00" + std::to_string( i );
-        } else if ( i < 100 ) {
-            bucket_filenames[i] = base + "0" + std::to_string( i );
-        } else {
-            bucket_filenames[i] = base + std::to_string( i );
-        }
+        bucket_filenames[i] = bucket_filename( dirname, i );
     }
 
-    FILE *buckets[127];
+    char params[128];
+    snprintf( params, sizeof(params),
+              " products=%zd reviews=%zd rate=%.17g seed=%llu",
+              prod_rev.size(), _num_rows, product_rate,
+              static_cast<unsigned long long>( seed ) );
+
+    Checkpoint checkpoint( checkpoint_filename,
+                           "map_edges " +
+                           Checkpoint::fingerprint( { _filename } ) + params );
+
+    size_t skip = 0;
+    if ( !checkpoint.records().empty() ) {
+        skip = resume_buckets( checkpoint.records().back(),
+                               bucket_filenames, 127 );
+    }
+
+    unique_ptr<TsvWriter> buckets[127];
     for ( int i = 0; i < 127; ++i ) {
-        buckets[i] = fopen_csv( bucket_filenames[i], "w", false );
+        buckets[i].reset( new TsvWriter( bucket_filenames[i], true, 1 << 16,
+                                         skip > 0 ) );
     }
 
-    unordered_map<size_t,unordered_set<size_t>>::iterator umit;
-    unordered_set<size_t>::iterator sit_i, sit_j;
+    typename unordered_map<V,unordered_set<V>>::iterator umit;
+    typename unordered_set<V>::iterator sit_i, sit_j;
 
     std::hash<size_t> hash_st;
 
-    for( umit = prod_rev.begin(); umit != prod_rev.end(); ++umit ) {
+    const uint64_t threshold = static_cast<uint64_t>(
+                                        product_rate*0x1.0p53 ) << 11;
+
+    size_t done = 0;
+    size_t since_checkpoint = 0;
+
+    for( umit = prod_rev.begin(); umit != prod_rev.end(); ++umit, ++done ) {
+        if ( done < skip ) continue;
+        if ( checkpoint.enabled() && since_checkpoint >= CHECKPOINT_ROWS ) {
+            checkpoint.record( bucket_record( done, buckets, 127 ) );
+            since_checkpoint = 0;
+        }
+        if ( product_rate < 1.0 &&
+                        mix64( umit->first ^ mix64( seed ) ) >= threshold ) {
+            continue;
+        }
         if ( umit->second.size() > 1 ) {
+            size_t n = umit->second.size();
+            since_checkpoint += n*(n-1)/2;
+            timer.add_rows( n*(n-1)/2 );
             for( sit_i = umit->second.begin(); sit_i != umit->second.end();
                                                                     ++sit_i ) {
                 for( sit_j = next(sit_i); sit_j != umit->second.end();
@@ -214,11 +445,11 @@ void Reviews::map_edges( const string &dirname ) {
                     if ( *sit_i < *sit_j ) {
                         size_t rev_hash = hash_st( *sit_i );
                         int bucket =  static_cast<int>( rev_hash % 127ul );
-                        fprintf(buckets[bucket],"%zd\t%zd\n", *sit_i, *sit_j );
+                        buckets[bucket]->row( *sit_i, *sit_j );
                     } else {
                         size_t rev_hash = hash_st( *sit_j );
                         int bucket =  static_cast<int>( rev_hash % 127ul );
-                        fprintf(buckets[bucket],"%zd\t%zd\n", *sit_j, *sit_i );
+                        buckets[bucket]->row( *sit_j, *sit_i );
                     }
                 }
             }
@@ -227,54 +458,328 @@ void Reviews::map_edges( const string &dirname ) {
 
 
     for ( int i = 0; i < 127; ++i ) {
-        fclose( buckets[i] );
+        buckets[i]->close();
+        timer.add_file( bucket_filenames[i] );
     }
-}
 
-void Reviews::reduce_edges( const std::string &mapdir, 
-                            const std::string &redfile ) {
+    checkpoint.finish();
+}
 
+/**
+ * Count the pairs of the map buckets into weighted edges. A window of up
+ * to one bucket per thread is counted at a time, as many as keep their
+ * counts within memory_budget bytes. With a checkpoint file, every window
+ * of buckets written is logged with the size of the output, so that a
+ * killed run carries on after the last one.
+ */
+template <typename V>
+void BasicReviews<V>::reduce_edges( const std::string &mapdir, 
+                                    const std::string &redfile,
+                                    const std::string &checkpoint_filename,
+                                    const size_t memory_budget ) {
+
+    StageTimer timer( "reduce_edges" );
 
     string bucket_filenames[127];
-    string base = mapdir + "/bucket_";
-
     for ( int i = 0; i < 127; ++i ) {
-        if ( i < 10 ) {
-            bucket_filenames[i] = base + "00" + std::to_string( i );
-        } else if ( i < 100 ) {
-            bucket_filenames[i] = base + "0" + std::to_string( i );
-        } else {
-            bucket_filenames[i] = base + std::to_string( i );
+        bucket_filenames[i] = bucket_filename( mapdir, i );
+    }
+
+    Checkpoint checkpoint( checkpoint_filename,
+                           "reduce_edges " + Checkpoint::fingerprint(
+                                vector<string>( bucket_filenames,
+                                                bucket_filenames + 127 ) ) );
+
+    // a record is the next bucket and the size of the output before it
+    int resume_at = 0;
+    if ( !checkpoint.records().empty() ) {
+        unsigned long long size = 0;
+        if ( sscanf( checkpoint.records().back().c_str(), "%d %llu",
+                     &resume_at, &size ) != 2 ||
+                            !Checkpoint::cut_back( redfile, size ) ) {
+            resume_at = 0;
         }
     }
 
+    TsvWriter output( redfile, false, 1ul << 20, resume_at > 0 );
+    if ( resume_at == 0 ) output.put( "source\ttarget\tweight\n" );
 
-    FILE *output = fopen_csv( redfile, "w", false );
-    fprintf( output, "source\ttarget\tweight\n" );
+    // a window of buckets is counted in parallel, then written in bucket
+    // order, so the output does not depend on the number of threads
 
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t read = 0;
+    ThreadPool &pool = ThreadPool::instance();
+
+    const int window = static_cast<int>( pool.num_threads() );
+
+    vector<vector<pair<string,long>>> counted( window );
+    vector<size_t> num_lines( window );
+    vector<size_t> num_bytes( window );
+
+    int last;
+
+    for ( int first = resume_at; first < 127; first = last ) {
 
-    for ( int b = 0; b < 127; ++b ) {
+        last = bucket_window( bucket_filenames, first, window,
+                              memory_budget );
 
-        FILE *bucket = fopen_csv( bucket_filenames[b], "r", false );
+        pool.parallel_for( first, last, [&]( size_t begin, size_t end ) {
 
-        unordered_map<string,long> edges;
+            char *line = NULL;
+            size_t len = 0;
+            ssize_t read = 0;
+
+            for ( size_t b = begin; b < end; ++b ) {
+
+                FILE *bucket = fopen_csv( bucket_filenames[b], "r", false );
+
+                unordered_map<string,long> edges;
+
+                while( ( read = getline( &line, &len, bucket ) ) != -1 ) {
+                    ++num_lines[b - first];
+                    num_bytes[b - first] += read;
+                    edges[string(line,(read-1))] += 1;
+                }
+
+                fclose( bucket );
+
+                counted[b - first].assign( edges.begin(), edges.end() );
+            }
+
+            free(line);
+        }, 1 );
+
+        for ( int b = first; b < last; ++b ) {
+
+            timer.add_rows( num_lines[b - first] );
+            timer.add_bytes( num_bytes[b - first] );
+            num_lines[b - first] = 0;
+            num_bytes[b - first] = 0;
+
+            for ( const pair<string,long> &edge : counted[b - first] ) {
+                output.row( edge.first, edge.second );
+            }
+            vector<pair<string,long>>().swap( counted[b - first] );
+        }
+
+        if ( checkpoint.enabled() && last < 127 ) {
+            checkpoint.record( std::to_string( last ) + " " +
+                               std::to_string( output.sync() ) );
+        }
+    }
         
-        while( ( read = getline( &line, &len, bucket ) ) != -1 ) {
-            edges[string(line,(read-1))] += 1;
+    output.close();
+
+    checkpoint.finish();
+}
+
+/**
+ * The earliest and latest review times, both 0 if there are no reviews.
+ */
+template <typename V>
+void BasicReviews<V>::time_range( long &first, long &last ) const {
+
+    require( METADATA_COLUMNS, "times" );
+
+    if ( _reviews.empty() ) {
+        first = 0;
+        last = 0;
+        return;
+    }
+
+    first = std::numeric_limits<long>::max();
+    last = std::numeric_limits<long>::min();
+
+    for ( const metadata<V> &review : _reviews ) {
+        first = std::min( first, review.time );
+        last = std::max( last, review.time );
+    }
+}
+
+/**
+ * Write the reviewer pairs of every product, tagged with each time window
+ * they fall in, into 127 buckets like map_edges. A pair of reviews of the
+ * same product is dated by the later of the two; with max_dt > 0 only
+ * reviews at most max_dt apart are paired. A reviewer counts once per
+ * product, at their first review, so that a single window spanning all
+ * reviews projects the same weights as map_edges.
+ *
+ * The reviews are swept once in time order, keeping for each product the
+ * reviewers still within max_dt. The windows must be ordered by both
+ * begin and end, so that the windows holding the current time form a
+ * range which only moves forward.
+ */
+template <typename V>
+void BasicReviews<V>::map_temporal_edges( const string &dirname,
+                                          const vector<TimeWindow> &windows,
+                                          const long max_dt ) {
+
+    StageTimer timer( "map_temporal_edges" );
+
+    require( METADATA_COLUMNS, "times" );
+
+    const size_t num_windows = windows.size();
+
+    for ( size_t w = 0; w < num_windows; ++w ) {
+        if ( windows[w].begin >= windows[w].end ||
+             ( w > 0 && ( windows[w].begin < windows[w-1].begin ||
+                          windows[w].end < windows[w-1].end ) ) ) {
+            fprintf( stderr, "Time windows must be non-empty and ordered\n" );
+            abort();
         }
+    }
 
-        fclose( bucket );
+    string bucket_filenames[127];
+    for ( int i = 0; i < 127; ++i ) {
+        bucket_filenames[i] = bucket_filename( dirname, i );
+    }
 
-        for ( pair<string,long> edge : edges ) {
-            fprintf( output,"%s\t%ld\n",edge.first.c_str(),edge.second);
+    unique_ptr<TsvWriter> buckets[127];
+    for ( int i = 0; i < 127; ++i ) {
+        buckets[i].reset( new TsvWriter( bucket_filenames[i], true, 1 << 16 ) );
+    }
+
+    vector<long> times( _reviews.size() );
+    for ( size_t r = 0; r < times.size(); ++r ) times[r] = _reviews[r].time;
+    vector<size_t> order = radix_argsort( times.data(), times.size(), false );
+    vector<long>().swap( times );
+
+    std::hash<size_t> hash_st;
+
+    // per product, the (time, reviewer) of the reviews still in reach
+    unordered_map<V,std::deque<pair<long,V>>> recent;
+    unordered_map<V,unordered_set<V>> seen;
+
+    size_t first_window = 0;
+    size_t last_window = 0;
+
+    for ( size_t r : order ) {
+
+        const metadata<V> &review = _reviews[r];
+
+        V product = review.product_id;
+        V reviewer = review.reviewer_id;
+        long t = review.time;
+
+        if ( !prod_rev.count( product ) ) continue;
+        if ( !seen[product].insert( reviewer ).second ) continue;
+
+        // the windows holding t are [first_window,last_window)
+        while ( first_window < num_windows &&
+                windows[first_window].end <= t ) ++first_window;
+        while ( last_window < num_windows &&
+                windows[last_window].begin <= t ) ++last_window;
+
+        std::deque<pair<long,V>> &reach = recent[product];
+
+        if ( max_dt > 0 ) {
+            while ( !reach.empty() && t - reach.front().first > max_dt ) {
+                reach.pop_front();
+            }
         }
 
+        timer.add_rows( ( last_window - first_window )*reach.size() );
+
+        for ( size_t w = first_window; w < last_window; ++w ) {
+            for ( const pair<long,V> &other : reach ) {
+                V lo = std::min( other.second, reviewer );
+                V hi = std::max( other.second, reviewer );
+                int bucket = static_cast<int>( hash_st( lo ) % 127ul );
+                buckets[bucket]->row( lo, hi, w );
+            }
+        }
+
+        reach.push_back( pair<long,V>( t, reviewer ) );
     }
 
-    free(line);
-        
-    fclose( output );
+    for ( int i = 0; i < 127; ++i ) {
+        buckets[i]->close();
+        timer.add_file( bucket_filenames[i] );
+    }
 }
+
+/**
+ * Count the pairs of map_temporal_edges into a sparse list of weighted
+ * edges, "source\ttarget\twindow\tweight", with a row only for the
+ * windows an edge is in. The buckets are counted in windows bounded by
+ * the threads and memory_budget as in reduce_edges.
+ */
+template <typename V>
+void BasicReviews<V>::reduce_temporal_edges( const string &mapdir,
+                                             const string &redfile,
+                                             const size_t num_windows,
+                                             const size_t memory_budget ) {
+
+    StageTimer timer( "reduce_temporal_edges" );
+
+    string bucket_filenames[127];
+    for ( int i = 0; i < 127; ++i ) {
+        bucket_filenames[i] = bucket_filename( mapdir, i );
+    }
+
+    TsvWriter output( redfile );
+    output.put( "source\ttarget\twindow\tweight\n" );
+
+    ThreadPool &pool = ThreadPool::instance();
+
+    const int window = static_cast<int>( pool.num_threads() );
+
+    vector<vector<pair<string,long>>> counted( window );
+    vector<size_t> num_lines( window );
+
+    int last;
+
+    for ( int first = 0; first < 127; first = last ) {
+
+        last = bucket_window( bucket_filenames, first, window,
+                              memory_budget );
+
+        pool.parallel_for( first, last, [&]( size_t begin, size_t end ) {
+
+            char *line = NULL;
+            size_t len = 0;
+            ssize_t read = 0;
+
+            for ( size_t b = begin; b < end; ++b ) {
+
+                FILE *bucket = fopen_csv( bucket_filenames[b], "r", false );
+
+                unordered_map<string,long> edges;
+
+                while( ( read = getline( &line, &len, bucket ) ) != -1 ) {
+                    ++num_lines[b - first];
+                    char *tab = strrchr( line, '\t' );
+                    size_t w = ( tab ? strtoul( tab + 1, NULL, 10 ) : 0 );
+                    if ( tab == NULL || w >= num_windows ) {
+                        fprintf( stderr, "Bad temporal edge in %s\n",
+                                         bucket_filenames[b].c_str() );
+                        abort();
+                    }
+                    edges[string( line, read - 1 )] += 1;
+                }
+
+                fclose( bucket );
+
+                counted[b - first].assign( edges.begin(), edges.end() );
+            }
+
+            free(line);
+        }, 1 );
+
+        for ( int b = first; b < last; ++b ) {
+
+            timer.add_rows( num_lines[b - first] );
+            timer.add_file( bucket_filenames[b] );
+            num_lines[b - first] = 0;
+
+            for ( const pair<string,long> &edge : counted[b - first] ) {
+                output.row( edge.first, edge.second );
+            }
+            vector<pair<string,long>>().swap( counted[b - first] );
+        }
+    }
+
+    output.close();
+}
+
+template class BasicReviews<uint32_t>;
+template class BasicReviews<uint64_t>;
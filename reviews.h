@@ -1,16 +1,20 @@
 #ifndef REVIEWS_H
 #define REVIEWS_H
 
+#include <cstdint>
 #include <string>
 #include <cstring>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
 
+#include "types.h"
+
+template <typename V>
 struct metadata {
 
-    long product_id;
-    long reviewer_id;
+    V product_id;
+    V reviewer_id;
     float score;
     short help;
     short outof;
@@ -18,34 +22,70 @@ struct metadata {
 
 };
 
-class Reviews {
+/**
+ * A half open interval [begin,end) of review times.
+ */
+struct TimeWindow {
+    long begin;
+    long end;
+};
+
+/**
+ * The optional columns of the metadata, for the 'columns' of a
+ * BasicReviews; the product and reviewer ids are always read.
+ */
+enum ReviewColumns {
+    TITLE_COLUMN = 1,           // title hashes, for condense_links
+    SCREEN_NAME_COLUMN = 2,     // for output_reviewer_index
+    METADATA_COLUMNS = 4,       // helpfulness, score and time, for the
+                                // temporal projection
+    ALL_COLUMNS = 7
+};
+
+/**
+ * The reviews of a SNAP category. V is the integer type of the product,
+ * reviewer and title ids.
+ *
+ * Only the columns asked for are parsed and kept; a run which only
+ * projects the edges needs neither the screen names nor the metadata of
+ * every review. Titles are kept as 64 bit hashes, which is all that
+ * condense_links compares.
+ */
+template <typename V>
+class BasicReviews {
 
  private:
-    std::vector<metadata> _reviews;
+    std::vector<metadata<V>> _reviews;
 
     std::vector<std::string> reviewers;
     std::vector<std::string> screen_names;
     std::vector<std::string> products;
-    std::vector<std::string> titles;
 
-    std::unordered_map<std::string, size_t> rev_index;
-    std::unordered_map<std::string, size_t> prod_index;
-    std::unordered_map<std::string, size_t> title_index;
+    std::unordered_map<std::string, V> rev_index;
+    std::unordered_map<std::string, V> prod_index;
+    std::unordered_map<uint64_t, V> title_index;
 
 
-    std::vector<long> rev_num_revs;
-    std::unordered_map< size_t, std::unordered_set<size_t> > prod_rev;
-    std::unordered_map< size_t, std::unordered_set<size_t> > title_prod;
+    std::vector<V> rev_num_revs;
+    std::unordered_map< V, std::unordered_set<V> > prod_rev;
+    std::unordered_map< V, std::unordered_set<V> > title_prod;
     
     std::string _filename;
+    unsigned _columns;
+    size_t _num_rows;
 
  public:
-    Reviews( const std::string &filename );
-    Reviews( const char *filename );
+    typedef V vertex_type;
+
+    BasicReviews( const std::string &filename,
+                  const unsigned columns = ALL_COLUMNS );
+    BasicReviews( const char *filename,
+                  const unsigned columns = ALL_COLUMNS );
 
     size_t num_reviews() {
         size_t _num_revs = 0;
-        for ( std::pair<size_t, std::unordered_set<size_t> > pr : prod_rev ) {
+        for ( const std::pair<const V, std::unordered_set<V> > &pr :
+                                                                prod_rev ) {
             _num_revs += pr.second.size();    
         }
         return _num_revs;
@@ -61,18 +101,51 @@ class Reviews {
         return title_index.size();
     }
 
+    long product_index( const std::string &product_id ) const {
+        auto pit = prod_index.find( product_id );
+        return ( pit == prod_index.end() ? -1
+                                         : static_cast<long>( pit->second ) );
+    }
+
+    const std::unordered_map< V, std::unordered_set<V> >&
+                                            product_reviewers() const {
+        return prod_rev;
+    }
+
+    void reviewer_products( std::vector<std::vector<uint32_t>> &rev_prods )
+                                                                    const;
+
     long condense_links();
     void reviews_per_reviewer();
     void output_reviewer_index( const std::string &filename );
-    void map_edges( const std::string &dirname );
+    void map_edges( const std::string &dirname,
+                    const double product_rate = 1.0,
+                    const uint64_t seed = 1,
+                    const std::string &checkpoint_filename = "" );
 
     static void reduce_edges( const std::string &mapdir, 
-                              const std::string &redfile );
+                              const std::string &redfile,
+                              const std::string &checkpoint_filename = "",
+                              const size_t memory_budget = 1ul << 30 );
+
+    void time_range( long &first, long &last ) const;
+    void map_temporal_edges( const std::string &dirname,
+                             const std::vector<TimeWindow> &windows,
+                             const long max_dt = 0 );
+
+    static void reduce_temporal_edges( const std::string &mapdir,
+                                       const std::string &redfile,
+                                       const size_t num_windows,
+                                       const size_t memory_budget = 1ul << 30 );
 
  private:
     void load_reviews( const std::string &filename );
 
+    void require( const unsigned column, const char *what ) const;
+
 
 };
 
+typedef BasicReviews<vertex_t> Reviews;
+
 #endif // REVIEWS_H
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "misc.h"
+#include "sample.h"
+#include "tsv_writer.h"
+
+using std::string;
+using std::vector;
+
+
+EdgeSample::EdgeSample( const double rate,
+                        const SampleMode mode,
+                        const uint64_t seed,
+                        const size_t num_groups ) {
+
+    if ( rate <= 0.0 || rate > 1.0 ) {
+        fprintf( stderr, "Sample rate must be in (0,1]: %g\n", rate );
+        abort();
+    }
+    if ( num_groups < 2 || num_groups > 255 ) {
+        fprintf( stderr, "Number of sample groups must be in [2,255]\n" );
+        abort();
+    }
+
+    _rate = rate;
+    _mode = mode;
+    _seed = seed;
+    _num_groups = num_groups;
+    _product_rate = 1.0;
+}
+
+/**
+ * The size of each vertex, required for SAMPLE_DEGREE. Vertices past the
+ * end count as size 1.
+ */
+void EdgeSample::set_sizes( const vector<double> &sizes ) {
+    _sizes = sizes;
+}
+
+/**
+ * Whether edge (source,target) is in the sample; if so 'scale' is the
+ * inverse of its inclusion probability and 'group' its jackknife group.
+ */
+bool EdgeSample::keep( const size_t source, const size_t target,
+                       double &scale, uint8_t &group ) const {
+
+    uint64_t lo = std::min( source, target );
+    uint64_t hi = std::max( source, target );
+
+    uint64_t h = mix64( mix64( lo ^ _seed ) + hi );
+
+    double p = _rate;
+
+    if ( _mode == SAMPLE_DEGREE ) {
+        if ( _sizes.empty() ) {
+            fprintf( stderr, "Degree stratified sample without sizes\n" );
+            abort();
+        }
+        double ds = ( source < _sizes.size() ? _sizes[source] : 1.0 );
+        double dt = ( target < _sizes.size() ? _sizes[target] : 1.0 );
+        double d = std::max( 1.0, std::min( ds, dt ) );
+        p = std::min( 1.0, std::max( _rate, 1.0/d ) );
+    }
+
+    double u = static_cast<double>( h >> 11 )*0x1.0p-53;
+    if ( u >= p ) return false;
+
+    scale = 1.0/p;
+    group = static_cast<uint8_t>( mix64( h ) % _num_groups );
+
+    return true;
+}
+
+Estimate jackknife( const double full, const vector<double> &replicates ) {
+
+    double k = static_cast<double>( replicates.size() );
+
+    double mean = 0.0;
+    for ( double r : replicates ) mean += r;
+    mean /= k;
+
+    double var = 0.0;
+    for ( double r : replicates ) var += ( r - mean )*( r - mean );
+    var *= ( k - 1.0 )/k;
+
+    double half = 1.96*sqrt( var );
+
+    Estimate estimate;
+    estimate.value = full;
+    estimate.lower = full - half;
+    estimate.upper = full + half;
+
+    return estimate;
+}
+
+SampleMode sample_mode( const string &name ) {
+
+    if ( name == "uniform" ) return SAMPLE_UNIFORM;
+    if ( name == "degree" ) return SAMPLE_DEGREE;
+
+    fprintf( stderr, "Unknown sample mode: %s\n", name.c_str() );
+    abort();
+}
+
+void write_estimate( const string &filename,
+                     const string &name,
+                     const Estimate &estimate ) {
+
+    TsvWriter output( filename );
+
+    output.put( "statistic\testimate\tlower\tupper\n" );
+    output.row( name, Fixed( estimate.value, 7 ), Fixed( estimate.lower, 7 ),
+                Fixed( estimate.upper, 7 ) );
+    output.close();
+}
@@ -0,0 +1,96 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A point estimate with a 95% confidence interval.
+ */
+struct Estimate {
+    double value;
+    double lower;
+    double upper;
+};
+
+enum SampleMode {
+    SAMPLE_UNIFORM,
+    SAMPLE_DEGREE
+};
+
+/**
+ * A deterministic sample of the edges of a graph, for the approximate
+ * Graph::sampled_* analytics.
+ *
+ * Whether an edge is kept depends only on a hash of its end points, so
+ * every pass over the edge file sees the same sample. With SAMPLE_UNIFORM
+ * every edge is kept with probability 'rate'. With SAMPLE_DEGREE an edge
+ * whose end points have sizes (degrees, or a proxy such as the number of
+ * reviews) d_s and d_t is kept with probability
+ *
+ *     min( 1, max( rate, 1/min( d_s, d_t ) ) )
+ *
+ * so that low degree vertices, which a uniform sample would miss
+ * entirely, keep about one edge each. The estimators weight every kept
+ * edge by the inverse of its probability (Horvitz-Thompson).
+ *
+ * The kept edges are split into num_groups random groups and intervals
+ * come from the delete-a-group jackknife.
+ *
+ * If the edge file was projected from a sample of the products, set
+ * product_rate: weights are scaled up to match. The intervals only cover
+ * the edge sampling, not the product sampling.
+ */
+class EdgeSample {
+
+ private:
+    double _rate;
+    SampleMode _mode;
+    uint64_t _seed;
+    size_t _num_groups;
+    double _product_rate;
+    std::vector<double> _sizes;
+
+ public:
+    EdgeSample( const double rate,
+                const SampleMode mode = SAMPLE_UNIFORM,
+                const uint64_t seed = 1,
+                const size_t num_groups = 10 );
+
+    void set_sizes( const std::vector<double> &sizes );
+
+    void set_product_rate( const double product_rate ) {
+        _product_rate = product_rate;
+    }
+
+    double product_rate() const {
+        return _product_rate;
+    }
+
+    size_t num_groups() const {
+        return _num_groups;
+    }
+
+    bool keep( const size_t source, const size_t target,
+               double &scale, uint8_t &group ) const;
+
+};
+
+/**
+ * The jackknife interval of a statistic from its value on the full sample
+ * and its values with each group left out.
+ */
+Estimate jackknife( const double full, const std::vector<double> &replicates );
+
+/**
+ * Parse a sample mode name, "uniform" or "degree"; aborts on others.
+ */
+SampleMode sample_mode( const std::string &name );
+
+void write_estimate( const std::string &filename,
+                     const std::string &name,
+                     const Estimate &estimate );
+
+#endif // SAMPLE_H
@@ -0,0 +1,384 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "misc.h"
+#include "server.h"
+#include "tsv_reader.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+
+volatile sig_atomic_t stop_serving = 0;
+
+// the longest a stop signal waits to be seen by the accept loop
+const int ACCEPT_POLL_MS = 200;
+
+void handle_stop( int ) {
+    stop_serving = 1;
+}
+
+/**
+ * Keep the k entries of largest value, largest first, ties in the order
+ * they were given.
+ */
+void keep_top( vector<QueryEntry> &entries, const size_t k ) {
+
+    vector<uint64_t> values( entries.size() );
+    for ( size_t e = 0; e < entries.size(); ++e ) {
+        values[e] = entries[e].value;
+    }
+
+    vector<size_t> top = top_indexes( values.data(), values.size(), k );
+
+    vector<QueryEntry> kept( top.size() );
+    for ( size_t e = 0; e < top.size(); ++e ) kept[e] = entries[top[e]];
+    entries.swap( kept );
+}
+
+/**
+ * Read in a two column node/value file, such as the output of
+ * cluster_stats or eigen_vect_cent.
+ */
+void load_column( const string &filename, vector<uint32_t> &column ) {
+
+    TsvReader reader( filename, 2 );
+
+    vector<uint64_t> rows;
+    size_t num_rows;
+
+    while( ( num_rows = reader.read_rows( rows ) ) > 0 ) {
+        for ( size_t r = 0; r < num_rows; ++r ) {
+            if ( rows[2*r] < column.size() ) column[rows[2*r]] = rows[2*r+1];
+        }
+    }
+}
+
+bool read_full( const int fd, void *buf, size_t len ) {
+    char *p = static_cast<char*>( buf );
+    while ( len > 0 ) {
+        ssize_t n = read( fd, p, len );
+        if ( n < 0 && errno == EINTR ) continue;
+        if ( n <= 0 ) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool write_full( const int fd, const void *buf, size_t len ) {
+    const char *p = static_cast<const char*>( buf );
+    while ( len > 0 ) {
+        ssize_t n = write( fd, p, len );
+        if ( n < 0 && errno == EINTR ) continue;
+        if ( n <= 0 ) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+void append( vector<char> &reply, const void *data, const size_t len ) {
+    const char *p = static_cast<const char*>( data );
+    reply.insert( reply.end(), p, p + len );
+}
+
+}
+
+
+QueryServer::QueryServer( const Reviews &reviews,
+                          const CSR &graph,
+                          const string &membership_filename,
+                          const string &evc_filename ) :
+                                    _reviews( reviews ), _graph( graph ) {
+
+    _component.assign( _graph.num_verts(), 0 );
+    load_column( membership_filename, _component );
+
+    _rank.assign( _graph.num_verts(), 0 );
+    load_column( evc_filename, _rank );
+}
+
+void QueryServer::serve( const string &socket_path ) {
+
+    sockaddr_un addr;
+    memset( &addr, 0, sizeof(addr) );
+    addr.sun_family = AF_UNIX;
+
+    if ( socket_path.size() >= sizeof(addr.sun_path) ) {
+        fprintf( stderr, "Socket path too long: %s\n", socket_path.c_str() );
+        abort();
+    }
+    strcpy( addr.sun_path, socket_path.c_str() );
+
+    int listen_fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if ( listen_fd < 0 ) {
+        perror( "socket" );
+        abort();
+    }
+
+    unlink( socket_path.c_str() );
+
+    if ( bind( listen_fd, reinterpret_cast<sockaddr*>( &addr ),
+                                                    sizeof(addr) ) < 0 ||
+         listen( listen_fd, 128 ) < 0 ) {
+        fprintf( stderr, "Could not listen on: %s\n", socket_path.c_str() );
+        abort();
+    }
+
+    // no SA_RESTART, so that a signal interrupts poll()
+    struct sigaction sa;
+    memset( &sa, 0, sizeof(sa) );
+    sa.sa_handler = handle_stop;
+    sigaction( SIGINT, &sa, NULL );
+    sigaction( SIGTERM, &sa, NULL );
+    signal( SIGPIPE, SIG_IGN );
+
+    // the connection threads leave SIGINT and SIGTERM to this one, so
+    // that they interrupt poll()
+    sigset_t stop_signals, old_mask;
+    sigemptyset( &stop_signals );
+    sigaddset( &stop_signals, SIGINT );
+    sigaddset( &stop_signals, SIGTERM );
+
+    fprintf( stderr, "Serving queries on %s\n", socket_path.c_str() );
+
+    vector<std::thread> threads;
+
+    // a signal arriving between the check of stop_serving and a blocking
+    // accept() would go unseen, so the loop waits in bounded polls and
+    // accepts without blocking
+    fcntl( listen_fd, F_SETFL, fcntl( listen_fd, F_GETFL ) | O_NONBLOCK );
+
+    while ( !stop_serving ) {
+
+        struct pollfd listener = { listen_fd, POLLIN, 0 };
+        int ready = poll( &listener, 1, ACCEPT_POLL_MS );
+
+        if ( ready < 0 && errno != EINTR ) {
+            perror( "poll" );
+            break;
+        }
+        if ( ready <= 0 ) continue;
+
+        int fd = accept( listen_fd, NULL, NULL );
+
+        if ( fd < 0 ) {
+            if ( errno == EINTR || errno == ECONNABORTED ||
+                 errno == EAGAIN || errno == EWOULDBLOCK ) continue;
+            perror( "accept" );
+            break;
+        }
+
+        join_finished( threads );
+
+        {
+            std::lock_guard<std::mutex> lock( _connections_mutex );
+            _open_fds.push_back( fd );
+        }
+
+        pthread_sigmask( SIG_BLOCK, &stop_signals, &old_mask );
+        threads.emplace_back( &QueryServer::handle_connection, this, fd );
+        pthread_sigmask( SIG_SETMASK, &old_mask, NULL );
+    }
+
+    fprintf( stderr, "Shutting down ...\n" );
+
+    close( listen_fd );
+    unlink( socket_path.c_str() );
+
+    // wake the connections waiting for a request, and wait for them
+    {
+        std::lock_guard<std::mutex> lock( _connections_mutex );
+        for ( int fd : _open_fds ) shutdown( fd, SHUT_RDWR );
+    }
+    for ( std::thread &thread : threads ) thread.join();
+    _finished.clear();
+}
+
+/**
+ * Join the connection threads which have returned.
+ */
+void QueryServer::join_finished( vector<std::thread> &threads ) {
+
+    vector<std::thread::id> finished;
+    {
+        std::lock_guard<std::mutex> lock( _connections_mutex );
+        finished.swap( _finished );
+    }
+
+    for ( std::thread::id id : finished ) {
+        for ( size_t t = 0; t < threads.size(); ++t ) {
+            if ( threads[t].get_id() == id ) {
+                threads[t].join();
+                threads[t] = std::move( threads.back() );
+                threads.pop_back();
+                break;
+            }
+        }
+    }
+}
+
+void QueryServer::handle_connection( const int fd ) {
+
+    QueryRequest request;
+    string product_id;
+    vector<char> reply;
+
+    while ( read_full( fd, &request, sizeof(request) ) ) {
+
+        product_id.clear();
+        if ( request.op == QUERY_PRODUCT_ID ) {
+            if ( request.k > MAX_PRODUCT_ID_LENGTH ) {
+                QueryReply header;
+                header.status = QUERY_BAD_ID;
+                header.count = 0;
+                header.value = 0;
+                write_full( fd, &header, sizeof(header) );
+                break;
+            }
+            product_id.resize( request.k );
+            if ( !read_full( fd, &product_id[0], request.k ) ) break;
+        }
+
+        reply.clear();
+        answer( request, product_id, reply );
+
+        if ( !write_full( fd, reply.data(), reply.size() ) ) break;
+    }
+
+    // off the list before the descriptor can be reused
+    {
+        std::lock_guard<std::mutex> lock( _connections_mutex );
+        _open_fds.erase( std::find( _open_fds.begin(), _open_fds.end(), fd ) );
+        _finished.push_back( std::this_thread::get_id() );
+    }
+
+    close( fd );
+}
+
+void QueryServer::answer( const QueryRequest &request,
+                          const string &product_id,
+                          vector<char> &reply ) const {
+
+    QueryReply header;
+    header.status = QUERY_OK;
+    header.count = 0;
+    header.value = 0;
+
+    vector<QueryEntry> entries;
+
+    const size_t v = request.id;
+    const bool is_vertex = ( v < _graph.num_verts() );
+
+    switch ( request.op ) {
+
+        case QUERY_NEIGHBORS:
+        case QUERY_TOP_REVIEWER: {
+            if ( !is_vertex ) {
+                header.status = QUERY_BAD_ID;
+                break;
+            }
+            const uint32_t *nbrs = _graph.neighbors( v );
+            const uint32_t *wgts = _graph.weights( v );
+            size_t deg = _graph.degree( v );
+
+            entries.resize( deg );
+            for ( size_t e = 0; e < deg; ++e ) {
+                entries[e].id = nbrs[e];
+                entries[e].value = wgts[e];
+            }
+
+            if ( request.op == QUERY_TOP_REVIEWER ) {
+                keep_top( entries, request.k );
+            }
+            header.value = _graph.weighted_degree( v );
+            break;
+        }
+
+        case QUERY_DEGREE:
+            if ( !is_vertex ) {
+                header.status = QUERY_BAD_ID;
+                break;
+            }
+            header.value = _graph.weighted_degree( v );
+            break;
+
+        case QUERY_COMPONENT:
+            if ( !is_vertex ) {
+                header.status = QUERY_BAD_ID;
+                break;
+            }
+            header.value = _component[v];
+            break;
+
+        case QUERY_RANK:
+            if ( !is_vertex ) {
+                header.status = QUERY_BAD_ID;
+                break;
+            }
+            header.value = _rank[v];
+            break;
+
+        case QUERY_TOP_PRODUCT: {
+            if ( request.id >
+                    std::numeric_limits<Reviews::vertex_type>::max() ) {
+                header.status = QUERY_BAD_ID;
+                break;
+            }
+            auto pit = _reviews.product_reviewers().find( request.id );
+            if ( pit == _reviews.product_reviewers().end() ) {
+                header.status = QUERY_BAD_ID;
+                break;
+            }
+            for ( size_t rev : pit->second ) {
+                QueryEntry entry;
+                entry.id = rev;
+                entry.value = ( rev < _graph.num_verts() ?
+                                        _graph.weighted_degree( rev ) : 0 );
+                entries.push_back( entry );
+            }
+            keep_top( entries, request.k );
+            header.value = pit->second.size();
+            break;
+        }
+
+        case QUERY_PRODUCT_ID: {
+            long prod_id = _reviews.product_index( product_id );
+            if ( prod_id < 0 ) {
+                header.status = QUERY_BAD_ID;
+                break;
+            }
+            header.value = prod_id;
+            break;
+        }
+
+        default:
+            header.status = QUERY_BAD_OP;
+            break;
+    }
+
+    header.count = entries.size();
+
+    append( reply, &header, sizeof(header) );
+    if ( !entries.empty() ) {
+        append( reply, entries.data(), entries.size()*sizeof(QueryEntry) );
+    }
+}
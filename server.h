@@ -0,0 +1,100 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "csr.h"
+#include "reviews.h"
+
+/**
+ * The binary protocol spoken over the query socket. Every request is a
+ * fixed 16 byte header; every reply is a 16 byte header followed by
+ * 'count' entries. All fields are in host byte order.
+ */
+enum QueryOp : uint32_t {
+    QUERY_NEIGHBORS    = 1,   // co-reviewers of a reviewer and the weights
+    QUERY_DEGREE       = 2,   // weighted degree of a reviewer
+    QUERY_COMPONENT    = 3,   // connected component of a reviewer
+    QUERY_RANK         = 4,   // eigenvector centrality rank of a reviewer
+    QUERY_TOP_REVIEWER = 5,   // top-k co-reviewers of a reviewer
+    QUERY_TOP_PRODUCT  = 6,   // top-k reviewers of a product by degree
+    QUERY_PRODUCT_ID   = 7    // product index of a product ID string
+};
+
+enum QueryStatus : uint32_t {
+    QUERY_OK     = 0,
+    QUERY_BAD_OP = 1,
+    QUERY_BAD_ID = 2
+};
+
+/**
+ * The longest product ID a QUERY_PRODUCT_ID request may carry. A longer
+ * one is answered QUERY_BAD_ID and the connection closed, since the
+ * string is not read.
+ */
+const uint32_t MAX_PRODUCT_ID_LENGTH = 256;
+
+struct QueryRequest {
+    uint32_t op;
+    uint32_t k;     // number of results, or the length of the product ID
+                    // string which follows a QUERY_PRODUCT_ID request
+    uint64_t id;
+};
+
+struct QueryReply {
+    uint32_t status;
+    uint32_t count;
+    uint64_t value;
+};
+
+struct QueryEntry {
+    uint64_t id;
+    uint64_t value;
+};
+
+/**
+ * A long running server which holds the reviews and the co-review graph
+ * in memory and answers queries over a Unix domain socket. Each client
+ * connection is served by its own thread; all of them share the loaded
+ * data read-only. serve() returns once every connection is closed: on
+ * SIGINT or SIGTERM it shuts the open client sockets down and joins
+ * their threads.
+ */
+class QueryServer {
+
+ private:
+    const Reviews &_reviews;
+    const CSR &_graph;
+    std::vector<uint32_t> _component;
+    std::vector<uint32_t> _rank;
+
+    // the sockets of the open connections, and the threads which have
+    // finished and wait to be joined
+    std::mutex _connections_mutex;
+    std::vector<int> _open_fds;
+    std::vector<std::thread::id> _finished;
+
+ public:
+    QueryServer( const Reviews &reviews,
+                 const CSR &graph,
+                 const std::string &membership_filename,
+                 const std::string &evc_filename );
+
+    void serve( const std::string &socket_path );
+
+ private:
+    void handle_connection( const int fd );
+
+    void join_finished( std::vector<std::thread> &threads );
+
+    void answer( const QueryRequest &request,
+                 const std::string &product_id,
+                 std::vector<char> &reply ) const;
+
+};
+
+#endif // SERVER_H
@@ -0,0 +1,843 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "edge_stream.h"
+#include "misc.h"
+#include "sharded_graph.h"
+#include "stats.h"
+#include "tsv_reader.h"
+#include "tsv_writer.h"
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+// one sharded analytic at a time, so that no worker inherits the channels
+// of another run and keeps them open
+std::mutex sharded_run;
+
+}
+
+/**
+ * Open the partition in shard_dir, if there is one for num_verts.
+ */
+template <typename V, typename W>
+BasicShardedGraph<V,W>::BasicShardedGraph( const size_t num_verts,
+                                           const string &shard_dir,
+                                           const string &transport ) {
+    _num_verts = num_verts;
+    _shard_dir = shard_dir;
+    _transport_kind = transport;
+    _in_worker = false;
+    _shard = 0;
+
+    string ranges_filename = _shard_dir + "/ranges.tsv";
+
+    struct stat st;
+    if ( stat( ranges_filename.c_str(), &st ) != 0 ) return;
+
+    TsvReader reader( ranges_filename, 2 );
+    vector<uint64_t> rows;
+    size_t num_rows;
+
+    while ( ( num_rows = reader.read_rows( rows ) ) > 0 ) {
+        for ( size_t r = 0; r < num_rows; ++r ) {
+            if ( _bounds.empty() ) _bounds.push_back( rows[2*r] );
+            _bounds.push_back( rows[2*r + 1] );
+        }
+    }
+
+    // a partition of another graph, to be replaced
+    if ( _bounds.empty() || _bounds.front() != 0 ||
+                                    _bounds.back() != _num_verts ) {
+        _bounds.clear();
+    }
+}
+
+template <typename V, typename W>
+string BasicShardedGraph<V,W>::shard_filename( const size_t s,
+                                               const string &suffix ) const {
+    string number = std::to_string( s );
+    if ( number.size() < 3 ) number.insert( 0, 3 - number.size(), '0' );
+    return _shard_dir + "/shard_" + number + suffix;
+}
+
+template <typename V, typename W>
+size_t BasicShardedGraph<V,W>::owner( const V v ) const {
+    return std::upper_bound( _bounds.begin(), _bounds.end(), v ) -
+                                                        _bounds.begin() - 1;
+}
+
+/**
+ * Fork a worker per shard to run 'work' and attach the caller as the
+ * coordinator. join() waits for the workers.
+ */
+template <typename V, typename W>
+void BasicShardedGraph<V,W>::spawn( const std::function<void()> &work ) {
+
+    if ( num_shards() == 0 ) {
+        fprintf( stderr, "No partition in %s\n", _shard_dir.c_str() );
+        abort();
+    }
+
+    sharded_run.lock();
+
+    _transport = make_transport( _transport_kind, num_shards() );
+
+    fflush( stdout );
+
+    for ( size_t s = 0; s < num_shards(); ++s ) {
+
+        pid_t pid = fork();
+
+        if ( pid < 0 ) {
+            fprintf( stderr, "Could not fork shard %zd: %s\n",
+                             s, strerror( errno ) );
+            abort();
+        }
+
+        if ( pid == 0 ) {
+            _in_worker = true;
+            _shard = s;
+            _transport->attach( s );
+            work();
+            _exit( 0 );
+        }
+
+        _workers.push_back( pid );
+    }
+
+    _transport->attach( Transport::COORDINATOR );
+}
+
+template <typename V, typename W>
+void BasicShardedGraph<V,W>::join() {
+
+    bool failed = false;
+
+    for ( pid_t pid : _workers ) {
+        int status = 0;
+        while ( waitpid( pid, &status, 0 ) < 0 && errno == EINTR ) {}
+        if ( !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 ) {
+            failed = true;
+        }
+    }
+
+    _workers.clear();
+    _transport.reset();
+    _routes.clear();
+    _export_offsets.clear();
+
+    sharded_run.unlock();
+
+    if ( failed ) {
+        fprintf( stderr, "A shard worker failed\n" );
+        abort();
+    }
+}
+
+/**
+ * Cut the vertices into num_shards ranges with about the same number of
+ * edge ends and split the edges over them, then let every worker convert
+ * its shard to local ids.
+ */
+template <typename V, typename W>
+void BasicShardedGraph<V,W>::partition( const string &edge_filename,
+                                        const size_t num_shards ) {
+
+    StageTimer timer( "partition" );
+    timer.add_file( edge_filename );
+
+    if ( num_shards == 0 ) {
+        fprintf( stderr, "Cannot partition into 0 shards\n" );
+        abort();
+    }
+
+    mkdir( _shard_dir.c_str(), 0755 );
+
+    BasicEdgeStream<V,W> edges( edge_filename );
+
+    const BasicEdge<V,W> *batch;
+    size_t count;
+
+    vector<uint64_t> degree( _num_verts );
+    uint64_t num_ends = 0;
+
+    edges.rewind();
+    while( ( batch = edges.next_batch( count ) ) != NULL ) {
+        timer.add_rows( count );
+        for ( size_t e = 0; e < count; ++e ) {
+            ++degree[batch[e].source];
+            ++degree[batch[e].target];
+        }
+        num_ends += 2*count;
+    }
+
+    _bounds.assign( 1, 0 );
+    uint64_t ends = 0;
+    size_t v = 0;
+    for ( size_t s = 1; s < num_shards; ++s ) {
+        uint64_t target = num_ends*s/num_shards;
+        while ( v < _num_verts && ends + degree[v] <= target ) {
+            ends += degree[v++];
+        }
+        _bounds.push_back( v );
+    }
+    _bounds.push_back( _num_verts );
+
+    vector<uint64_t>().swap( degree );
+
+    vector<unique_ptr<TsvWriter>> shards;
+    for ( size_t s = 0; s < num_shards; ++s ) {
+        shards.emplace_back( new TsvWriter( shard_filename( s, ".split" ) ) );
+        shards.back()->put( "source\ttarget\tweight\n" );
+    }
+
+    edges.rewind();
+    while( ( batch = edges.next_batch( count ) ) != NULL ) {
+        for ( size_t e = 0; e < count; ++e ) {
+            size_t s = owner( batch[e].source );
+            size_t t = owner( batch[e].target );
+            shards[s]->row( batch[e].source, batch[e].target,
+                            batch[e].weight );
+            if ( t != s ) {
+                shards[t]->row( batch[e].source, batch[e].target,
+                                batch[e].weight );
+            }
+        }
+    }
+
+    for ( unique_ptr<TsvWriter> &shard : shards ) shard->close();
+
+    spawn( [&]() { localize(); } );
+    join();
+
+    TsvWriter ranges( _shard_dir + "/ranges.tsv" );
+    ranges.put( "first\tend\n" );
+    for ( size_t s = 0; s < num_shards; ++s ) {
+        ranges.row( _bounds[s], _bounds[s + 1] );
+    }
+    ranges.close();
+
+    fprintf( stderr, "Partitioned %zd vertices into %zd shards\n",
+                     _num_verts, num_shards );
+}
+
+/**
+ * In a worker: find the ghosts of its shard and rewrite the edges in
+ * local ids.
+ */
+template <typename V, typename W>
+void BasicShardedGraph<V,W>::localize() {
+
+    const V first = _bounds[_shard];
+    const V end = _bounds[_shard + 1];
+    const size_t owned = num_owned( _shard );
+
+    string split_filename = shard_filename( _shard, ".split" );
+
+    BasicEdgeStream<V,W> edges( split_filename );
+
+    const BasicEdge<V,W> *batch;
+    size_t count;
+
+    vector<bool> is_ghost( _num_verts );
+
+    edges.rewind();
+    while( ( batch = edges.next_batch( count ) ) != NULL ) {
+        for ( size_t e = 0; e < count; ++e ) {
+            V source = batch[e].source;
+            V target = batch[e].target;
+            if ( source < first || source >= end ) is_ghost[source] = true;
+            if ( target < first || target >= end ) is_ghost[target] = true;
+        }
+    }
+
+    _ghosts.clear();
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        if ( is_ghost[v] ) _ghosts.push_back( v );
+    }
+    vector<bool>().swap( is_ghost );
+
+    auto local = [&]( const V v ) -> V {
+        if ( v >= first && v < end ) return v - first;
+        return owned + ( std::lower_bound( _ghosts.begin(), _ghosts.end(),
+                                           v ) - _ghosts.begin() );
+    };
+
+    TsvWriter out( shard_filename( _shard, ".tsv" ) );
+    out.put( "source\ttarget\tweight\n" );
+
+    edges.rewind();
+    while( ( batch = edges.next_batch( count ) ) != NULL ) {
+        for ( size_t e = 0; e < count; ++e ) {
+            out.row( local( batch[e].source ), local( batch[e].target ),
+                     batch[e].weight );
+        }
+    }
+    out.close();
+
+    TsvWriter ghosts( shard_filename( _shard, ".ghosts" ) );
+    ghosts.put( "vertex\n" );
+    for ( V ghost : _ghosts ) ghosts.row( ghost );
+    ghosts.close();
+
+    unlink( split_filename.c_str() );
+}
+
+/**
+ * Set up the exchange of boundary values. Every worker sends the ids of
+ * its ghosts; the coordinator tells every owner which of its vertices
+ * are read elsewhere, and keeps where each ghost's value comes from.
+ */
+template <typename V, typename W>
+void BasicShardedGraph<V,W>::connect() {
+
+    if ( _in_worker ) {
+
+        TsvReader reader( shard_filename( _shard, ".ghosts" ), 1 );
+        vector<uint64_t> rows;
+        size_t num_rows;
+
+        _ghosts.clear();
+        while ( ( num_rows = reader.read_rows( rows ) ) > 0 ) {
+            for ( size_t r = 0; r < num_rows; ++r ) {
+                _ghosts.push_back( rows[r] );
+            }
+        }
+
+        uint64_t num_ghosts = _ghosts.size();
+        _transport->send( _shard, &num_ghosts, sizeof(num_ghosts) );
+        _transport->send( _shard, _ghosts.data(), num_ghosts*sizeof(V) );
+
+        uint64_t num_exports = 0;
+        _transport->receive( _shard, &num_exports, sizeof(num_exports) );
+        _exports.resize( num_exports );
+        _transport->receive( _shard, _exports.data(), num_exports*sizeof(V) );
+
+        for ( V &v : _exports ) v -= _bounds[_shard];
+
+        return;
+    }
+
+    const size_t num = num_shards();
+
+    vector<vector<V>> ghosts( num );
+    for ( size_t s = 0; s < num; ++s ) {
+        uint64_t num_ghosts = 0;
+        _transport->receive( s, &num_ghosts, sizeof(num_ghosts) );
+        ghosts[s].resize( num_ghosts );
+        _transport->receive( s, ghosts[s].data(), num_ghosts*sizeof(V) );
+    }
+
+    vector<vector<V>> exports( num );
+    for ( size_t s = 0; s < num; ++s ) {
+        for ( V ghost : ghosts[s] ) exports[owner( ghost )].push_back( ghost );
+    }
+
+    _export_offsets.assign( 1, 0 );
+    for ( size_t t = 0; t < num; ++t ) {
+        std::sort( exports[t].begin(), exports[t].end() );
+        exports[t].erase( std::unique( exports[t].begin(), exports[t].end() ),
+                          exports[t].end() );
+        _export_offsets.push_back( _export_offsets.back() +
+                                   exports[t].size() );
+    }
+
+    _routes.assign( num, vector<size_t>() );
+    for ( size_t s = 0; s < num; ++s ) {
+        _routes[s].reserve( ghosts[s].size() );
+        for ( V ghost : ghosts[s] ) {
+            const vector<V> &from = exports[owner( ghost )];
+            _routes[s].push_back( _export_offsets[owner( ghost )] +
+                                  ( std::lower_bound( from.begin(),
+                                                      from.end(), ghost ) -
+                                    from.begin() ) );
+        }
+    }
+
+    for ( size_t t = 0; t < num; ++t ) {
+        uint64_t num_exports = exports[t].size();
+        _transport->send( t, &num_exports, sizeof(num_exports) );
+        _transport->send( t, exports[t].data(), num_exports*sizeof(V) );
+    }
+
+    fprintf( stderr, "Boundary: %zd values routed per exchange\n",
+                     _export_offsets.back() );
+}
+
+/**
+ * In a worker: send the values of its vertices which are ghosts elsewhere
+ * and receive those of its own ghosts, which follow the owned values.
+ */
+template <typename V, typename W>
+template <typename T>
+void BasicShardedGraph<V,W>::exchange( T *values ) {
+
+    vector<T> out( _exports.size() );
+    for ( size_t i = 0; i < _exports.size(); ++i ) {
+        out[i] = values[_exports[i]];
+    }
+
+    _transport->send( _shard, out.data(), out.size()*sizeof(T) );
+    _transport->receive( _shard, values + num_owned( _shard ),
+                         _ghosts.size()*sizeof(T) );
+}
+
+/**
+ * In the coordinator: the other side of exchange(). All the exports are
+ * received before any ghosts are sent, so no worker waits on another.
+ */
+template <typename V, typename W>
+template <typename T>
+void BasicShardedGraph<V,W>::route() {
+
+    vector<T> routed( _export_offsets.back() );
+
+    for ( size_t t = 0; t < num_shards(); ++t ) {
+        _transport->receive( t, routed.data() + _export_offsets[t],
+                             ( _export_offsets[t + 1] - _export_offsets[t] )*
+                                                                sizeof(T) );
+    }
+
+    for ( size_t s = 0; s < num_shards(); ++s ) {
+        vector<T> values( _routes[s].size() );
+        for ( size_t i = 0; i < values.size(); ++i ) {
+            values[i] = routed[_routes[s][i]];
+        }
+        _transport->send( s, values.data(), values.size()*sizeof(T) );
+    }
+}
+
+/**
+ * A worker sends the values of its owned vertices; the coordinator
+ * collects them into one vector over all the vertices.
+ */
+template <typename V, typename W>
+template <typename T>
+void BasicShardedGraph<V,W>::gather( vector<T> &values ) {
+
+    if ( _in_worker ) {
+        _transport->send( _shard, values.data(),
+                          num_owned( _shard )*sizeof(T) );
+        return;
+    }
+
+    values.resize( _num_verts );
+    for ( size_t s = 0; s < num_shards(); ++s ) {
+        _transport->receive( s, values.data() + _bounds[s],
+                             num_owned( s )*sizeof(T) );
+    }
+}
+
+/**
+ * The degree distribution, as Graph::degree_dist.
+ */
+template <typename V, typename W>
+void BasicShardedGraph<V,W>::degree_dist( const string &output_filename ) {
+
+    StageTimer timer( "sharded_degree_dist" );
+
+    spawn( [&]() {
+
+        const size_t owned = num_owned( _shard );
+
+        vector<V> degree( owned );
+
+        BasicEdgeStream<V,W> edges( shard_filename( _shard, ".tsv" ) );
+        edges.rewind();
+
+        const BasicEdge<V,W> *batch;
+        size_t count;
+
+        while( ( batch = edges.next_batch( count ) ) != NULL ) {
+            for ( size_t e = 0; e < count; ++e ) {
+                if ( batch[e].source < owned ) ++degree[batch[e].source];
+                if ( batch[e].target < owned ) ++degree[batch[e].target];
+            }
+        }
+
+        gather( degree );
+    });
+
+    vector<V> degree;
+    gather( degree );
+
+    join();
+
+    TsvWriter output( output_filename );
+
+    output.put( "node\tdegree\n" );
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        output.row( v, degree[v] );
+    }
+    output.close();
+}
+
+/**
+ * Eigenvector centrality by power iteration, as Graph::eigen_vect_cent
+ * without the warm start and checkpoints. Every iteration the workers
+ * sum the integer weights (first iteration only) and then the squared
+ * scores in vertex order, the running sum passed from shard to shard;
+ * the coordinator returns the norm and whether to stop, and routes the
+ * scaled boundary scores for the next iteration.
+ */
+template <typename V, typename W>
+void BasicShardedGraph<V,W>::eigen_vect_cent( const string &output_filename,
+                                              const int num_it,
+                                              const double eps ) {
+
+    StageTimer timer( "sharded_eigen_vect_cent" );
+
+    spawn( [&]() {
+
+        connect();
+
+        const size_t owned = num_owned( _shard );
+        const size_t num_local = owned + _ghosts.size();
+
+        double dnorm = sqrt( 1.0/static_cast<double>(_num_verts) );
+        vector<double> scores_a( num_local, dnorm );
+        vector<double> scores_b( num_local, 0.0 );
+        double *rold = scores_a.data();
+        double *rnew = scores_b.data();
+
+        // the newest normalized vector, rold after the swap when the
+        // iterations run out before converging
+        double *latest = rold;
+
+        double wnorm = 1.0;
+        long   wsq = 0;
+
+        BasicEdgeStream<V,W> edges( shard_filename( _shard, ".tsv" ) );
+
+        const BasicEdge<V,W> *batch;
+        size_t count;
+
+        for ( int it = 0; it < num_it; ++it ) {
+
+            edges.rewind();
+
+            memset( rnew, 0, owned*sizeof(double) );
+
+            while( ( batch = edges.next_batch( count ) ) != NULL ) {
+
+                for ( size_t e = 0; e < count; ++e ) {
+
+                    size_t source = batch[e].source;
+                    size_t target = batch[e].target;
+                    size_t weight = batch[e].weight;
+
+                    double dweight = static_cast<double>(weight)*wnorm;
+
+                    // an edge between shards is in both; each adds to its
+                    // own end, and the source's counts the weight
+                    if ( source < owned ) {
+                        rnew[source] += dweight*rold[target];
+                        if ( it == 0 ) {
+                            wsq += weight*weight;
+                        }
+                    }
+                    if ( target < owned ) {
+                        rnew[target] += dweight*rold[source];
+                    }
+                }
+            }
+
+            if ( it == 0 ) {
+                _transport->send( _shard, &wsq, sizeof(wsq) );
+                _transport->receive( _shard, &wsq, sizeof(wsq) );
+            }
+
+            wnorm = 1.0/sqrt( static_cast<double>(wsq) );
+
+            double norm_sq;
+            _transport->receive( _shard, &norm_sq, sizeof(norm_sq) );
+            for ( size_t i = 0; i < owned; ++i ) {
+                norm_sq += rnew[i]*rnew[i];
+            }
+            _transport->send( _shard, &norm_sq, sizeof(norm_sq) );
+
+            double norm;
+            char stop;
+            _transport->receive( _shard, &norm, sizeof(norm) );
+            _transport->receive( _shard, &stop, sizeof(stop) );
+
+            double inv_norm = 1.0/norm;
+            for ( size_t i = 0; i < owned; ++i ) {
+                rnew[i] *= inv_norm;
+            }
+            latest = rnew;
+
+            if ( stop ) break;
+
+            std::swap( rold, rnew );
+
+            exchange( rold );
+        }
+
+        vector<double> result( latest, latest + owned );
+        gather( result );
+    });
+
+    connect();
+
+    double norm_last = 1.0;
+    double delta = 1.0;
+    int it;
+
+    for ( it = 0; it < num_it; ++it ) {
+
+        fprintf(stderr,"%3d %14.7e %14.7e\n",it,delta,norm_last);
+
+        if ( it == 0 ) {
+            long wsq = 0;
+            for ( size_t s = 0; s < num_shards(); ++s ) {
+                long part;
+                _transport->receive( s, &part, sizeof(part) );
+                wsq += part;
+            }
+            for ( size_t s = 0; s < num_shards(); ++s ) {
+                _transport->send( s, &wsq, sizeof(wsq) );
+            }
+        }
+
+        double norm_sq = 0.0;
+        for ( size_t s = 0; s < num_shards(); ++s ) {
+            _transport->send( s, &norm_sq, sizeof(norm_sq) );
+            _transport->receive( s, &norm_sq, sizeof(norm_sq) );
+        }
+        double norm = sqrt( norm_sq );
+
+        delta = fabs( (norm - norm_last) )/norm_last;
+        char stop = ( delta < eps );
+
+        for ( size_t s = 0; s < num_shards(); ++s ) {
+            _transport->send( s, &norm, sizeof(norm) );
+            _transport->send( s, &stop, sizeof(stop) );
+        }
+
+        if ( stop ) break;
+
+        norm_last = norm;
+
+        route<double>();
+    }
+
+    fprintf(stderr,"num iterations: %d\n", it );
+    fprintf(stderr,"eigenvalue: %14.7e\n", norm_last );
+
+    vector<double> scores;
+    gather( scores );
+
+    join();
+
+    vector<size_t> ranks = sort_indexes( scores );
+
+    TsvWriter output( output_filename );
+
+    output.put( "node\trank\n" );
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        output.row( ranks[v], (v+1) );
+    }
+    output.close();
+}
+
+/**
+ * Connected components, with the statistics and membership file of
+ * Graph::cluster_stats. Each worker joins the components of its own
+ * edges, then every round labels each of them with the smallest label
+ * among its vertices, ghosts included, and trades the labels of the
+ * boundary; once no label changes, every vertex carries the smallest
+ * vertex id of its component.
+ */
+template <typename V, typename W>
+void BasicShardedGraph<V,W>::cluster_stats( const string &output_filename ) {
+
+    StageTimer timer( "sharded_cluster_stats" );
+
+    spawn( [&]() {
+
+        connect();
+
+        const size_t owned = num_owned( _shard );
+        const size_t num_local = owned + _ghosts.size();
+
+        vector<V> parent( num_local );
+        for ( size_t v = 0; v < num_local; ++v ) parent[v] = v;
+
+        vector<uint8_t> linked( owned, 0 );
+
+        BasicEdgeStream<V,W> edges( shard_filename( _shard, ".tsv" ) );
+        edges.rewind();
+
+        const BasicEdge<V,W> *batch;
+        size_t count;
+
+        auto find = [&]( V v ) {
+            while ( parent[v] != v ) {
+                parent[v] = parent[parent[v]];
+                v = parent[v];
+            }
+            return v;
+        };
+
+        while( ( batch = edges.next_batch( count ) ) != NULL ) {
+            for ( size_t e = 0; e < count; ++e ) {
+                V source = batch[e].source;
+                V target = batch[e].target;
+                if ( source < owned ) linked[source] = 1;
+                if ( target < owned ) linked[target] = 1;
+                V r1 = find( source );
+                V r2 = find( target );
+                if ( r1 != r2 ) parent[std::max( r1, r2 )] = std::min( r1, r2 );
+            }
+        }
+
+        for ( size_t v = 0; v < num_local; ++v ) parent[v] = find( v );
+
+        vector<V> label( num_local );
+        for ( size_t v = 0; v < owned; ++v ) label[v] = _bounds[_shard] + v;
+        for ( size_t g = 0; g < _ghosts.size(); ++g ) {
+            label[owned + g] = _ghosts[g];
+        }
+
+        vector<V> least( num_local );
+
+        for ( ;; ) {
+
+            std::fill( least.begin(), least.end(),
+                       std::numeric_limits<V>::max() );
+            for ( size_t v = 0; v < num_local; ++v ) {
+                least[parent[v]] = std::min( least[parent[v]], label[v] );
+            }
+
+            char changed = 0;
+            for ( size_t v = 0; v < num_local; ++v ) {
+                if ( label[v] != least[parent[v]] ) {
+                    if ( v < owned ) changed = 1;
+                    label[v] = least[parent[v]];
+                }
+            }
+
+            _transport->send( _shard, &changed, sizeof(changed) );
+            _transport->receive( _shard, &changed, sizeof(changed) );
+
+            if ( !changed ) break;
+
+            exchange( label.data() );
+        }
+
+        gather( label );
+        gather( linked );
+    });
+
+    connect();
+
+    size_t num_rounds = 0;
+
+    for ( ;; ) {
+
+        char changed = 0;
+        for ( size_t s = 0; s < num_shards(); ++s ) {
+            char part;
+            _transport->receive( s, &part, sizeof(part) );
+            changed |= part;
+        }
+        for ( size_t s = 0; s < num_shards(); ++s ) {
+            _transport->send( s, &changed, sizeof(changed) );
+        }
+
+        ++num_rounds;
+
+        if ( !changed ) break;
+
+        route<V>();
+    }
+
+    vector<V> label;
+    vector<uint8_t> linked;
+    gather( label );
+    gather( linked );
+
+    join();
+
+    fprintf(stderr,"label rounds: %zd\n", num_rounds );
+
+    // number the clusters by their smallest vertex, which is their label
+    vector<V> cluster( _num_verts, 0 );
+    vector<size_t> sizes;
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        if ( !linked[v] ) continue;
+        if ( cluster[label[v]] == 0 ) {
+            sizes.push_back( 0 );
+            cluster[label[v]] = sizes.size();
+        }
+        ++sizes[cluster[label[v]] - 1];
+    }
+
+    double frag = 1.0;
+    double nverts = static_cast<double>( _num_verts );
+    double norm = 1.0/( nverts*( nverts - 1.0 ) );
+    long num_clusters = sizes.size();
+    long max_cluster = 0;
+    long num_nodes = 0;
+    for ( size_t size : sizes ) {
+        double cs = static_cast<double>( size );
+        frag -= (cs*(cs-1.0)*norm);
+        max_cluster = std::max( max_cluster, static_cast<long>( size ) );
+        num_nodes += size;
+    }
+
+    double avg_cluster = static_cast<double>( num_nodes )/
+                                    static_cast<double>( num_clusters );
+
+    fprintf(stderr,"number of clusters: %zd\n", num_clusters);
+    fprintf(stderr,"average cluster size: %10.3e\n", avg_cluster);
+    fprintf(stderr,"max cluster size: %ld\n", max_cluster );
+    fprintf(stderr,"number isolated vertices: %ld\n",
+                                            (_num_verts - num_nodes) );
+    fprintf(stderr,"fragmentation: %14.7e\n",frag);
+
+    // cluster by cluster, the vertices of each ascending
+    vector<size_t> offsets( sizes.size() + 1, 0 );
+    for ( size_t c = 0; c < sizes.size(); ++c ) {
+        offsets[c + 1] = offsets[c] + sizes[c];
+    }
+    vector<V> nodes( num_nodes );
+    for ( size_t v = 0; v < _num_verts; ++v ) {
+        if ( linked[v] ) nodes[offsets[cluster[label[v]] - 1]++] = v;
+    }
+
+    TsvWriter out_fp( output_filename );
+
+    out_fp.put( "node\tmembership\n" );
+    size_t cluster_id = 1;
+    size_t next = 0;
+    for ( size_t size : sizes ) {
+        for ( size_t i = 0; i < size; ++i ) {
+            out_fp.row( nodes[next++], cluster_id );
+        }
+        ++cluster_id;
+    }
+    out_fp.close();
+}
+
+template class BasicShardedGraph<uint32_t,uint32_t>;
+template class BasicShardedGraph<uint64_t,uint64_t>;
@@ -0,0 +1,129 @@
+#ifndef SHARDED_GRAPH_H
+#define SHARDED_GRAPH_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "transport.h"
+#include "types.h"
+
+/**
+ * Analytics on an edge file split over worker processes, for graphs too
+ * large for one. The vertices are cut into contiguous ranges with about
+ * the same number of edge ends, and shard s keeps every edge with an end
+ * point in its range, in the order of the edge file. The vertices at the
+ * other end of those edges which another shard owns are its ghosts.
+ *
+ * partition() writes, in shard_dir,
+ *
+ *    ranges.tsv           first and end vertex of every shard
+ *    shard_NNN.tsv        the edges of a shard in local ids: the owned
+ *                         vertices 0..end-first-1, then the ghosts
+ *    shard_NNN.ghosts     the global ids of the ghosts, ascending
+ *
+ * Every analytic forks one worker per shard, connected to the calling
+ * process by a Transport. A worker streams only its own edges and keeps
+ * vectors only for its owned and ghost vertices. Between iterations the
+ * owners send the values of their boundary vertices to the coordinator,
+ * which routes them to the shards holding them as ghosts.
+ *
+ * The results are those of Graph: degree_dist and eigen_vect_cent write
+ * the same files byte for byte, since every vertex sums its edges in file
+ * order and the norm is summed over the vertices in order, carried from
+ * shard to shard. cluster_stats finds the same components and statistics
+ * by propagating the smallest vertex id of each component across the
+ * shards; its clusters are numbered by their smallest vertex, not in the
+ * order Graph happens to create them.
+ *
+ * Workers run no ThreadPool tasks, which do not survive fork(), and one
+ * sharded analytic runs at a time.
+ *
+ * Usage:
+ *
+ *     ShardedGraph graph( num_verts, shard_dir, "shm" );
+ *     graph.partition( edge_filename, num_shards );
+ *     graph.eigen_vect_cent( output_filename, num_it, eps );
+ */
+template <typename V, typename W>
+class BasicShardedGraph {
+
+ private:
+    size_t _num_verts;
+    std::string _shard_dir;
+    std::string _transport_kind;
+    std::vector<V> _bounds;
+
+    std::unique_ptr<Transport> _transport;
+    std::vector<pid_t> _workers;
+
+    // in a worker: its shard, the global ids of its ghosts and the local
+    // ids of its vertices which are ghosts elsewhere
+    bool _in_worker;
+    size_t _shard;
+    std::vector<V> _ghosts;
+    std::vector<V> _exports;
+
+    // in the coordinator: the start of the exports of every shard in the
+    // routed values, and for every ghost of every shard its routed value
+    std::vector<size_t> _export_offsets;
+    std::vector<std::vector<size_t>> _routes;
+
+ public:
+    typedef V vertex_type;
+    typedef W weight_type;
+
+    BasicShardedGraph( const size_t num_verts,
+                       const std::string &shard_dir,
+                       const std::string &transport = "shm" );
+
+    size_t num_shards() const {
+        return _bounds.empty() ? 0 : _bounds.size() - 1;
+    }
+
+    void partition( const std::string &edge_filename,
+                    const size_t num_shards );
+
+    void degree_dist( const std::string &output_filename );
+
+    void eigen_vect_cent( const std::string &output_filename,
+                          const int num_it,
+                          const double eps );
+
+    void cluster_stats( const std::string &output_filename );
+
+ private:
+    std::string shard_filename( const size_t s,
+                                const std::string &suffix ) const;
+
+    size_t num_owned( const size_t s ) const {
+        return _bounds[s + 1] - _bounds[s];
+    }
+
+    size_t owner( const V v ) const;
+
+    void spawn( const std::function<void()> &work );
+
+    void join();
+
+    void localize();
+
+    void connect();
+
+    template <typename T>
+    void exchange( T *values );
+
+    template <typename T>
+    void route();
+
+    template <typename T>
+    void gather( std::vector<T> &values );
+
+};
+
+typedef BasicShardedGraph<vertex_t,weight_t> ShardedGraph;
+
+#endif // SHARDED_GRAPH_H
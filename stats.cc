@@ -0,0 +1,189 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "misc.h"
+#include "stats.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+
+std::atomic<size_t> num_allocations( 0 );
+std::atomic<size_t> num_allocated_bytes( 0 );
+
+std::mutex report_mutex;
+vector<StageStats> report;
+
+double cpu_seconds() {
+    struct timespec ts;
+    clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &ts );
+    return static_cast<double>( ts.tv_sec ) + 1.0e-9*ts.tv_nsec;
+}
+
+long process_peak_rss_kb() {
+    struct rusage usage;
+    getrusage( RUSAGE_SELF, &usage );
+    return usage.ru_maxrss;
+}
+
+void *counted_alloc( size_t size ) {
+
+    num_allocations.fetch_add( 1, std::memory_order_relaxed );
+    num_allocated_bytes.fetch_add( size, std::memory_order_relaxed );
+
+    void *p = malloc( size ? size : 1 );
+    if ( p == NULL ) throw std::bad_alloc();
+
+    return p;
+}
+
+/**
+ * A rate, or 0 for stages too quick to measure.
+ */
+double per_second( const size_t n, const double seconds ) {
+    return seconds > 0.0 ? static_cast<double>( n )/seconds : 0.0;
+}
+
+}
+
+
+/**
+ * Every allocation through new goes through these, so that the report can
+ * count the allocations of each stage.
+ */
+void *operator new( size_t size ) {
+    return counted_alloc( size );
+}
+
+void *operator new[]( size_t size ) {
+    return counted_alloc( size );
+}
+
+void operator delete( void *p ) noexcept {
+    free( p );
+}
+
+void operator delete[]( void *p ) noexcept {
+    free( p );
+}
+
+void operator delete( void *p, size_t ) noexcept {
+    free( p );
+}
+
+void operator delete[]( void *p, size_t ) noexcept {
+    free( p );
+}
+
+
+size_t total_allocations() {
+    return num_allocations.load( std::memory_order_relaxed );
+}
+
+size_t total_allocated_bytes() {
+    return num_allocated_bytes.load( std::memory_order_relaxed );
+}
+
+StageTimer::StageTimer( const string &name ) {
+
+    _name = name;
+    _rows = 0;
+    _bytes = 0;
+    _stopped = false;
+
+    _allocations_start = total_allocations();
+    _allocated_bytes_start = total_allocated_bytes();
+    _cpu_start = cpu_seconds();
+    _start = std::chrono::steady_clock::now();
+}
+
+StageTimer::~StageTimer() {
+    stop();
+}
+
+void StageTimer::add_file( const string &filename ) {
+    struct stat st;
+    if ( stat( filename.c_str(), &st ) == 0 ) _bytes += st.st_size;
+}
+
+void StageTimer::stop() {
+
+    if ( _stopped ) return;
+    _stopped = true;
+
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() -
+                                                                    _start;
+
+    StageStats stats;
+    stats.name = _name;
+    stats.wall_seconds = wall.count();
+    stats.cpu_seconds = cpu_seconds() - _cpu_start;
+    stats.rows = _rows;
+    stats.bytes = _bytes;
+    stats.process_peak_rss_kb = process_peak_rss_kb();
+    stats.allocations = total_allocations() - _allocations_start;
+    stats.allocated_bytes = total_allocated_bytes() - _allocated_bytes_start;
+
+    std::lock_guard<std::mutex> lock( report_mutex );
+    report.push_back( stats );
+}
+
+vector<StageStats> stage_stats() {
+    std::lock_guard<std::mutex> lock( report_mutex );
+    return report;
+}
+
+void clear_stage_stats() {
+    std::lock_guard<std::mutex> lock( report_mutex );
+    report.clear();
+}
+
+void write_stats_report( const string &filename ) {
+
+    std::lock_guard<std::mutex> lock( report_mutex );
+
+    FILE *fp = fopen_csv( filename, "w", false );
+
+    fprintf( fp, "{\n  \"process_peak_rss_kb\": %ld,\n",
+                 process_peak_rss_kb() );
+    fprintf( fp, "  \"allocations\": %zd,\n", total_allocations() );
+    fprintf( fp, "  \"allocated_bytes\": %zd,\n", total_allocated_bytes() );
+    fprintf( fp, "  \"stages\": [" );
+
+    for ( size_t s = 0; s < report.size(); ++s ) {
+
+        const StageStats &stats = report[s];
+
+        fprintf( fp, "%s\n    {\"name\": \"", s ? "," : "" );
+        for ( char c : stats.name ) {
+            if ( c == '"' || c == '\\' ) fputc( '\\', fp );
+            fputc( c, fp );
+        }
+        fprintf( fp, "\", \"wall_seconds\": %.6f, \"cpu_seconds\": %.6f, "
+                     "\"rows\": %zd, \"bytes\": %zd, "
+                     "\"rows_per_second\": %.1f, \"bytes_per_second\": %.1f, "
+                     "\"process_peak_rss_kb\": %ld, "
+                     "\"allocations\": %zd, \"allocated_bytes\": %zd}",
+                     stats.wall_seconds, stats.cpu_seconds,
+                     stats.rows, stats.bytes,
+                     per_second( stats.rows, stats.wall_seconds ),
+                     per_second( stats.bytes, stats.wall_seconds ),
+                     stats.process_peak_rss_kb,
+                     stats.allocations, stats.allocated_bytes );
+    }
+
+    fprintf( fp, "\n  ]\n}\n" );
+
+    fclose( fp );
+}
@@ -0,0 +1,85 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * The measurements of one timed stage.
+ *
+ * CPU time, peak RSS and the allocation counts are process wide: a stage
+ * running alongside another, or spawning its own threads, is charged for
+ * everything the process did while it ran. The peak RSS is that of the
+ * process up to the end of the stage, so it only grows from one stage to
+ * the next; resetting the kernel's mark per stage would also lower the
+ * peak reported to the parent process and to tools like time(1).
+ */
+struct StageStats {
+    std::string name;
+    double wall_seconds;
+    double cpu_seconds;
+    size_t rows;
+    size_t bytes;
+    long process_peak_rss_kb;
+    size_t allocations;
+    size_t allocated_bytes;
+};
+
+/**
+ * Times a stage from construction until stop() or destruction and adds
+ * its StageStats to the process wide report.
+ *
+ * Usage:
+ *
+ *     StageTimer timer( "reduce_edges" );
+ *     ...
+ *     timer.add_rows( num_lines );
+ *     timer.add_file( filename );
+ */
+class StageTimer {
+
+ private:
+    std::string _name;
+    std::chrono::steady_clock::time_point _start;
+    double _cpu_start;
+    size_t _allocations_start;
+    size_t _allocated_bytes_start;
+    size_t _rows;
+    size_t _bytes;
+    bool _stopped;
+
+ public:
+    StageTimer( const std::string &name );
+
+    ~StageTimer();
+
+    void add_rows( const size_t n ) { _rows += n; }
+
+    void add_bytes( const size_t n ) { _bytes += n; }
+
+    void add_file( const std::string &filename );
+
+    void stop();
+
+};
+
+/**
+ * Number of operator new calls, and bytes requested, since the start.
+ */
+size_t total_allocations();
+size_t total_allocated_bytes();
+
+/**
+ * The stages timed so far, and a fresh start for the next measurement.
+ */
+std::vector<StageStats> stage_stats();
+void clear_stage_stats();
+
+/**
+ * Write the stages timed so far as a JSON report.
+ */
+void write_stats_report( const std::string &filename );
+
+#endif // STATS_H
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "synth.h"
+#include "tsv_writer.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+
+/**
+ * splitmix64, so that the data sets are identical on every platform,
+ * unlike the std::*_distribution classes.
+ */
+class Random {
+
+ private:
+    uint64_t _state;
+
+ public:
+    Random( const uint64_t seed ) : _state( seed ) {}
+
+    uint64_t next() {
+        uint64_t x = ( _state += 0x9e3779b97f4a7c15ull );
+        x = ( x ^ ( x >> 30 ) )*0xbf58476d1ce4e5b9ull;
+        x = ( x ^ ( x >> 27 ) )*0x94d049bb133111ebull;
+        return x ^ ( x >> 31 );
+    }
+
+    // uniform in [0,1)
+    double uniform() {
+        return static_cast<double>( next() >> 11 )*0x1.0p-53;
+    }
+};
+
+/**
+ * Cumulative weights of a Zipf distribution over n ranks: P(k) ~ 1/(k+1)^s
+ */
+vector<double> zipf_cdf( const size_t n, const double s ) {
+
+    vector<double> cdf( n );
+
+    double total = 0.0;
+    for ( size_t k = 0; k < n; ++k ) {
+        total += pow( static_cast<double>( k + 1 ), -s );
+        cdf[k] = total;
+    }
+    for ( size_t k = 0; k < n; ++k ) cdf[k] /= total;
+
+    return cdf;
+}
+
+size_t sample( const vector<double> &cdf, Random &random ) {
+    size_t k = std::upper_bound( cdf.begin(), cdf.end(), random.uniform() ) -
+                                                                cdf.begin();
+    return std::min( k, cdf.size() - 1 );
+}
+
+/**
+ * An identifier in the style of the SNAP data, e.g. B000GKXY4S. Multiplying
+ * by a unit modulo 36^digits scatters the ids without collisions.
+ */
+string snap_id( const char prefix, const size_t id, const int digits ) {
+
+    unsigned __int128 modulus = 1;
+    for ( int d = 0; d < digits; ++d ) modulus *= 36;
+
+    uint64_t x = static_cast<uint64_t>(
+                    ( static_cast<unsigned __int128>( id )*
+                                        0x9e3779b97f4a7c15ull ) % modulus );
+
+    static const char symbols[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+    string result( digits + 1, '0' );
+    result[0] = prefix;
+    for ( int d = digits; d > 0; --d ) {
+        result[d] = symbols[x % 36];
+        x /= 36;
+    }
+
+    return result;
+}
+
+}
+
+
+size_t generate_metadata( const string &filename,
+                          const SynthParams &params ) {
+
+    size_t num_products = params.num_products;
+    if ( num_products == 0 ) {
+        num_products = std::max<size_t>( 1, params.num_reviews/8 );
+    }
+
+    size_t num_reviewers = params.num_reviewers;
+    if ( num_reviewers == 0 ) {
+        num_reviewers = std::max<size_t>( 1, params.num_reviews/3 );
+    }
+
+    Random random( params.seed );
+
+    // products are grouped into works, the editions of which share their
+    // title and reviews
+    vector<size_t> work_start( 1, 0 );
+    for ( size_t p = 1; p < num_products; ++p ) {
+        if ( random.uniform() >= params.duplicate_titles ) {
+            work_start.push_back( p );
+        }
+    }
+    size_t num_works = work_start.size();
+    work_start.push_back( num_products );
+
+    vector<double> work_cdf = zipf_cdf( num_works, params.product_skew );
+    vector<double> reviewer_cdf = zipf_cdf( num_reviewers,
+                                            params.reviewer_skew );
+
+    // the share of each star rating in the SNAP data
+    const double score_cdf[5] = { 0.07, 0.12, 0.21, 0.41, 1.0 };
+
+    TsvWriter output( filename );
+
+    output.put( "productID\ttitle\treviewerID\tscreenName\t"
+                "helpfulness\tscore\ttime\n" );
+
+    size_t num_rows = 0;
+
+    for ( size_t r = 0; r < params.num_reviews; ++r ) {
+
+        size_t work = sample( work_cdf, random );
+        size_t reviewer = sample( reviewer_cdf, random );
+
+        double v = random.uniform();
+        size_t outof = static_cast<size_t>( -3.0*log( 1.0 - v ) );
+        size_t help = static_cast<size_t>( random.uniform()*( outof + 1 ) );
+
+        double u = random.uniform();
+        int score = 1;
+        while ( score < 5 && u >= score_cdf[score-1] ) ++score;
+
+        size_t time = 900000000 + random.next() % 450000000;
+
+        string title = "\"Title " + std::to_string( work ) + "\"";
+        string reviewer_id = snap_id( 'A', reviewer, 12 );
+        string screen_name = "\"User " + std::to_string( reviewer ) + "\"";
+        string helpfulness = std::to_string( help ) + "/" +
+                             std::to_string( outof );
+
+        for ( size_t p = work_start[work]; p < work_start[work+1]; ++p ) {
+            output.row( snap_id( 'B', p, 9 ), title, reviewer_id, screen_name,
+                        helpfulness, Fixed( score, 1 ), time );
+            ++num_rows;
+        }
+    }
+
+    output.close();
+
+    return num_rows;
+}
@@ -0,0 +1,45 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * The shape of a synthetic review data set. Zero counts of products or
+ * reviewers are derived from the number of reviews with roughly the
+ * ratios of the SNAP categories.
+ */
+struct SynthParams {
+    size_t num_reviews;
+    size_t num_products;
+    size_t num_reviewers;
+
+    // Zipf exponent of product popularity
+    double product_skew;
+
+    // power law exponent of the number of reviews per reviewer
+    double reviewer_skew;
+
+    // fraction of products which are another edition of the previous
+    // product: same title, same reviewers
+    double duplicate_titles;
+
+    uint64_t seed;
+
+    SynthParams( const size_t reviews = 100000 )
+        : num_reviews( reviews ), num_products( 0 ), num_reviewers( 0 ),
+          product_skew( 0.6 ), reviewer_skew( 0.8 ),
+          duplicate_titles( 0.05 ), seed( 1 ) {}
+};
+
+/**
+ * Write synthetic metadata in the tab separated format produced by
+ * extract_metadata and read by Reviews::load_reviews. The output only
+ * depends on the parameters. Returns the number of rows written, which
+ * exceeds num_reviews by the copies made for duplicate products.
+ */
+size_t generate_metadata( const std::string &filename,
+                          const SynthParams &params );
+
+#endif // SYNTH_H
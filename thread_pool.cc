@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "thread_pool.h"
+
+using std::vector;
+
+namespace {
+
+// slots for threads outside the pool, e.g. the Pipeline stage threads,
+// while they run a loop; further callers run their loops serially
+const int EXTERNAL_SLOTS = 16;
+
+int config_threads = 0;
+bool config_pin = false;
+bool created = false;
+
+thread_local int current_slot = -1;
+
+}
+
+
+/**
+ * Set the number of threads, counting the one starting a loop, and whether
+ * workers are pinned to cores. 0 threads means one per hardware thread.
+ * Only takes effect before the first parallel loop.
+ */
+void ThreadPool::configure( const int num_threads, const bool pin ) {
+
+    if ( created ) {
+        fprintf( stderr, "Thread pool already running, not reconfigured\n" );
+        return;
+    }
+
+    config_threads = num_threads;
+    config_pin = pin;
+}
+
+ThreadPool& ThreadPool::instance() {
+
+    static ThreadPool pool( config_threads > 0 ?
+                                static_cast<size_t>( config_threads ) :
+                                std::max( 1u,
+                                          std::thread::hardware_concurrency() ),
+                            config_pin );
+    return pool;
+}
+
+ThreadPool::ThreadPool( const size_t num_threads, const bool pin ) {
+
+    created = true;
+
+    _num_threads = num_threads;
+    _num_slots = num_threads - 1 + EXTERNAL_SLOTS;
+    _queued = 0;
+    _stop = false;
+
+    for ( size_t s = 0; s < _num_slots; ++s ) {
+        _queues.emplace_back( new Queue() );
+    }
+
+    for ( int s = _num_slots; s-- > static_cast<int>( num_threads - 1 ); ) {
+        _free_slots.push_back( s );
+    }
+
+    for ( size_t s = 0; s + 1 < num_threads; ++s ) {
+        _workers.emplace_back( &ThreadPool::work, this, s, pin );
+    }
+}
+
+ThreadPool::~ThreadPool() {
+
+    _stop = true;
+    {
+        std::lock_guard<std::mutex> lock( _wake_mutex );
+    }
+    _wake.notify_all();
+
+    for ( std::thread &worker : _workers ) worker.join();
+}
+
+/**
+ * The slot of the calling thread, or 0 outside of the pool's loops.
+ */
+int ThreadPool::slot() {
+    return current_slot + 1;
+}
+
+void ThreadPool::parallel_for( const size_t begin, const size_t end,
+                               const std::function<void(size_t,size_t)> &body,
+                               const size_t grain ) {
+
+    if ( end <= begin ) return;
+
+    if ( _num_threads == 1 || end - begin == 1 ) {
+        body( begin, end );
+        return;
+    }
+
+    Loop loop;
+    loop.body = body;
+    loop.costs = NULL;
+    loop.grain = ( grain > 0 ? grain :
+                        std::max( size_t( 1 ),
+                                  ( end - begin )/( 16*_num_threads ) ) );
+
+    run( loop, begin, end );
+}
+
+/**
+ * A loop over [0,n) where item i costs costs[i+1] - costs[i]; the grain is
+ * in units of cost. A single item is never split, however costly.
+ */
+void ThreadPool::parallel_for_weighted(
+                            const size_t *costs, const size_t n,
+                            const std::function<void(size_t,size_t)> &body,
+                            const size_t grain ) {
+
+    if ( n == 0 ) return;
+
+    if ( _num_threads == 1 || n == 1 ) {
+        body( 0, n );
+        return;
+    }
+
+    Loop loop;
+    loop.body = body;
+    loop.costs = costs;
+    loop.grain = ( grain > 0 ? grain :
+                        std::max( size_t( 1 ),
+                                  ( costs[n] - costs[0] )/
+                                                    ( 16*_num_threads ) ) );
+
+    run( loop, 0, n );
+}
+
+/**
+ * Run a loop from the calling thread and help with any task until it is
+ * done. A thread outside the pool borrows a slot for the duration.
+ */
+void ThreadPool::run( Loop &loop, const size_t begin, const size_t end ) {
+
+    int s = current_slot;
+    bool borrowed = false;
+
+    if ( s < 0 ) {
+        std::lock_guard<std::mutex> lock( _slot_mutex );
+        if ( !_free_slots.empty() ) {
+            s = _free_slots.back();
+            _free_slots.pop_back();
+            borrowed = true;
+        }
+    }
+
+    if ( s < 0 ) {
+        loop.body( begin, end );
+        return;
+    }
+
+    current_slot = s;
+
+    loop.pending = 1;
+
+    Task task = { &loop, begin, end };
+    execute( task, s );
+
+    while ( loop.pending.load( std::memory_order_acquire ) > 0 ) {
+        if ( find_task( s, task ) ) {
+            execute( task, s );
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    if ( borrowed ) {
+        current_slot = -1;
+        std::lock_guard<std::mutex> lock( _slot_mutex );
+        _free_slots.push_back( s );
+    }
+}
+
+/**
+ * Split the upper half off the task, onto the deque of 'slot', until it
+ * is within the grain, then run the rest.
+ */
+void ThreadPool::execute( Task task, const int slot ) {
+
+    Loop *loop = task.loop;
+
+    while ( task.end - task.begin > 1 ) {
+
+        size_t mid;
+
+        if ( loop->costs != NULL ) {
+            const size_t *costs = loop->costs;
+            size_t cost = costs[task.end] - costs[task.begin];
+            if ( cost <= loop->grain ) break;
+            mid = std::upper_bound( costs + task.begin + 1,
+                                    costs + task.end,
+                                    costs[task.begin] + cost/2 ) - costs;
+            mid = std::min( mid, task.end - 1 );
+        } else {
+            if ( task.end - task.begin <= loop->grain ) break;
+            mid = task.begin + ( task.end - task.begin )/2;
+        }
+
+        loop->pending.fetch_add( 1, std::memory_order_relaxed );
+        push( slot, Task{ loop, mid, task.end } );
+        task.end = mid;
+    }
+
+    loop->body( task.begin, task.end );
+
+    loop->pending.fetch_sub( 1, std::memory_order_release );
+}
+
+void ThreadPool::push( const int slot, const Task &task ) {
+
+    {
+        std::lock_guard<std::mutex> lock( _queues[slot]->mutex );
+        _queues[slot]->tasks.push_back( task );
+    }
+    ++_queued;
+
+    {
+        std::lock_guard<std::mutex> lock( _wake_mutex );
+    }
+    _wake.notify_one();
+}
+
+/**
+ * The newest task of our own deque, or else the oldest of another.
+ */
+bool ThreadPool::find_task( const int slot, Task &task ) {
+
+    {
+        Queue &own = *_queues[slot];
+        std::lock_guard<std::mutex> lock( own.mutex );
+        if ( !own.tasks.empty() ) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            --_queued;
+            return true;
+        }
+    }
+
+    if ( _queued.load( std::memory_order_relaxed ) == 0 ) return false;
+
+    for ( size_t i = 1; i < _num_slots; ++i ) {
+        Queue &victim = *_queues[( slot + i ) % _num_slots];
+        std::lock_guard<std::mutex> lock( victim.mutex );
+        if ( !victim.tasks.empty() ) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            --_queued;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::work( const int slot, const bool pin ) {
+
+    current_slot = slot;
+
+#ifdef __linux__
+    if ( pin ) {
+        unsigned num_cpus = std::max( 1u, std::thread::hardware_concurrency() );
+        cpu_set_t cpus;
+        CPU_ZERO( &cpus );
+        CPU_SET( slot % num_cpus, &cpus );
+        if ( pthread_setaffinity_np( pthread_self(), sizeof(cpus), &cpus ) ) {
+            fprintf( stderr, "Could not pin worker %d\n", slot );
+        }
+    }
+#endif
+
+    Task task;
+
+    while ( true ) {
+
+        if ( find_task( slot, task ) ) {
+            execute( task, slot );
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock( _wake_mutex );
+        _wake.wait( lock, [this]() { return _queued > 0 || _stop; } );
+
+        if ( _stop && _queued == 0 ) return;
+    }
+}
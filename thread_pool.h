@@ -0,0 +1,121 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * The process wide work-stealing scheduler behind every parallel loop in
+ * Reviews, Graph and MinHashIndex, so that stages running side by side in
+ * the Pipeline share one set of workers instead of each starting its own.
+ *
+ * A loop over [begin,end) starts as a single task. The thread running a
+ * task splits off the upper half onto its own deque until the task is no
+ * bigger than the grain, then runs what is left. Owners take the newest,
+ * smallest tasks from the back of their deque and idle workers steal the
+ * oldest, largest ones from the front, so a slow range, such as the row of
+ * a hub vertex, is worked around rather than waited for. The thread which
+ * starts a loop takes part in it until the loop is done, which also makes
+ * nested loops safe.
+ *
+ * parallel_for_weighted splits by a prefix sum of costs, e.g. the offsets
+ * of a CSR, instead of by index, so that every grain holds about the same
+ * number of edges rather than of vertices.
+ *
+ * Every thread running tasks has a slot, a small integer below
+ * max_slots(), for per-thread accumulators; slot 0 is for a thread which
+ * runs a whole loop on its own.
+ *
+ * Usage:
+ *
+ *     ThreadPool::configure( num_threads, pin );  // optional, before use
+ *     parallel_for( 0, n, [&]( size_t begin, size_t end ) { ... } );
+ */
+class ThreadPool {
+
+ private:
+    struct Loop {
+        std::function<void(size_t,size_t)> body;
+        const size_t *costs;
+        size_t grain;
+        std::atomic<size_t> pending;
+    };
+
+    struct Task {
+        Loop *loop;
+        size_t begin;
+        size_t end;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    size_t _num_threads;
+    size_t _num_slots;
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::thread> _workers;
+
+    std::atomic<size_t> _queued;
+    std::atomic<bool> _stop;
+    std::mutex _wake_mutex;
+    std::condition_variable _wake;
+
+    std::mutex _slot_mutex;
+    std::vector<int> _free_slots;
+
+ public:
+    static void configure( const int num_threads, const bool pin = false );
+
+    static ThreadPool& instance();
+
+    ~ThreadPool();
+
+    size_t num_threads() const {
+        return _num_threads;
+    }
+
+    size_t max_slots() const {
+        return _num_slots + 1;
+    }
+
+    static int slot();
+
+    void parallel_for( const size_t begin, const size_t end,
+                       const std::function<void(size_t,size_t)> &body,
+                       const size_t grain = 0 );
+
+    void parallel_for_weighted( const size_t *costs, const size_t n,
+                                const std::function<void(size_t,size_t)> &body,
+                                const size_t grain = 0 );
+
+ private:
+    ThreadPool( const size_t num_threads, const bool pin );
+
+    void run( Loop &loop, const size_t begin, const size_t end );
+
+    void execute( Task task, const int slot );
+
+    void push( const int slot, const Task &task );
+
+    bool find_task( const int slot, Task &task );
+
+    void work( const int slot, const bool pin );
+
+};
+
+inline void parallel_for( const size_t begin, const size_t end,
+                          const std::function<void(size_t,size_t)> &body,
+                          const size_t grain = 0 ) {
+    ThreadPool::instance().parallel_for( begin, end, body, grain );
+}
+
+#endif // THREAD_POOL_H
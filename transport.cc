@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "transport.h"
+
+using std::string;
+using std::unique_ptr;
+
+namespace {
+
+const size_t RING_BYTES = 1ul << 20;
+
+[[noreturn]] void peer_exited( const size_t channel ) {
+    fprintf( stderr, "Shard channel %zd: the other end exited\n", channel );
+    abort();
+}
+
+}
+
+/**
+ * A single producer, single consumer byte ring. head and tail count the
+ * bytes written and read; the producer copies into the free space and the
+ * consumer out of the used space without holding the mutex.
+ */
+struct ShmTransport::Ring {
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    pid_t worker;
+    uint64_t head;
+    uint64_t tail;
+    char data[RING_BYTES];
+};
+
+ShmTransport::ShmTransport( const size_t num_channels ) {
+
+    _num_channels = num_channels;
+    _size = 2*num_channels*sizeof(Ring);
+    _coordinator = getpid();
+    _endpoint = COORDINATOR;
+
+    void *region = mmap( NULL, _size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+    if ( region == MAP_FAILED ) {
+        fprintf( stderr, "Could not map %zd bytes for the shard channels\n",
+                                                                    _size );
+        abort();
+    }
+    _region = static_cast<char*>( region );
+
+    pthread_mutexattr_t mutex_attr;
+    pthread_mutexattr_init( &mutex_attr );
+    pthread_mutexattr_setpshared( &mutex_attr, PTHREAD_PROCESS_SHARED );
+    pthread_mutexattr_setrobust( &mutex_attr, PTHREAD_MUTEX_ROBUST );
+
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init( &cond_attr );
+    pthread_condattr_setpshared( &cond_attr, PTHREAD_PROCESS_SHARED );
+
+    for ( size_t r = 0; r < 2*_num_channels; ++r ) {
+        Ring *ring = reinterpret_cast<Ring*>( _region + r*sizeof(Ring) );
+        pthread_mutex_init( &ring->mutex, &mutex_attr );
+        pthread_cond_init( &ring->changed, &cond_attr );
+        ring->worker = 0;
+        ring->head = 0;
+        ring->tail = 0;
+    }
+
+    pthread_condattr_destroy( &cond_attr );
+    pthread_mutexattr_destroy( &mutex_attr );
+}
+
+ShmTransport::~ShmTransport() {
+    munmap( _region, _size );
+}
+
+void ShmTransport::attach( const int endpoint ) {
+
+    _endpoint = endpoint;
+
+    if ( _endpoint != COORDINATOR ) {
+        __atomic_store_n( &ring( _endpoint, true )->worker, getpid(),
+                          __ATOMIC_RELEASE );
+    }
+}
+
+ShmTransport::Ring* ShmTransport::ring( const size_t channel,
+                                        const bool to_worker ) const {
+
+    if ( channel >= _num_channels ||
+         ( _endpoint != COORDINATOR &&
+                        channel != static_cast<size_t>( _endpoint ) ) ) {
+        fprintf( stderr, "Shard channel %zd is not open here\n", channel );
+        abort();
+    }
+
+    return reinterpret_cast<Ring*>( _region +
+                                ( 2*channel + to_worker )*sizeof(Ring) );
+}
+
+/**
+ * Lock r->mutex. The mutexes are robust, so a peer which died holding one
+ * hands it over with EOWNERDEAD; the ring is then in an unknown state and
+ * the run cannot go on.
+ */
+void ShmTransport::lock( Ring *r, const size_t channel ) {
+
+    int err = pthread_mutex_lock( &r->mutex );
+    if ( err == EOWNERDEAD ) peer_exited( channel );
+    if ( err != 0 ) {
+        fprintf( stderr, "Shard channel %zd: could not lock: %s\n",
+                         channel, strerror( err ) );
+        abort();
+    }
+}
+
+/**
+ * Wait, holding r->mutex, for the other end to move. Every second without
+ * progress checks that it is still running: a worker whose coordinator
+ * has gone is orphaned, and the coordinator looks for its child having
+ * exited without reaping it.
+ */
+void ShmTransport::wait( Ring *r, const size_t channel ) {
+
+    struct timespec deadline;
+    clock_gettime( CLOCK_REALTIME, &deadline );
+    deadline.tv_sec += 1;
+
+    int err = pthread_cond_timedwait( &r->changed, &r->mutex, &deadline );
+    if ( err == EOWNERDEAD ) peer_exited( channel );
+    if ( err != ETIMEDOUT ) return;
+
+    if ( _endpoint != COORDINATOR ) {
+        if ( getppid() != _coordinator ) peer_exited( channel );
+        return;
+    }
+
+    pid_t worker = __atomic_load_n( &ring( channel, true )->worker,
+                                    __ATOMIC_ACQUIRE );
+    if ( worker == 0 ) return;
+
+    siginfo_t info;
+    memset( &info, 0, sizeof(info) );
+    if ( waitid( P_PID, worker, &info, WEXITED | WNOHANG | WNOWAIT ) == 0 &&
+                                                    info.si_pid == worker ) {
+        peer_exited( channel );
+    }
+}
+
+void ShmTransport::send( const size_t channel,
+                         const void *data,
+                         const size_t bytes ) {
+
+    Ring *r = ring( channel, _endpoint == COORDINATOR );
+
+    const char *p = static_cast<const char*>( data );
+    size_t left = bytes;
+
+    while ( left > 0 ) {
+
+        lock( r, channel );
+        while ( r->head - r->tail == RING_BYTES ) wait( r, channel );
+        size_t at = r->head % RING_BYTES;
+        size_t n = std::min( left, RING_BYTES - ( r->head - r->tail ) );
+        n = std::min( n, RING_BYTES - at );
+        pthread_mutex_unlock( &r->mutex );
+
+        memcpy( r->data + at, p, n );
+
+        lock( r, channel );
+        r->head += n;
+        pthread_cond_broadcast( &r->changed );
+        pthread_mutex_unlock( &r->mutex );
+
+        p += n;
+        left -= n;
+    }
+}
+
+void ShmTransport::receive( const size_t channel,
+                            void *data,
+                            const size_t bytes ) {
+
+    Ring *r = ring( channel, _endpoint != COORDINATOR );
+
+    char *p = static_cast<char*>( data );
+    size_t left = bytes;
+
+    while ( left > 0 ) {
+
+        lock( r, channel );
+        while ( r->head == r->tail ) wait( r, channel );
+        size_t at = r->tail % RING_BYTES;
+        size_t n = std::min( left, static_cast<size_t>( r->head - r->tail ) );
+        n = std::min( n, RING_BYTES - at );
+        pthread_mutex_unlock( &r->mutex );
+
+        memcpy( p, r->data + at, n );
+
+        lock( r, channel );
+        r->tail += n;
+        pthread_cond_broadcast( &r->changed );
+        pthread_mutex_unlock( &r->mutex );
+
+        p += n;
+        left -= n;
+    }
+}
+
+SocketTransport::SocketTransport( const size_t num_channels ) {
+
+    _endpoint = COORDINATOR;
+
+    for ( size_t c = 0; c < num_channels; ++c ) {
+        int fds[2];
+        if ( socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) != 0 ) {
+            fprintf( stderr, "Could not open shard channel %zd: %s\n",
+                             c, strerror( errno ) );
+            abort();
+        }
+        _coordinator_fds.push_back( fds[0] );
+        _worker_fds.push_back( fds[1] );
+    }
+}
+
+SocketTransport::~SocketTransport() {
+    for ( int fd : _coordinator_fds ) if ( fd >= 0 ) close( fd );
+    for ( int fd : _worker_fds ) if ( fd >= 0 ) close( fd );
+}
+
+/**
+ * Close the ends this process does not use, so that a peer exiting is
+ * seen as the end of its stream. The coordinator attaches once all the
+ * workers are forked.
+ */
+void SocketTransport::attach( const int endpoint ) {
+
+    _endpoint = endpoint;
+
+    for ( size_t c = 0; c < _worker_fds.size(); ++c ) {
+        bool mine = ( _endpoint == static_cast<int>( c ) );
+        if ( _endpoint == COORDINATOR || !mine ) {
+            close( _worker_fds[c] );
+            _worker_fds[c] = -1;
+        }
+        if ( _endpoint != COORDINATOR ) {
+            close( _coordinator_fds[c] );
+            _coordinator_fds[c] = -1;
+        }
+    }
+}
+
+int SocketTransport::fd( const size_t channel ) const {
+
+    int fd = -1;
+    if ( channel < _worker_fds.size() ) {
+        fd = ( _endpoint == COORDINATOR ? _coordinator_fds[channel]
+                                        : _worker_fds[channel] );
+    }
+
+    if ( fd < 0 ) {
+        fprintf( stderr, "Shard channel %zd is not open here\n", channel );
+        abort();
+    }
+
+    return fd;
+}
+
+void SocketTransport::send( const size_t channel,
+                            const void *data,
+                            const size_t bytes ) {
+
+    int out = fd( channel );
+
+    const char *p = static_cast<const char*>( data );
+    size_t left = bytes;
+
+    while ( left > 0 ) {
+        ssize_t n = ::send( out, p, left, MSG_NOSIGNAL );
+        if ( n < 0 && errno == EINTR ) continue;
+        if ( n <= 0 ) peer_exited( channel );
+        p += n;
+        left -= n;
+    }
+}
+
+void SocketTransport::receive( const size_t channel,
+                               void *data,
+                               const size_t bytes ) {
+
+    int in = fd( channel );
+
+    char *p = static_cast<char*>( data );
+    size_t left = bytes;
+
+    while ( left > 0 ) {
+        ssize_t n = read( in, p, left );
+        if ( n < 0 && errno == EINTR ) continue;
+        if ( n <= 0 ) peer_exited( channel );
+        p += n;
+        left -= n;
+    }
+}
+
+unique_ptr<Transport> make_transport( const string &kind,
+                                      const size_t num_channels ) {
+
+    if ( kind == "shm" ) {
+        return unique_ptr<Transport>( new ShmTransport( num_channels ) );
+    }
+    if ( kind == "socket" ) {
+        return unique_ptr<Transport>( new SocketTransport( num_channels ) );
+    }
+
+    fprintf( stderr, "Unknown transport: %s\n", kind.c_str() );
+    exit(1);
+}
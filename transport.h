@@ -0,0 +1,118 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+/**
+ * The channels between the coordinator of a ShardedGraph and its worker
+ * processes, one per worker. A channel carries a byte stream each way;
+ * send() returns once the bytes are handed over and receive() blocks until
+ * they have all arrived. Messages have no framing, so both ends agree on
+ * their sizes in advance.
+ *
+ * The transport is created before the workers are forked. Every process
+ * then calls attach() once, with its worker number or COORDINATOR, and
+ * uses only the channels its role allows: the coordinator all of them, a
+ * worker its own. A peer which exits while a channel is in use aborts the
+ * other end, so a failed worker does not hang the run.
+ *
+ * Usage:
+ *
+ *     unique_ptr<Transport> transport = make_transport( "shm", num_workers );
+ *     ... fork ...
+ *     transport->attach( worker );
+ *     transport->send( worker, data, bytes );
+ */
+class Transport {
+
+ public:
+    static const int COORDINATOR = -1;
+
+    virtual ~Transport() {}
+
+    virtual void attach( const int endpoint ) = 0;
+
+    virtual void send( const size_t channel,
+                       const void *data,
+                       const size_t bytes ) = 0;
+
+    virtual void receive( const size_t channel,
+                          void *data,
+                          const size_t bytes ) = 0;
+
+};
+
+/**
+ * Ring buffers in an anonymous shared mapping, a robust mutex and a
+ * condition variable each, shared across fork(). One ring per direction
+ * and channel.
+ */
+class ShmTransport : public Transport {
+
+ private:
+    struct Ring;
+
+    size_t _num_channels;
+    size_t _size;
+    pid_t _coordinator;
+    int _endpoint;
+    char *_region;
+
+ public:
+    ShmTransport( const size_t num_channels );
+
+    ~ShmTransport();
+
+    void attach( const int endpoint );
+
+    void send( const size_t channel, const void *data, const size_t bytes );
+
+    void receive( const size_t channel, void *data, const size_t bytes );
+
+ private:
+    Ring* ring( const size_t channel, const bool to_worker ) const;
+
+    void lock( Ring *r, const size_t channel );
+
+    void wait( Ring *r, const size_t channel );
+
+};
+
+/**
+ * A connected pair of Unix stream sockets per channel.
+ */
+class SocketTransport : public Transport {
+
+ private:
+    std::vector<int> _coordinator_fds;
+    std::vector<int> _worker_fds;
+    int _endpoint;
+
+ public:
+    SocketTransport( const size_t num_channels );
+
+    ~SocketTransport();
+
+    void attach( const int endpoint );
+
+    void send( const size_t channel, const void *data, const size_t bytes );
+
+    void receive( const size_t channel, void *data, const size_t bytes );
+
+ private:
+    int fd( const size_t channel ) const;
+
+};
+
+/**
+ * The transport named "shm" or "socket".
+ */
+std::unique_ptr<Transport> make_transport( const std::string &kind,
+                                           const size_t num_channels );
+
+#endif // TRANSPORT_H
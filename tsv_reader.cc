@@ -0,0 +1,105 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "misc.h"
+#include "tsv_reader.h"
+
+using std::string;
+using std::vector;
+
+TsvReader::TsvReader( const string &filename,
+                      const size_t num_cols,
+                      const bool discard_header,
+                      const size_t buffer_size ) {
+
+    _filename = filename;
+    _num_cols = num_cols;
+    _line = ( discard_header ? 1 : 0 );
+    _eof = false;
+
+    _fp = fopen_csv( filename, "r", discard_header );
+
+    _buffer.resize( buffer_size );
+    _begin = 0;
+    _end = 0;
+}
+
+TsvReader::~TsvReader() {
+    fclose( _fp );
+}
+
+/**
+ * Parse every complete row in the next block of the file into 'rows'.
+ * Returns the number of rows, or 0 at the end of the file.
+ */
+size_t TsvReader::read_rows( vector<uint64_t> &rows ) {
+
+    rows.clear();
+
+    while ( 1 ) {
+
+        const char *begin = _buffer.data() + _begin;
+        const char *end = _buffer.data() + _end;
+
+        const char *last = static_cast<const char*>(
+                                        memrchr( begin, '\n', end - begin ) );
+        const char *stop;
+
+        if ( last != NULL ) {
+            stop = last + 1;
+        } else if ( _eof ) {
+            stop = end;
+        } else {
+            fill();
+            continue;
+        }
+
+        if ( begin == stop ) return 0;
+
+        const char *parsed = parse_uint_rows( begin, stop, _num_cols, _line,
+                                [&]( const uint64_t *row ) {
+                                    rows.insert( rows.end(), row,
+                                                 row + _num_cols ); } );
+
+        if ( parsed == NULL ) {
+            fprintf( stderr, "%s:%zd: expected %zd unsigned 64 bit integer "
+                             "columns\n", _filename.c_str(), _line, _num_cols );
+            abort();
+        }
+
+        _begin += stop - begin;
+
+        if ( !rows.empty() ) return rows.size()/_num_cols;
+    }
+}
+
+/**
+ * Move the unparsed tail to the front of the buffer and read the next
+ * block behind it, growing the buffer if a single line fills it.
+ */
+bool TsvReader::fill() {
+
+    size_t tail = _end - _begin;
+    memmove( _buffer.data(), _buffer.data() + _begin, tail );
+    _begin = 0;
+    _end = tail;
+
+    if ( _end == _buffer.size() ) _buffer.resize( 2*_buffer.size() );
+
+    size_t n = fread( _buffer.data() + _end, 1, _buffer.size() - _end, _fp );
+
+    if ( n == 0 ) {
+        if ( ferror( _fp ) ) {
+            fprintf( stderr, "Error reading file: %s\n", _filename.c_str() );
+            abort();
+        }
+        _eof = true;
+        return false;
+    }
+
+    _end += n;
+    return true;
+}
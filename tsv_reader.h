@@ -0,0 +1,176 @@
+#ifndef TSV_READER_H
+#define TSV_READER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * The number of leading ASCII digits in the 8 bytes at p (little endian
+ * SWAR: a byte is a digit when its value xor '0' is below 10).
+ */
+inline int swar_digit_count( const char *p, uint64_t &digits ) {
+
+    uint64_t x;
+    memcpy( &x, p, sizeof(x) );
+
+    digits = x ^ 0x3030303030303030ull;
+    uint64_t non_digit = ( ( ( digits & 0x7f7f7f7f7f7f7f7full ) +
+                             0x7676767676767676ull ) | digits ) &
+                         0x8080808080808080ull;
+
+    return ( non_digit == 0 ? 8 : __builtin_ctzll( non_digit ) >> 3 );
+}
+
+/**
+ * Convert 'len' (1 to 8) digit values, first digit in the lowest byte,
+ * into an integer with three multiply-shift steps.
+ */
+inline uint64_t swar_digit_value( uint64_t digits, const int len ) {
+
+    digits <<= ( 8*( 8 - len ) );
+
+    digits = ( ( digits & 0x0f0f0f0f0f0f0f0full ) * 2561 ) >> 8;
+    digits = ( ( digits & 0x00ff00ff00ff00ffull ) * 6553601 ) >> 16;
+    digits = ( ( digits & 0x0000ffff0000ffffull ) * 42949672960001ull ) >> 32;
+
+    return digits;
+}
+
+/**
+ * Parse the complete rows of unsigned integers in [begin,end), handing
+ * each row of 'num_cols' values to emit(const uint64_t *row). Fields are
+ * separated by tabs, spaces or commas; empty lines are skipped. Digits are
+ * consumed eight at a time where the buffer allows it.
+ *
+ * 'line' counts the lines seen so far. Returns NULL, with 'line' at the
+ * offending line, if a row is malformed or a value does not fit in 64
+ * bits; otherwise 'end'. Values of up to 19 digits cannot overflow, so
+ * only longer ones pay for the checks.
+ */
+template <typename F>
+inline const char* parse_uint_rows( const char *begin, const char *end,
+                                    const size_t num_cols, size_t &line,
+                                    F emit ) {
+
+    static const uint64_t pow10[9] = { 1ull, 10ull, 100ull, 1000ull,
+                                       10000ull, 100000ull, 1000000ull,
+                                       10000000ull, 100000000ull };
+
+    uint64_t row[16];
+
+    if ( num_cols == 0 || num_cols > 16 ) return NULL;
+
+    const char *p = begin;
+
+    while ( p < end ) {
+
+        ++line;
+
+        size_t col = 0;
+
+        while ( p < end && *p != '\n' ) {
+
+            char c = *p;
+
+            if ( c == '\t' || c == ' ' || c == ',' || c == '\r' ) {
+                ++p;
+                continue;
+            }
+
+            if ( c < '0' || c > '9' || col == num_cols ) return NULL;
+
+            uint64_t x = 0;
+            int num_digits = 0;
+
+            while ( p + 8 <= end ) {
+                uint64_t digits;
+                int len = swar_digit_count( p, digits );
+                if ( len == 0 ) break;
+                uint64_t value = swar_digit_value( digits, len );
+                num_digits += len;
+                if ( num_digits <= 19 ) {
+                    x = x*pow10[len] + value;
+                } else if ( num_digits > 20 ||
+                            __builtin_mul_overflow( x, pow10[len], &x ) ||
+                            __builtin_add_overflow( x, value, &x ) ) {
+                    return NULL;
+                }
+                p += len;
+                if ( len < 8 ) break;
+            }
+
+            for ( ; p < end && *p >= '0' && *p <= '9'; ++p ) {
+                uint64_t value = *p - '0';
+                if ( ++num_digits <= 19 ) {
+                    x = x*10 + value;
+                } else if ( num_digits > 20 ||
+                            __builtin_mul_overflow( x, 10, &x ) ||
+                            __builtin_add_overflow( x, value, &x ) ) {
+                    return NULL;
+                }
+            }
+
+            row[col++] = x;
+        }
+
+        ++p;
+
+        if ( col == num_cols ) {
+            emit( row );
+        } else if ( col != 0 ) {
+            return NULL;
+        }
+    }
+
+    return end;
+}
+
+/**
+ * A bulk reader for files of unsigned integer columns, such as the edge,
+ * degree, rank and membership files. The file is read in large blocks and
+ * all complete rows of a block are returned at once, row after row.
+ *
+ * Usage:
+ *
+ *     TsvReader reader( filename, 2 );
+ *     while ( ( num_rows = reader.read_rows( rows ) ) > 0 ) { ... }
+ *
+ * A malformed row is reported with its line number and aborts, as does a
+ * read error. read_rows() returns 0 only at the end of the file.
+ */
+class TsvReader {
+
+ private:
+    std::string _filename;
+    FILE *_fp;
+    size_t _num_cols;
+    size_t _line;
+    bool _eof;
+
+    std::vector<char> _buffer;
+    size_t _begin;
+    size_t _end;
+
+ public:
+    TsvReader( const std::string &filename,
+               const size_t num_cols,
+               const bool discard_header = true,
+               const size_t buffer_size = 4ul << 20 );
+
+    ~TsvReader();
+
+    size_t read_rows( std::vector<uint64_t> &rows );
+
+    bool eof() const {
+        return _eof && _begin == _end;
+    }
+
+ private:
+    bool fill();
+
+};
+
+#endif // TSV_READER_H
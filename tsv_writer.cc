@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tsv_writer.h"
+
+using std::string;
+using std::vector;
+
+/**
+ * The single background thread shared by all writers opened with
+ * 'background' set. Each writer has at most one block in flight, so the
+ * blocks of a file are written in order.
+ */
+class Flusher {
+
+ private:
+    std::mutex _mutex;
+    std::condition_variable _work;
+    std::deque<TsvWriter*> _queue;
+    bool _stop;
+    std::thread _thread;
+
+ public:
+    static Flusher& instance() {
+        static Flusher flusher;
+        return flusher;
+    }
+
+    void submit( TsvWriter *writer ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _queue.push_back( writer );
+        _work.notify_one();
+    }
+
+ private:
+    Flusher() : _stop( false ) {
+        _thread = std::thread( &Flusher::run, this );
+    }
+
+    ~Flusher() {
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+            _stop = true;
+        }
+        _work.notify_all();
+        _thread.join();
+    }
+
+    void run() {
+
+        while ( 1 ) {
+
+            TsvWriter *writer;
+            {
+                std::unique_lock<std::mutex> lock( _mutex );
+                _work.wait( lock, [this] { return !_queue.empty() || _stop; } );
+                if ( _queue.empty() ) return;
+                writer = _queue.front();
+                _queue.pop_front();
+            }
+
+            writer->write_block( writer->_spare.data(), writer->_spare_used );
+
+            std::lock_guard<std::mutex> lock( writer->_mutex );
+            writer->_in_flight = false;
+            writer->_flushed.notify_all();
+        }
+    }
+
+};
+
+
+TsvWriter::TsvWriter( const string &filename,
+                      const bool background,
+                      const size_t buffer_size,
+                      const bool append ) {
+
+    _filename = filename;
+    _background = background;
+    _at_row_start = true;
+
+    _buffer.resize( buffer_size < 4096 ? 4096 : buffer_size );
+    _used = 0;
+
+    _spare_used = 0;
+    _in_flight = false;
+
+    _fd = open( filename.c_str(),
+                O_WRONLY | O_CREAT | ( append ? O_APPEND : O_TRUNC ), 0644 );
+
+    if ( _fd < 0 ) {
+        fprintf( stderr, "Could not open file: %s\n", filename.c_str() );
+        abort();
+    }
+
+    if ( _background ) {
+        _spare.resize( _buffer.size() );
+        Flusher::instance();
+    }
+}
+
+TsvWriter::~TsvWriter() {
+    if ( _fd >= 0 ) close();
+}
+
+/**
+ * A fixed point number. Most fit a small buffer on the stack; a large
+ * value at a high precision, up to 309 integer digits and the decimals,
+ * is formatted again into one sized for it.
+ */
+TsvWriter& TsvWriter::field( const Fixed x ) {
+
+    char tmp[512];
+    const char *text = tmp;
+    std::to_chars_result res = std::to_chars( tmp, tmp + sizeof(tmp), x.value,
+                                              std::chars_format::fixed,
+                                              x.precision );
+
+    vector<char> wide;
+    if ( res.ec != std::errc() ) {
+        wide.resize( 320 + std::max( x.precision, 0 ) );
+        text = wide.data();
+        res = std::to_chars( wide.data(), wide.data() + wide.size(),
+                             x.value, std::chars_format::fixed,
+                             x.precision );
+    }
+    if ( res.ec != std::errc() ) {
+        fprintf( stderr, "Could not format %g with %d decimals for %s\n",
+                         x.value, x.precision, _filename.c_str() );
+        abort();
+    }
+    reserve( 1 );
+    separate();
+    put( text, res.ptr - text );
+
+    return *this;
+}
+
+TsvWriter& TsvWriter::field( const char *s ) {
+    reserve( 1 );
+    separate();
+    put( s, strlen( s ) );
+    return *this;
+}
+
+TsvWriter& TsvWriter::field( const string &s ) {
+    reserve( 1 );
+    separate();
+    put( s.data(), s.size() );
+    return *this;
+}
+
+/**
+ * Append raw text; row separators are the caller's responsibility.
+ */
+void TsvWriter::put( const char *s, size_t len ) {
+
+    if ( len > _buffer.size()/2 ) {
+        flush();
+        std::unique_lock<std::mutex> lock( _mutex );
+        _flushed.wait( lock, [this] { return !_in_flight; } );
+        write_block( s, len );
+        return;
+    }
+
+    reserve( len );
+    memcpy( _buffer.data() + _used, s, len );
+    _used += len;
+}
+
+void TsvWriter::flush() {
+
+    if ( _used == 0 ) return;
+
+    if ( !_background ) {
+        write_block( _buffer.data(), _used );
+        _used = 0;
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        _flushed.wait( lock, [this] { return !_in_flight; } );
+        _in_flight = true;
+    }
+
+    _buffer.swap( _spare );
+    _spare_used = _used;
+    _used = 0;
+
+    Flusher::instance().submit( this );
+}
+
+void TsvWriter::write_block( const char *data, size_t len ) {
+
+    while ( len > 0 ) {
+        ssize_t n = write( _fd, data, len );
+        if ( n < 0 && errno == EINTR ) continue;
+        if ( n <= 0 ) {
+            fprintf( stderr, "Error writing file: %s\n", _filename.c_str() );
+            abort();
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+/**
+ * Write out everything buffered and sync it to disk. Returns the size of
+ * the file, the point a resumed run cuts it back to.
+ */
+size_t TsvWriter::sync() {
+
+    flush();
+
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        _flushed.wait( lock, [this] { return !_in_flight; } );
+    }
+
+    struct stat st;
+    if ( fdatasync( _fd ) != 0 || fstat( _fd, &st ) != 0 ) {
+        fprintf( stderr, "Error syncing file: %s\n", _filename.c_str() );
+        abort();
+    }
+
+    return st.st_size;
+}
+
+void TsvWriter::close() {
+
+    flush();
+
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        _flushed.wait( lock, [this] { return !_in_flight; } );
+    }
+
+    ::close( _fd );
+    _fd = -1;
+}
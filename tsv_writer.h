@@ -0,0 +1,125 @@
+#ifndef TSV_WRITER_H
+#define TSV_WRITER_H
+
+#include <charconv>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+ * A floating point field written with a fixed number of decimals.
+ */
+struct Fixed {
+    double value;
+    int precision;
+
+    Fixed( const double v, const int p ) : value( v ), precision( p ) {}
+};
+
+/**
+ * A buffered writer for tab separated output. Numbers are formatted with
+ * std::to_chars straight into a large buffer which is handed to the
+ * kernel with a single write() when full.
+ *
+ * With 'background' set, a full buffer is swapped for a spare one and
+ * written by a shared flusher thread, so that formatting continues while
+ * the previous block goes to disk. This suits the large bucket fan-outs.
+ *
+ * With 'append' set the file is extended rather than truncated, for a
+ * stage resuming from a Checkpoint after cutting the file back to the
+ * size that sync() returned.
+ *
+ * Usage:
+ *
+ *     TsvWriter out( filename );
+ *     out.put( "node\tdegree\n" );
+ *     out.row( v, degree[v] );
+ */
+class TsvWriter {
+
+ private:
+    std::string _filename;
+    int _fd;
+    bool _background;
+    bool _at_row_start;
+
+    std::vector<char> _buffer;
+    size_t _used;
+
+    std::vector<char> _spare;
+    size_t _spare_used;
+    bool _in_flight;
+    std::mutex _mutex;
+    std::condition_variable _flushed;
+
+ public:
+    TsvWriter( const std::string &filename,
+               const bool background = false,
+               const size_t buffer_size = 1ul << 20,
+               const bool append = false );
+
+    ~TsvWriter();
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value, TsvWriter&>::type
+    field( const T x ) {
+        reserve( 24 );
+        separate();
+        char *p = _buffer.data() + _used;
+        _used = std::to_chars( p, p + 24, x ).ptr - _buffer.data();
+        return *this;
+    }
+
+    TsvWriter& field( const Fixed x );
+    TsvWriter& field( const char *s );
+    TsvWriter& field( const std::string &s );
+
+    void end_row() {
+        reserve( 1 );
+        _buffer[_used++] = '\n';
+        _at_row_start = true;
+    }
+
+    template <typename... T>
+    void row( const T&... fields ) {
+        int expand[] = { 0, ( field( fields ), 0 )... };
+        (void) expand;
+        end_row();
+    }
+
+    void put( const char *s, size_t len );
+
+    void put( const std::string &s ) {
+        put( s.data(), s.size() );
+    }
+
+    void put( const char *s ) {
+        put( s, strlen( s ) );
+    }
+
+    size_t sync();
+
+    void close();
+
+ private:
+    void separate() {
+        if ( !_at_row_start ) _buffer[_used++] = '\t';
+        _at_row_start = false;
+    }
+
+    void reserve( const size_t len ) {
+        if ( _used + len + 1 > _buffer.size() ) flush();
+    }
+
+    void flush();
+
+    void write_block( const char *data, size_t len );
+
+    friend class Flusher;
+
+};
+
+#endif // TSV_WRITER_H
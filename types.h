@@ -0,0 +1,21 @@
+#ifndef TYPES_H
+#define TYPES_H
+
+#include <cstdint>
+
+/**
+ * The integer types of vertex ids and edge weights in Reviews, Graph and
+ * the edge streams. 32 bits cover the largest SNAP categories and halve
+ * every vertex array and edge batch. Build with -DAZREV_64BIT_IDS for
+ * inputs with more than 2^32 - 1 reviewers or products; both widths are
+ * always compiled, as BasicGraph<uint64_t,uint64_t> etc.
+ */
+#ifdef AZREV_64BIT_IDS
+typedef uint64_t vertex_t;
+typedef uint64_t weight_t;
+#else
+typedef uint32_t vertex_t;
+typedef uint32_t weight_t;
+#endif
+
+#endif // TYPES_H